@@ -31,6 +31,33 @@ For more information, please refer to
 ![Zlib License](https://choosealicense.com/licenses/zlib/)
 
 ## CHANGELOG
+- [2.0] Added the ALLOCATOR_STATS statistics layer, alc_stats_dump() and
+        dynalc_fragmentation(). Freeing no longer counts towards the total
+        number of allocations. Stack markers also hold the number of live
+        allocations, so rewinding keeps the count right.
+        blkalc_bookkeeper() also gives the counts of lock-free block
+        allocators.
+- [1.9] Added stackalc_alloc_aligned(), dynalc_malloc_aligned(),
+        dynalc_realloc_aligned() and blkalc_init_aligned() for any power of
+        two alignment, and BLKALC_CACHE_LINE.
+- [1.8] Added virtual memory regions on Linux, vmregion_* (ALLOCATOR_VMREGION),
+        committed on demand by the stack and first fit dynamic allocators.
+        Region lengths and stack offsets are 64 bit.
+- [1.7] Added stack markers, stackalc_mark()/stackalc_rewind(), and the double
+        ended stack allocator, dstackalc_*.
+- [1.6] Added the double buffered frame allocator, framealc_*.
+- [1.5] Added lock-free block allocator mode, blkalc_init_lockfree(), and
+        per thread block magazines.
+- [1.4] Added dynalc_realloc(), resizing in place when possible.
+- [1.3] Dynamic allocator entries are doubly linked, dynalc_free is O(1).
+- [1.2] Added TLSF mode to the dynamic allocator, dynalc_init_tlsf().
+- [1.1] Replaced the char mutex with an atomic spinlock with exponential
+        backoff, and an optional futex lock on Linux (TH_FUTEX_MUTEX).
+        The stack allocator is now locked too. C++ builds use <atomic>.
+        Fixed block allocator handle stack and block layout.
+- [1.0.1] Fixed dynalc_malloc() placing entries over the next header when a
+          gap could not fit the header alignment padding, reading the header
+          of a missing next entry, and counting failed allocations.
 - [1.0] Rewrote lib to be more modern.
         Updated block allocator to be smarter.
 - [0.1] Ported seperated implementation into a single header file
@@ -58,6 +85,14 @@ something like:
 #define ALLOCATOR_BACKEND static
 #endif /*ALLOCATOR_BACKEND */
 
+/*syscall(), madvise() and the mmap flags are not declared by strict ISO C
+  modes, the feature macro has to be defined before the first system header
+  is included*/
+#if (defined(TH_FUTEX_MUTEX) || defined(ALLOCATOR_VMREGION)) && \
+	defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdint.h>
 
 #ifndef NULL
@@ -80,22 +115,100 @@ something like:
 	( (((IDX)+(_TH_ALIGNMENT)-1) & ~((_TH_ALIGNMENT)-1)) - (IDX) )
 #define _TH_IS_ALIGNED(IDX) \
 	( ((IDX) & ((_TH_ALIGNMENT)-1)) == 0 )
+/*Alignments of the *_aligned() functions, any power of two*/
+#define _TH_ALIGN_TO(IDX, ALIGN) \
+	( ((IDX)+(ALIGN)-1) & ~((unsigned long)(ALIGN)-1) )
+#define _TH_IS_POW2(N) \
+	( (N) != 0 && ((N) & ((N)-1)) == 0 )
+
+/* *****************************************************************************
+ * Mutex
+ *
+ * The allocators are guarded by a test-and-test-and-set spinlock built on C11
+ * atomics. A waiter spins on a plain load, so it does not bounce the cache
+ * line, and backs off exponentially until it yields its time slice.
+ *
+ * #define TH_FUTEX_MUTEX   - On Linux, sleep in the kernel while contended
+ *                            instead of spinning. Include this header before
+ *                            any system header, or define _DEFAULT_SOURCE.
+ * #define TH_DISABLE_MUTEX - Single threaded use, locking compiles away.
+ *
+ * A zeroed mutex is unlocked, so zero initialized allocators are valid.
+ * ****************************************************************************/
 
-/*Mutex Macros*/
-typedef char _th_mutex;
 #ifndef TH_DISABLE_MUTEX
-#define _TH_MUTEX_TAKE(mutex) ( mutex = 1 )
-#define _TH_MUTEX_GIVE(mutex) ( mutex = 0 )
-#define _TH_MUTEX_IS_TAKEN(mutex) ( (mutex) ? 1:0 )
-#define _TH_MUTEX_WAIT_THEN_TAKE(mutex) \
-	do {do {} while (_TH_MUTEX_IS_TAKEN(mutex)); _TH_MUTEX_TAKE(mutex); \
-	} while (0)
-#else 
-#define _TH_MUTEX_TAKE(mutex)
-#define _TH_MUTEX_GIVE(mutex)
+#ifdef __cplusplus
+#include <atomic>
+typedef std::atomic<int> _th_mutex;
+using std::atomic_uint;
+using std::atomic_uint_least64_t;
+using std::atomic_init;
+using std::atomic_load_explicit;
+using std::atomic_store_explicit;
+using std::atomic_exchange_explicit;
+using std::atomic_compare_exchange_strong_explicit;
+using std::atomic_compare_exchange_weak_explicit;
+using std::atomic_fetch_add_explicit;
+using std::atomic_fetch_sub_explicit;
+using std::atomic_signal_fence;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_seq_cst;
+#else
+#include <stdatomic.h>
+typedef atomic_int _th_mutex;
+#endif /*__cplusplus*/
+
+#ifndef _TH_MUTEX_BACKOFF_MAX
+#define _TH_MUTEX_BACKOFF_MAX 1024
+#endif /*_TH_MUTEX_BACKOFF_MAX*/
+
+#if defined(__x86_64__) || defined(__i386__)
+#define _TH_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define _TH_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define _TH_CPU_RELAX() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+#if defined(TH_FUTEX_MUTEX) && defined(__linux__)
+#define _TH_FUTEX_MUTEX
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#if defined(__GLIBC__) && !defined(__USE_MISC)
+#error "TH_FUTEX_MUTEX needs syscall(), define _DEFAULT_SOURCE before including any system header"
+#endif
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#define _TH_YIELD() sched_yield()
+#else
+#define _TH_YIELD()
+#endif
+
+#define _TH_MUTEX_INIT(mutex) atomic_init(&(mutex), 0)
+#define _TH_MUTEX_IS_TAKEN(mutex) \
+	( atomic_load_explicit(&(mutex), memory_order_relaxed) != 0 )
+#define _TH_MUTEX_TRY_TAKE(mutex) _th_mutex_try_take(&(mutex))
+#define _TH_MUTEX_WAIT_THEN_TAKE(mutex) _th_mutex_wait_then_take(&(mutex))
+#define _TH_MUTEX_GIVE(mutex) _th_mutex_give(&(mutex))
+
+ALLOCATOR_API
+int _th_mutex_try_take(_th_mutex* _m);
+ALLOCATOR_API
+void _th_mutex_wait_then_take(_th_mutex* _m);
+ALLOCATOR_API
+void _th_mutex_give(_th_mutex* _m);
+
+#else
+typedef char _th_mutex;
+#define _TH_MUTEX_INIT(mutex) ( (mutex) = 0 )
 #define _TH_MUTEX_IS_TAKEN(mutex) ( 0 )
+#define _TH_MUTEX_TRY_TAKE(mutex) ( 1 )
 #define _TH_MUTEX_WAIT_THEN_TAKE(mutex)
-#endif /*TH_NO_MUTEX*/
+#define _TH_MUTEX_GIVE(mutex)
+#endif /*TH_DISABLE_MUTEX*/
 
 typedef enum {
 	ALLOCATOR_OK = 0,
@@ -105,15 +218,108 @@ typedef enum {
 	ALLOCATOR_STATUS_COUNT
 }allocator_status;
 	
+/* *****************************************************************************
+ * Statistics
+ *
+ * #define ALLOCATOR_STATS - Every allocator bookkeeper also tracks bytes in
+ *                           use and their high water mark, a histogram of
+ *                           allocation sizes and histograms of the cycles
+ *                           spent per allocation and free.
+ *
+ * Histogram bucket k counts values in [2^k, 2^(k+1)), bucket 0 also counts 0.
+ * Cycles are read from the time stamp counter where there is one, and the
+ * measurement includes waiting for the lock. Block allocators in lock-free
+ * mode only count blocks, read them with blkalc_bookkeeper().
+ * ****************************************************************************/
+
+#define ALC_STATS_BUCKETS 32
+
 typedef struct {
 	uint32_t total;
 	uint32_t curr;
+#ifdef ALLOCATOR_STATS
+	uint64_t bytes;
+	uint64_t bytes_peak;
+	uint32_t sizes[ALC_STATS_BUCKETS];
+	uint32_t alloc_cycles[ALC_STATS_BUCKETS];
+	uint32_t free_cycles[ALC_STATS_BUCKETS];
+#endif /*ALLOCATOR_STATS*/
 }_allocation_bookkeeper;
 
-#define _ALC_BOOKKEEPER_NEW(book) ( (book) = (_allocation_bookkeeper) {0,0} )
-#define _ALC_BOOKKEEPER_CLEAR(book) ((book).curr = 0)
+#define _ALC_BOOKKEEPER_NEW(book) ( (book) = (_allocation_bookkeeper) {0} )
+#define _ALC_BOOKKEEPER_CLEAR(book) ( (book).curr = 0, _ALC_STATS_BYTES(book, 0) )
 #define _ALC_BOOKKEEPER_INCREMENT(book) ( (book).curr++, (book).total++ )
-#define _ALC_BOOKKEEPER_DECREMENT(book) ( (book).curr--, (book).total++ )
+#define _ALC_BOOKKEEPER_DECREMENT(book) ( (book).curr-- )
+
+#ifdef ALLOCATOR_STATS
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define _ALC_CYCLES() __builtin_ia32_rdtsc()
+#elif defined(__aarch64__)
+#define _ALC_CYCLES() _alc_cycles()
+#else
+#include <time.h>
+#define _ALC_CYCLES() ( (uint64_t)clock() )
+#endif
+
+/*Fragmentation of the free space, see dynalc_fragmentation()*/
+typedef struct {
+	uint64_t free_bytes;
+	uint64_t largest_free;
+	/*1 - largest_free / free_bytes, 0 when all free space is one gap*/
+	double ratio;
+}alc_fragmentation;
+
+ALLOCATOR_API
+void alc_stats_dump(FILE* _out, const char* _name, _allocation_bookkeeper* _book);
+
+/*Declares the start time of a measurement, no semicolon after it*/
+#define _ALC_STATS_TIMER(t) uint64_t t = _ALC_CYCLES();
+#define _ALC_STATS_ALLOC(book, size, used) \
+	( _alc_stats_hist((book).sizes, (size)), _ALC_STATS_BYTES(book, (book).bytes + (used)) )
+#define _ALC_STATS_FREE(book, used) _ALC_STATS_BYTES(book, (book).bytes - (used))
+#define _ALC_STATS_BYTES(book, n) _alc_stats_bytes(&(book), (n))
+#define _ALC_STATS_ALLOC_CYCLES(book, t) _alc_stats_hist((book).alloc_cycles, _ALC_CYCLES() - (t))
+#define _ALC_STATS_FREE_CYCLES(book, t) _alc_stats_hist((book).free_cycles, _ALC_CYCLES() - (t))
+#else
+#define _ALC_STATS_TIMER(t)
+#define _ALC_STATS_ALLOC(book, size, used) ( (void)0 )
+#define _ALC_STATS_FREE(book, used) ( (void)0 )
+#define _ALC_STATS_BYTES(book, n) ( (void)0 )
+#define _ALC_STATS_ALLOC_CYCLES(book, t) ( (void)0 )
+#define _ALC_STATS_FREE_CYCLES(book, t) ( (void)0 )
+#endif /*ALLOCATOR_STATS*/
+
+/* *****************************************************************************
+ * Virtual Memory Region
+ *
+ * #define ALLOCATOR_VMREGION - On Linux, provide regions that reserve address
+ *                              space up front and commit pages on demand.
+ *                              Include this header before any system header,
+ *                              or define _DEFAULT_SOURCE.
+ *
+ * A vmregion reserves a range with mmap without backing it. Allocators that
+ * hand out memory from the front, the stack and the first fit dynamic
+ * allocator, commit pages in VMREGION_COMMIT_STEP chunks as they grow, and
+ * decommit them with madvise when reset. The other allocators commit the
+ * whole region when initialized.
+ * ****************************************************************************/
+
+#if defined(ALLOCATOR_VMREGION) && defined(__linux__)
+#define _ALLOCATOR_VMREGION
+#endif
+
+/*A multiple of the page size on all supported targets*/
+#ifndef VMREGION_COMMIT_STEP
+#define VMREGION_COMMIT_STEP ALC_KB_2_B(64)
+#endif /*VMREGION_COMMIT_STEP*/
+
+typedef struct {
+    uint8_t* mem;
+    uint64_t reserved;
+    uint64_t committed;
+}vmregion;
 
 /* *****************************************************************************
  * Memory Region
@@ -121,16 +327,47 @@ typedef struct {
 
 typedef struct {
     uint8_t* mem;
-    uint32_t len;
+    uint64_t len;
     uint8_t freeable;
+    /*Set if the region lies in a vmregion and must be committed before use*/
+    vmregion* vm;
 }memregion;
 
 ALLOCATOR_API
-memregion region(void* _mem, uint32_t _len);
+memregion region(void* _mem, uint64_t _len);
 
 ALLOCATOR_API
 char region_ok(memregion* _r);
 
+#ifdef _ALLOCATOR_VMREGION
+ALLOCATOR_API
+allocator_status vmregion_reserve(vmregion* _vm, uint64_t _size);
+
+ALLOCATOR_API
+void vmregion_release(vmregion* _vm);
+
+ALLOCATOR_API
+memregion vmregion_region(vmregion* _vm);
+
+ALLOCATOR_API
+char vmregion_commit(vmregion* _vm, uint64_t _end);
+
+ALLOCATOR_API
+void vmregion_decommit(vmregion* _vm, uint64_t _keep);
+
+/*Make sure the region is usable up to ptr end, and give back what lies
+  beyond ptr keep*/
+#define _ALC_REGION_COMMIT(r, end) \
+	( (r).vm == NULL || (uint64_t)((uint8_t*)(end) - (r).vm->mem) <= (r).vm->committed || \
+	  vmregion_commit((r).vm, (uint8_t*)(end) - (r).vm->mem) )
+#define _ALC_REGION_DECOMMIT(r, keep) \
+	do { if ((r).vm != NULL) vmregion_decommit((r).vm, (uint8_t*)(keep) - (r).vm->mem); } while (0)
+#else
+#define _ALC_REGION_COMMIT(r, end) ( 1 )
+#define _ALC_REGION_DECOMMIT(r, keep) do {} while (0)
+#endif /*_ALLOCATOR_VMREGION*/
+#define _ALC_REGION_COMMIT_ALL(r) _ALC_REGION_COMMIT(r, (r).mem + (r).len)
+
 /* *****************************************************************************
  * Stack Allocator
  * ****************************************************************************/
@@ -139,7 +376,8 @@ typedef struct {
 	memregion region;
     void* scratch_buffer;
 	_allocation_bookkeeper bookkeeper;
-	uint32_t offset;
+    _th_mutex is_in_use;
+	uint64_t offset;
 }stackallocator;
 
 ALLOCATOR_API
@@ -148,18 +386,108 @@ allocator_status stackalc_new(stackallocator* _a, memregion _mem, void* _scratch
 ALLOCATOR_API
 void* stackalc_alloc(stackallocator* _a, uint32_t _n);
 
+ALLOCATOR_API
+void* stackalc_alloc_aligned(stackallocator* _a, uint32_t _n, uint32_t _align);
+
 ALLOCATOR_API
 void stackalc_reset(stackallocator* _a);
 
+/*Markers are the stack offset and the number of live allocations when they
+  were taken, rewinding to one frees everything allocated after it*/
+typedef struct {
+    uint64_t offset;
+    uint32_t count;
+}stack_marker;
+
+ALLOCATOR_API
+stack_marker stackalc_mark(stackallocator* _a);
+
+ALLOCATOR_API
+allocator_status stackalc_rewind(stackallocator* _a, stack_marker _m);
+
+/* *****************************************************************************
+ * Double Ended Stack Allocator
+ * ****************************************************************************/
+
+/*Allocates from both ends of the region towards the middle. low is the offset
+  of the free space and high the offset of the end of it. count holds the
+  live allocations of each end, indexed by dstack_end*/
+typedef enum {
+    DSTACK_LOW = 0,
+    DSTACK_HIGH = 1,
+}dstack_end;
+
+typedef struct {
+	memregion region;
+	_allocation_bookkeeper bookkeeper;
+    _th_mutex is_in_use;
+	uint32_t low;
+	uint32_t high;
+	uint32_t count[2];
+}dstackallocator;
+
+ALLOCATOR_API
+allocator_status dstackalc_new(dstackallocator* _a, memregion _mem);
+
+ALLOCATOR_API
+void* dstackalc_alloc(dstackallocator* _a, dstack_end _end, uint32_t _n);
+
+ALLOCATOR_API
+stack_marker dstackalc_mark(dstackallocator* _a, dstack_end _end);
+
+ALLOCATOR_API
+allocator_status dstackalc_rewind(dstackallocator* _a, dstack_end _end, stack_marker _m);
+
+ALLOCATOR_API
+void dstackalc_reset(dstackallocator* _a);
+
+/* *****************************************************************************
+ * Frame Allocator
+ * ****************************************************************************/
+
+/*Two stack allocators that take turns, one per frame. An allocation is valid
+  for the frame it was made in and the next one, swapping resets the older
+  stack. When a frame is full, allocations overflow into a double ended
+  scratch stack, frame 0 uses the low end and frame 1 the high end, so each
+  frame drops only its own overflow.*/
+typedef struct {
+    stackallocator frames[2];
+    dstackallocator scratch;
+    uint8_t current;
+    _th_mutex is_in_use;
+    /*Bytes used by the last finished frame and the most by any frame, both
+      including alignment padding and overflow. overflow_frames counts the
+      frames that needed the scratch region*/
+    uint32_t last_frame_bytes;
+    uint32_t high_water;
+    uint32_t overflow_frames;
+}frameallocator;
+
+ALLOCATOR_API
+allocator_status framealc_init(frameallocator* _fa, memregion _mem, memregion _scratch);
+
+ALLOCATOR_API
+void* framealc_alloc(frameallocator* _fa, uint32_t _n);
+
+ALLOCATOR_API
+void framealc_swap(frameallocator* _fa);
+
+ALLOCATOR_API
+uint32_t framealc_frame_bytes(frameallocator* _fa);
+
 /* *****************************************************************************
  * Dynamic Allocator
  * ****************************************************************************/
 /*TODO: Add a sequencial_malloc() function that takes n allocations and forces
   them to be sequencial in memory*/
 
+/*Entries are doubly linked in address order. prev is the offset of the
+  previous entry data from the region start, 0 for the first entry, which
+  keeps the header at 16 bytes*/
 typedef struct {
 	uint8_t* next;
 	uint32_t size;
+	uint32_t prev;
 }_dynalc_header;
  
 #define _ALLOCATOR_DATA2HEADER(data) \
@@ -168,26 +496,79 @@ typedef struct {
 #define _ALLOCATOR_HEADER2DATA(header) \
     ((uint8_t*)(header)) + sizeof(_dynalc_header)
 
+/*TLSF (two level segregated fit) mode.
+  Free blocks are kept in size class lists, a first level per power of two
+  split into _DYNALC_TLSF_SL_COUNT second level classes. Two bitmaps find
+  the smallest non-empty class that fits, so malloc and free are O(1) with
+  a bounded worst case. Block headers keep their physical predecessor and
+  are laid out like _dynalc_header, so size is read the same in both modes.
+  The control structure is placed at the start of the region.*/
+#define _DYNALC_TLSF_SL_LOG2 4
+#define _DYNALC_TLSF_SL_COUNT (1 << _DYNALC_TLSF_SL_LOG2)
+#define _DYNALC_TLSF_FL_SHIFT (_DYNALC_TLSF_SL_LOG2 + 4)
+#define _DYNALC_TLSF_FL_COUNT (32 - _DYNALC_TLSF_FL_SHIFT + 1)
+#define _DYNALC_TLSF_SMALL (1 << _DYNALC_TLSF_FL_SHIFT)
+
+#define _DYNALC_BLOCK_FREE 0x0f4eeb10
+#define _DYNALC_BLOCK_USED 0x05edb10c
+
+typedef struct _dynalc_block _dynalc_block;
+struct _dynalc_block {
+	_dynalc_block* prev_phys;
+	uint32_t size;
+	uint32_t state;
+};
+
+/*Free blocks keep their class list links in the payload*/
+typedef struct {
+	_dynalc_block* next;
+	_dynalc_block* prev;
+}_dynalc_links;
+
+typedef struct {
+	uint32_t fl_bitmap;
+	uint32_t sl_bitmap[_DYNALC_TLSF_FL_COUNT];
+	_dynalc_block* heads[_DYNALC_TLSF_FL_COUNT][_DYNALC_TLSF_SL_COUNT];
+}_dynalc_tlsf;
+
 typedef struct {
     memregion region;
     _allocation_bookkeeper bookkeeper;
     _th_mutex is_in_use;
     uint8_t* first;
     uint8_t* last;
+    /*First fit searches from here, entries before it have no gap after them
+      that fits an entry. NULL to search from first*/
+    uint8_t* search_from;
+    /*NULL in first fit mode*/
+    _dynalc_tlsf* tlsf;
 }dynallocator;
 
 ALLOCATOR_API
 allocator_status dynalc_init(dynallocator* _da, memregion _region);
 ALLOCATOR_API
+allocator_status dynalc_init_tlsf(dynallocator* _da, memregion _region);
+ALLOCATOR_API
 void* dynalc_malloc(dynallocator* _da, int _size);
+ALLOCATOR_API
+void* dynalc_malloc_aligned(dynallocator* _da, int _size, uint32_t _align);
 /*
 ALLOCATOR_API
 void* dynalc_sequencial_malloc(dynallocator* _da, int _n, ...);
+*/
 ALLOCATOR_API
 void* dynalc_realloc(dynallocator* _da, void* _oldptr, uint32_t _newsize);
-*/
+ALLOCATOR_API
+void* dynalc_realloc_aligned(dynallocator* _da, void* _oldptr, uint32_t _newsize,
+                             uint32_t _align);
 ALLOCATOR_API
 void* dynalc_free(dynallocator* _da, void* _ptr);
+#ifdef ALLOCATOR_STATS
+ALLOCATOR_API
+alc_fragmentation dynalc_fragmentation(dynallocator* _da);
+ALLOCATOR_API
+void dynalc_stats_dump(FILE* _out, dynallocator* _da);
+#endif /*ALLOCATOR_STATS*/
 ALLOCATOR_API
 allocator_status dynalc_free_all(dynallocator* _da);
 
@@ -204,6 +585,15 @@ typedef struct {
     _th_mutex is_in_use;
 	uint32_t block_size;
 	uint32_t block_count;
+	uint32_t block_align;
+#ifndef TH_DISABLE_MUTEX
+    /*Lock-free mode, see blkalc_init_lockfree()*/
+    char lockfree;
+    atomic_uint_least64_t free_head;
+    /*The bookkeeper counts of lock-free mode*/
+    atomic_uint n_taken;
+    atomic_uint n_total;
+#endif /*TH_DISABLE_MUTEX*/
 }blkallocator;
 
 struct blk_handle {
@@ -216,13 +606,25 @@ struct blk_handle {
 #define blk_ptr(handle, type) \
 	((type*)_blkalc_ptr(handle))
 
-/*Calculates size of block memory and a blockhandle stack*/
+/*Calculates size of a blockhandle stack and the aligned block memory after it*/
 #define BLKALC_OPTIMAL_MEMSIZE(n_blocks, block_size)                    \
-	( ((n_blocks) * (_TH_ALIGN(block_size))) + ((sizeof(blk_handle) * (n_blocks))) )
+	BLKALC_OPTIMAL_MEMSIZE_ALIGNED(n_blocks, block_size, _TH_ALIGNMENT)
+#define BLKALC_OPTIMAL_MEMSIZE_ALIGNED(n_blocks, block_size, align)     \
+	( ((n_blocks) * (_TH_ALIGN_TO(block_size, align))) + ((sizeof(blk_handle) * (n_blocks))) \
+	  + (align) )
+
+/*Block alignment that keeps every block on cache lines of its own, so
+  threads working on neighbouring blocks do not share a line*/
+#ifndef BLKALC_CACHE_LINE
+#define BLKALC_CACHE_LINE 64
+#endif /*BLKALC_CACHE_LINE*/
 
 ALLOCATOR_API
 allocator_status blkalc_init(blkallocator* _ba, uint8_t* _memory, uint32_t _block_size, uint32_t _block_count);
 
+ALLOCATOR_API
+allocator_status blkalc_init_aligned(blkallocator* _ba, uint8_t* _memory, uint32_t _block_size, uint32_t _block_count, uint32_t _align);
+
 ALLOCATOR_API
 blk_handle blkalc_take(blkallocator* _ba);
 
@@ -232,9 +634,45 @@ char blk_ok(blk_handle* _h);
 ALLOCATOR_API
 uint32_t blkalc_n_available(blkallocator* _ba);
 
+ALLOCATOR_API
+_allocation_bookkeeper blkalc_bookkeeper(blkallocator* _ba);
+
 ALLOCATOR_API
 void blk_handle_return(blk_handle _handle);
 
+#ifndef TH_DISABLE_MUTEX
+ALLOCATOR_API
+allocator_status blkalc_init_lockfree(blkallocator* _ba, uint8_t* _memory, uint32_t _block_size, uint32_t _block_count);
+
+ALLOCATOR_API
+allocator_status blkalc_init_lockfree_aligned(blkallocator* _ba, uint8_t* _memory, uint32_t _block_size, uint32_t _block_count, uint32_t _align);
+#endif /*TH_DISABLE_MUTEX*/
+
+/*A magazine caches blocks for one thread, so most takes and returns touch
+  no shared state. It refills from and flushes to the allocator in batches
+  of half its size. Blocks in a magazine count as taken.*/
+#ifndef BLKALC_MAGAZINE_SIZE
+#define BLKALC_MAGAZINE_SIZE 32
+#endif /*BLKALC_MAGAZINE_SIZE*/
+
+typedef struct {
+    blkallocator* blkalc;
+    uint32_t n;
+    uint32_t ids[BLKALC_MAGAZINE_SIZE];
+}blk_magazine;
+
+ALLOCATOR_API
+blk_magazine blkalc_magazine(blkallocator* _ba);
+
+ALLOCATOR_API
+blk_handle blk_magazine_take(blk_magazine* _m);
+
+ALLOCATOR_API
+void blk_magazine_return(blk_magazine* _m, blk_handle _handle);
+
+ALLOCATOR_API
+void blk_magazine_flush(blk_magazine* _m);
+
 /* *****************************************************************************
  * Implenentation - define before include:
  * #define ALLOCATOR_IMPLEMENTATION
@@ -244,11 +682,148 @@ void blk_handle_return(blk_handle _handle);
 #define ALLOCATOR_IMPLEMENTATION
 #ifdef ALLOCATOR_IMPLEMENTATION
 
+#ifndef TH_DISABLE_MUTEX
+ALLOCATOR_API
+int
+_th_mutex_try_take(_th_mutex* _m)
+{
+	int expected = 0;
+	return atomic_compare_exchange_strong_explicit(_m, &expected, 1,
+	                                               memory_order_acquire,
+	                                               memory_order_relaxed);
+}
+
+#ifdef _TH_FUTEX_MUTEX
+/*The futex word is 0 when unlocked, 1 when locked and 2 when locked with
+  sleeping waiters, so an uncontended give never enters the kernel*/
+ALLOCATOR_API
+void
+_th_mutex_wait_then_take(_th_mutex* _m)
+{
+	int c = 0;
+	if (atomic_compare_exchange_strong_explicit(_m, &c, 1,
+	                                            memory_order_acquire,
+	                                            memory_order_relaxed))
+		return;
+	if (c != 2)
+		c = atomic_exchange_explicit(_m, 2, memory_order_acquire);
+	while (c != 0) {
+		syscall(SYS_futex, (int*)_m, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+		c = atomic_exchange_explicit(_m, 2, memory_order_acquire);
+	}
+}
+
+ALLOCATOR_API
+void
+_th_mutex_give(_th_mutex* _m)
+{
+	if (atomic_exchange_explicit(_m, 0, memory_order_release) == 2)
+		syscall(SYS_futex, (int*)_m, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+#else
+ALLOCATOR_API
+void
+_th_mutex_wait_then_take(_th_mutex* _m)
+{
+	uint32_t backoff = 1;
+	uint32_t i;
+	while (!_th_mutex_try_take(_m)) {
+		while (atomic_load_explicit(_m, memory_order_relaxed) != 0) {
+			if (backoff < _TH_MUTEX_BACKOFF_MAX) {
+				for (i = 0; i < backoff; i++)
+					_TH_CPU_RELAX();
+				backoff <<= 1;
+			} else {
+				_TH_YIELD();
+			}
+		}
+	}
+}
+
+ALLOCATOR_API
+void
+_th_mutex_give(_th_mutex* _m)
+{
+	atomic_store_explicit(_m, 0, memory_order_release);
+}
+#endif /*_TH_FUTEX_MUTEX*/
+#endif /*TH_DISABLE_MUTEX*/
+
+#ifdef ALLOCATOR_STATS
+#if defined(__aarch64__) && !defined(__x86_64__) && !defined(__i386__)
+ALLOCATOR_BACKEND
+uint64_t
+_alc_cycles(void)
+{
+	uint64_t c;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(c));
+	return c;
+}
+#endif
+
+ALLOCATOR_BACKEND
+void
+_alc_stats_hist(uint32_t* _hist, uint64_t _x)
+{
+	int k = 0;
+	while (_x > 1 && k < ALC_STATS_BUCKETS - 1) {
+		_x >>= 1;
+		k++;
+	}
+	_hist[k]++;
+}
+
+ALLOCATOR_BACKEND
+void
+_alc_stats_bytes(_allocation_bookkeeper* _book, uint64_t _n)
+{
+	_book->bytes = _n;
+	if (_n > _book->bytes_peak)
+		_book->bytes_peak = _n;
+}
+
+ALLOCATOR_BACKEND
+void
+_alc_stats_dump_hist(FILE* _out, const char* _title, uint32_t* _hist)
+{
+	int k;
+	fprintf(_out, "  %s:\n", _title);
+	for (k = 0; k < ALC_STATS_BUCKETS; k++)
+		if (_hist[k] > 0)
+			fprintf(_out, "    [%llu, %llu): %u\n", (unsigned long long)((k == 0) ? 0 : 1ull << k),
+			        (unsigned long long)(1ull << (k + 1)), _hist[k]);
+}
+
+ALLOCATOR_API
+void
+alc_stats_dump(FILE* _out, const char* _name, _allocation_bookkeeper* _book)
+/**
+ * alc_stats_dump() - Print the statistics of an allocator.
+ * @arg1: Stream to print to.
+ * @arg2: Name of the allocator in the output.
+ * @arg3: The bookkeeper of the allocator, eg. &stackallocator.bookkeeper.
+ *        For block allocators pass a blkalc_bookkeeper() copy, in lock-free
+ *        mode it only has the counts and the bytes in use.
+ */
+{
+	if (_out == NULL || _book == NULL)
+		return;
+	fprintf(_out, "%s: %u allocations, %u live\n", (_name != NULL) ? _name : "allocator",
+	        _book->total, _book->curr);
+	fprintf(_out, "  bytes in use: %llu, high water: %llu\n",
+	        (unsigned long long)_book->bytes, (unsigned long long)_book->bytes_peak);
+	_alc_stats_dump_hist(_out, "allocation sizes", _book->sizes);
+	_alc_stats_dump_hist(_out, "allocation cycles", _book->alloc_cycles);
+	_alc_stats_dump_hist(_out, "free cycles", _book->free_cycles);
+}
+#endif /*ALLOCATOR_STATS*/
+
 ALLOCATOR_API
 memregion
-region(void* _mem, uint32_t _len)
+region(void* _mem, uint64_t _len)
 {
-    return (memregion){(uint8_t*)_mem, _len, 0};
+    return (memregion){(uint8_t*)_mem, _len, 0, NULL};
 }
 
 ALLOCATOR_API
@@ -260,6 +835,120 @@ region_ok(memregion* _r)
     return 0;
 }
 
+#ifdef _ALLOCATOR_VMREGION
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) || !defined(MAP_NORESERVE) || !defined(MADV_DONTNEED)
+#error "ALLOCATOR_VMREGION needs mmap flags and madvise(), define _DEFAULT_SOURCE before including any system header"
+#endif
+
+#define _VMREGION_ROUND(N) \
+	( ((N) + VMREGION_COMMIT_STEP - 1) / VMREGION_COMMIT_STEP * VMREGION_COMMIT_STEP )
+
+ALLOCATOR_API
+allocator_status
+vmregion_reserve(vmregion* _vm, uint64_t _size)
+/**
+ * vmregion_reserve() - Reserve address space without committing it.
+ * @arg1: Ptr to vmregion.
+ * @arg2: Size to reserve, may exceed physical memory.
+ *
+ * Return: ALLOCATOR_INVALID_REGION if the range could not be mapped,
+ *         ALLOCATOR_OK on clean exit.
+ */
+{
+    void* mem;
+    if (_vm == NULL || _size == 0)
+        return ALLOCATOR_INVALID_INPUT;
+    _size = _VMREGION_ROUND(_size);
+    mem = mmap(NULL, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+        return ALLOCATOR_INVALID_REGION;
+    _vm->mem = (uint8_t*)mem;
+    _vm->reserved = _size;
+    _vm->committed = 0;
+    return ALLOCATOR_OK;
+}
+
+ALLOCATOR_API
+void
+vmregion_release(vmregion* _vm)
+/**
+ * vmregion_release() - Unmap the reserved range.
+ * @arg1: Ptr to vmregion.
+ */
+{
+    if (_vm == NULL || _vm->mem == NULL)
+        return;
+    munmap(_vm->mem, _vm->reserved);
+    *_vm = (vmregion) {0};
+}
+
+ALLOCATOR_API
+memregion
+vmregion_region(vmregion* _vm)
+/**
+ * vmregion_region() - Region spanning the reserved range, for allocators.
+ * @arg1: Ptr to vmregion.
+ *
+ * Stack and first fit dynamic allocators commit pages as they grow. Double
+ * ended stacks, frame allocators and TLSF commit the whole region when they
+ * are created. Dynamic and
+ * double ended stack allocators hold 32 bit offsets, and reject regions over
+ * UINT32_MAX bytes (4 GB), so reserve at most that much for them.
+ */
+{
+    memregion r = region(_vm->mem, _vm->reserved);
+    r.vm = _vm;
+    return r;
+}
+
+ALLOCATOR_API
+char
+vmregion_commit(vmregion* _vm, uint64_t _end)
+/**
+ * vmregion_commit() - Commit pages up to @arg2 bytes into the range.
+ * @arg1: Ptr to vmregion.
+ * @arg2: End of the memory to use.
+ *
+ * Return: 1 if the memory is usable, 0 if it is beyond the reserved range or
+ *         the system is out of memory.
+ */
+{
+    uint64_t end = _VMREGION_ROUND(_end);
+    if (end <= _vm->committed)
+        return 1;
+    if (end > _vm->reserved)
+        return 0;
+    if (mprotect(_vm->mem + _vm->committed, end - _vm->committed,
+                 PROT_READ | PROT_WRITE) != 0)
+        return 0;
+    _vm->committed = end;
+    return 1;
+}
+
+ALLOCATOR_API
+void
+vmregion_decommit(vmregion* _vm, uint64_t _keep)
+/**
+ * vmregion_decommit() - Give committed pages back to the system.
+ * @arg1: Ptr to vmregion.
+ * @arg2: Bytes to keep committed, at least one step is kept.
+ *
+ * Pages are dropped with madvise, touching them again would be an error
+ * until they are committed again.
+ */
+{
+    uint64_t keep = _VMREGION_ROUND(_keep);
+    if (keep < VMREGION_COMMIT_STEP)
+        keep = VMREGION_COMMIT_STEP;
+    if (keep >= _vm->committed)
+        return;
+    madvise(_vm->mem + keep, _vm->committed - keep, MADV_DONTNEED);
+    mprotect(_vm->mem + keep, _vm->committed - keep, PROT_NONE);
+    _vm->committed = keep;
+}
+#endif /*_ALLOCATOR_VMREGION*/
+
 ALLOCATOR_API
 allocator_status
 stackalc_new(stackallocator* _a, memregion _mem, void* _scratch)
@@ -275,10 +964,29 @@ stackalc_new(stackallocator* _a, memregion _mem, void* _scratch)
         return ALLOCATOR_INVALID_INPUT;
     _a->scratch_buffer = _scratch;
     _a->region = _mem;
+    _a->offset = 0;
 	_ALC_BOOKKEEPER_NEW(_a->bookkeeper);
+    _TH_MUTEX_INIT(_a->is_in_use);
     return ALLOCATOR_OK;
 }
 
+ALLOCATOR_BACKEND
+uint8_t*
+_stackalc_bump(stackallocator* _a, uint32_t _n, uint32_t _align)
+/*Unlocked aligned bump, the padding counts against the region.
+  Return NULL if the region is full*/
+{
+	uint8_t* out = (uint8_t*)_TH_ALIGN_TO((unsigned long)_a->region.mem + _a->offset, _align);
+    if (out + _n > _a->region.mem + _a->region.len || !_ALC_REGION_COMMIT(_a->region, out + _n))
+		return NULL;
+	_a->offset = out - _a->region.mem + _n;
+	_ALC_BOOKKEEPER_INCREMENT(_a->bookkeeper);
+	/*Bytes in use include the alignment padding*/
+	_ALC_STATS_ALLOC(_a->bookkeeper, _n, 0);
+	_ALC_STATS_BYTES(_a->bookkeeper, _a->offset);
+	return out;
+}
+
 ALLOCATOR_API
 void*
 stackalc_alloc(stackallocator* _a, uint32_t _n)
@@ -292,24 +1000,54 @@ stackalc_alloc(stackallocator* _a, uint32_t _n)
  */
 {
     uint8_t* out = NULL;
+    _ALC_STATS_TIMER(t)
 
-    if (_a == NULL)
+    if (_a == NULL || _n == 0)
         return NULL;
 
-    if ((_a->offset + _n) < _a->region.len) {
-		/*Provide a block of aligned memory*/
-		out = (uint8_t*)_TH_ALIGN((unsigned long)_a->region.mem +
-								  _a->offset);
-		_a->offset = out - _a->region.mem + _n;
-	} else {
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+	out = _stackalc_bump(_a, _n, _TH_ALIGNMENT);
+	if (out == NULL) {
 		/*Provide scratch buffer on arena being full*/
         out = (uint8_t*)_a->scratch_buffer;
+		if (out != NULL)
+		   _ALC_BOOKKEEPER_INCREMENT(_a->bookkeeper);
 	}
-	if (out != NULL)
-	   _ALC_BOOKKEEPER_INCREMENT(_a->bookkeeper);
+	_ALC_STATS_ALLOC_CYCLES(_a->bookkeeper, t);
+    _TH_MUTEX_GIVE(_a->is_in_use);
 	return out;
 }
 
+ALLOCATOR_API
+void*
+stackalc_alloc_aligned(stackallocator* _a, uint32_t _n, uint32_t _align)
+/**
+ * stackalc_alloc_aligned() - Allocate block from stack with given alignment.
+ * @arg1: Ptr to stack allocator.
+ * @arg2: Size of requested memory.
+ * @arg3: Alignment, a power of two. Smaller than _TH_ALIGNMENT means
+ *        _TH_ALIGNMENT.
+ *
+ * Only the padding up to the alignment is used. The scratch buffer is not
+ * aligned, so it is never returned.
+ *
+ * Return: ptr to allocated block, NULL if full, @arg2 is 0 or @arg3 is no
+ *         power of two.
+ */
+{
+    uint8_t* out;
+    _ALC_STATS_TIMER(t)
+    if (_a == NULL || _n == 0 || !_TH_IS_POW2(_align))
+        return NULL;
+    if (_align < _TH_ALIGNMENT)
+        _align = _TH_ALIGNMENT;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    out = _stackalc_bump(_a, _n, _align);
+    _ALC_STATS_ALLOC_CYCLES(_a->bookkeeper, t);
+    _TH_MUTEX_GIVE(_a->is_in_use);
+    return out;
+}
+
 ALLOCATOR_API
 void
 stackalc_reset(stackallocator* _a)
@@ -320,74 +1058,800 @@ stackalc_reset(stackallocator* _a)
 {
     if (_a == NULL)
         return;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
     _a->offset = 0;
+    _ALC_BOOKKEEPER_CLEAR(_a->bookkeeper);
+    _ALC_REGION_DECOMMIT(_a->region, _a->region.mem);
+    _TH_MUTEX_GIVE(_a->is_in_use);
+}
+
+ALLOCATOR_API
+stack_marker
+stackalc_mark(stackallocator* _a)
+/**
+ * stackalc_mark() - Mark the top of the stack.
+ * @arg1: Ptr to stack allocator.
+ *
+ * Return: marker to rewind to.
+ */
+{
+    stack_marker m = {0, 0};
+    if (_a == NULL)
+        return m;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    m.offset = _a->offset;
+    m.count = _a->bookkeeper.curr;
+    _TH_MUTEX_GIVE(_a->is_in_use);
+    return m;
+}
+
+ALLOCATOR_API
+allocator_status
+stackalc_rewind(stackallocator* _a, stack_marker _m)
+/**
+ * stackalc_rewind() - Free everything allocated after marker was taken.
+ * @arg1: Ptr to stack allocator.
+ * @arg2: marker from stackalc_mark().
+ *
+ * Markers nest, rewinding to an outer marker also releases inner ones.
+ *
+ * Return: ALLOCATOR_INVALID_INPUT if marker is above the top of the stack,
+ *         meaning it was already rewound past, ALLOCATOR_OK otherwise.
+ */
+{
+    allocator_status status = ALLOCATOR_OK;
+    if (_a == NULL)
+        return ALLOCATOR_INVALID_INPUT;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    if (_m.offset <= _a->offset && _m.count <= _a->bookkeeper.curr) {
+        _a->offset = _m.offset;
+        _a->bookkeeper.curr = _m.count;
+        _ALC_STATS_BYTES(_a->bookkeeper, _m.offset);
+    } else
+        status = ALLOCATOR_INVALID_INPUT;
+    _TH_MUTEX_GIVE(_a->is_in_use);
+    return status;
+}
+
+ALLOCATOR_API
+allocator_status
+dstackalc_new(dstackallocator* _a, memregion _mem)
+/**
+ * dstackalc_new() - Create double ended stack allocator from provided memory.
+ * @arg1: Ptr to double ended stack allocator.
+ * @arg2: memory region, at most UINT32_MAX bytes. A vmregion is committed
+ *        whole up front, both ends grow into it.
+ *
+ * Return: error code on error, ALLOCATOR_INVALID_REGION if the region is over
+ *         4 GB or cannot be committed, ALLOCATOR_OK on clean exit.
+ */
+{
+    if (_a == NULL || !region_ok(&_mem))
+        return ALLOCATOR_INVALID_INPUT;
+    if (_mem.len > UINT32_MAX || !_ALC_REGION_COMMIT_ALL(_mem))
+        return ALLOCATOR_INVALID_REGION;
+    _a->region = _mem;
+    _a->low = 0;
+    _a->high = _mem.len;
+    _a->count[DSTACK_LOW] = 0;
+    _a->count[DSTACK_HIGH] = 0;
+	_ALC_BOOKKEEPER_NEW(_a->bookkeeper);
+    _TH_MUTEX_INIT(_a->is_in_use);
+    return ALLOCATOR_OK;
+}
+
+ALLOCATOR_BACKEND
+uint8_t*
+_dstackalc_bump(dstackallocator* _a, dstack_end _end, uint32_t _n)
+/*Unlocked aligned bump of one end. The high end aligns its allocations down,
+  so padding always lies between the allocation and the free space.
+  Return NULL if the ends would cross*/
+{
+	unsigned long low = (unsigned long)_a->region.mem + _a->low;
+	unsigned long high = (unsigned long)_a->region.mem + _a->high;
+	unsigned long out;
+	if (_a->region.mem == NULL)
+		return NULL;
+	if (_end == DSTACK_LOW) {
+		out = _TH_ALIGN(low);
+		if (out > high || high - out < _n)
+			return NULL;
+		_a->low = out + _n - (unsigned long)_a->region.mem;
+	} else {
+		if (high - low < _n)
+			return NULL;
+		out = (high - _n) & ~(unsigned long)(_TH_ALIGNMENT - 1);
+		if (out < low)
+			return NULL;
+		_a->high = out - (unsigned long)_a->region.mem;
+	}
+	_a->count[_end]++;
+	_ALC_BOOKKEEPER_INCREMENT(_a->bookkeeper);
+	/*Bytes in use include the alignment padding of both ends*/
+	_ALC_STATS_ALLOC(_a->bookkeeper, _n, 0);
+	_ALC_STATS_BYTES(_a->bookkeeper, _a->low + (_a->region.len - _a->high));
+	return (uint8_t*)out;
+}
+
+ALLOCATOR_BACKEND
+void
+_dstackalc_rewind(dstackallocator* _a, dstack_end _end, stack_marker _m)
+/*Unlocked rewind of one end to a marker that is known to be valid*/
+{
+	if (_end == DSTACK_LOW)
+		_a->low = _m.offset;
+	else
+		_a->high = _m.offset;
+	_a->bookkeeper.curr -= _a->count[_end] - _m.count;
+	_a->count[_end] = _m.count;
+	_ALC_STATS_BYTES(_a->bookkeeper, _a->low + (_a->region.len - _a->high));
+}
+
+ALLOCATOR_API
+void*
+dstackalc_alloc(dstackallocator* _a, dstack_end _end, uint32_t _n)
+/**
+ * dstackalc_alloc() - Allocate aligned memory from one end.
+ * @arg1: Ptr to double ended stack allocator.
+ * @arg2: DSTACK_LOW or DSTACK_HIGH.
+ * @arg3: Size of requested memory.
+ *
+ * Return: ptr to allocated block, NULL if the ends would cross.
+ */
+{
+    uint8_t* out;
+    _ALC_STATS_TIMER(t)
+    if (_a == NULL)
+        return NULL;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    out = _dstackalc_bump(_a, _end, _n);
+    _ALC_STATS_ALLOC_CYCLES(_a->bookkeeper, t);
+    _TH_MUTEX_GIVE(_a->is_in_use);
+    return out;
+}
+
+ALLOCATOR_API
+stack_marker
+dstackalc_mark(dstackallocator* _a, dstack_end _end)
+/**
+ * dstackalc_mark() - Mark the top of one end.
+ * @arg1: Ptr to double ended stack allocator.
+ * @arg2: DSTACK_LOW or DSTACK_HIGH.
+ *
+ * Return: marker to rewind that end to.
+ */
+{
+    stack_marker m = {0, 0};
+    if (_a == NULL)
+        return m;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    m.offset = (_end == DSTACK_LOW) ? _a->low : _a->high;
+    m.count = _a->count[_end];
+    _TH_MUTEX_GIVE(_a->is_in_use);
+    return m;
+}
+
+ALLOCATOR_API
+allocator_status
+dstackalc_rewind(dstackallocator* _a, dstack_end _end, stack_marker _m)
+/**
+ * dstackalc_rewind() - Free everything allocated from one end after marker.
+ * @arg1: Ptr to double ended stack allocator.
+ * @arg2: DSTACK_LOW or DSTACK_HIGH.
+ * @arg3: marker from dstackalc_mark() of the same end.
+ *
+ * Return: ALLOCATOR_INVALID_INPUT if that end was already rewound past
+ *         marker, ALLOCATOR_OK otherwise.
+ */
+{
+    allocator_status status = ALLOCATOR_OK;
+    if (_a == NULL)
+        return ALLOCATOR_INVALID_INPUT;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    if (_end == DSTACK_LOW && _m.offset <= _a->low &&
+        _m.count <= _a->count[DSTACK_LOW])
+        _dstackalc_rewind(_a, DSTACK_LOW, _m);
+    else if (_end == DSTACK_HIGH && _m.offset >= _a->high && _m.offset <= _a->region.len &&
+             _m.count <= _a->count[DSTACK_HIGH])
+        _dstackalc_rewind(_a, DSTACK_HIGH, _m);
+    else
+        status = ALLOCATOR_INVALID_INPUT;
+    _TH_MUTEX_GIVE(_a->is_in_use);
+    return status;
+}
+
+ALLOCATOR_API
+void
+dstackalc_reset(dstackallocator* _a)
+/**
+ * dstackalc_reset() - Free all allocated memory from both ends.
+ * @arg1: Ptr to double ended stack allocator.
+ */
+{
+    if (_a == NULL)
+        return;
+    _TH_MUTEX_WAIT_THEN_TAKE(_a->is_in_use);
+    _a->low = 0;
+    _a->high = _a->region.len;
+    _a->count[DSTACK_LOW] = 0;
+    _a->count[DSTACK_HIGH] = 0;
+    _ALC_BOOKKEEPER_CLEAR(_a->bookkeeper);
+    _TH_MUTEX_GIVE(_a->is_in_use);
+}
+
+ALLOCATOR_API
+allocator_status
+framealc_init(frameallocator* _fa, memregion _mem, memregion _scratch)
+/**
+ * framealc_init() - Create frame allocator from provided memory.
+ * @arg1: Ptr to frame allocator.
+ * @arg2: memory region, split in halves between the two frames. A vmregion
+ *        is committed whole up front.
+ * @arg3: scratch region for overflow, region(NULL, 0) for none. It is a
+ *        double ended stack, so at most UINT32_MAX bytes and committed up
+ *        front, a larger one leaves the frames without scratch.
+ *
+ * Return: error code on error, ALLOCATOR_OK on clean exit.
+ */
+{
+    uint64_t half;
+    if (_fa == NULL || !region_ok(&_mem) || _mem.len < 2)
+        return ALLOCATOR_INVALID_INPUT;
+    /*The frames take turns, so both halves end up committed anyway*/
+    if (!_ALC_REGION_COMMIT_ALL(_mem))
+        return ALLOCATOR_INVALID_REGION;
+    half = _mem.len / 2;
+    stackalc_new(&_fa->frames[0], region(_mem.mem, half), NULL);
+    stackalc_new(&_fa->frames[1], region(_mem.mem + half, _mem.len - half), NULL);
+    if (dstackalc_new(&_fa->scratch, _scratch) != ALLOCATOR_OK) {
+        /*No scratch, every bump of it fails*/
+        _fa->scratch.region = region(NULL, 0);
+        _fa->scratch.low = 0;
+        _fa->scratch.high = 0;
+        _fa->scratch.count[DSTACK_LOW] = 0;
+        _fa->scratch.count[DSTACK_HIGH] = 0;
+        _ALC_BOOKKEEPER_NEW(_fa->scratch.bookkeeper);
+        _TH_MUTEX_INIT(_fa->scratch.is_in_use);
+    }
+    _fa->current = 0;
+    _fa->last_frame_bytes = 0;
+    _fa->high_water = 0;
+    _fa->overflow_frames = 0;
+    _TH_MUTEX_INIT(_fa->is_in_use);
+    return ALLOCATOR_OK;
+}
+
+ALLOCATOR_API
+void*
+framealc_alloc(frameallocator* _fa, uint32_t _n)
+/**
+ * framealc_alloc() - Allocate aligned memory for this and the next frame.
+ * @arg1: Ptr to frame allocator.
+ * @arg2: Size of requested memory.
+ *
+ * O(1), takes from the current frame and overflows into the scratch region.
+ *
+ * Return: ptr to allocated block, NULL if both are full.
+ */
+{
+    uint8_t* out;
+    if (_fa == NULL || _n < 1)
+        return NULL;
+    _TH_MUTEX_WAIT_THEN_TAKE(_fa->is_in_use);
+    out = _stackalc_bump(&_fa->frames[_fa->current], _n, _TH_ALIGNMENT);
+    if (out == NULL)
+        out = _dstackalc_bump(&_fa->scratch, (dstack_end)_fa->current, _n);
+    _TH_MUTEX_GIVE(_fa->is_in_use);
+    return out;
+}
+
+ALLOCATOR_BACKEND
+uint32_t
+_framealc_overflow_bytes(frameallocator* _fa, uint8_t _frame)
+{
+    if (_frame == DSTACK_LOW)
+        return _fa->scratch.low;
+    return _fa->scratch.region.len - _fa->scratch.high;
+}
+
+ALLOCATOR_API
+uint32_t
+framealc_frame_bytes(frameallocator* _fa)
+/**
+ * framealc_frame_bytes() - Bytes used by the current frame so far.
+ * @arg1: Ptr to frame allocator.
+ */
+{
+    uint32_t n;
+    if (_fa == NULL)
+        return 0;
+    _TH_MUTEX_WAIT_THEN_TAKE(_fa->is_in_use);
+    n = _fa->frames[_fa->current].offset + _framealc_overflow_bytes(_fa, _fa->current);
+    _TH_MUTEX_GIVE(_fa->is_in_use);
+    return n;
+}
+
+ALLOCATOR_API
+void
+framealc_swap(frameallocator* _fa)
+/**
+ * framealc_swap() - End the current frame.
+ * @arg1: Ptr to frame allocator.
+ *
+ * Allocations of the frame before the current one are released, allocations
+ * of the current frame stay valid through the next.
+ */
+{
+    stack_marker empty = {0, 0};
+    uint32_t overflow;
+    if (_fa == NULL)
+        return;
+    _TH_MUTEX_WAIT_THEN_TAKE(_fa->is_in_use);
+    overflow = _framealc_overflow_bytes(_fa, _fa->current);
+    _fa->last_frame_bytes = _fa->frames[_fa->current].offset + overflow;
+    if (_fa->last_frame_bytes > _fa->high_water)
+        _fa->high_water = _fa->last_frame_bytes;
+    if (overflow > 0)
+        _fa->overflow_frames++;
+
+    _fa->current ^= 1;
+    _fa->frames[_fa->current].offset = 0;
+    _ALC_BOOKKEEPER_CLEAR(_fa->frames[_fa->current].bookkeeper);
+    if (_fa->current == DSTACK_HIGH)
+        empty.offset = _fa->scratch.region.len;
+    _dstackalc_rewind(&_fa->scratch, (dstack_end)_fa->current, empty);
+    _TH_MUTEX_GIVE(_fa->is_in_use);
+}
+
+ALLOCATOR_API
+allocator_status
+dynalc_init(dynallocator* _da, memregion _region)
+/**
+ * dynAllocator_set() - Initialize Dynamic Allocator without allocation.
+ * @arg1: Ptr to allocator to initialize.
+ * @arg2: Size of memory pool for initialized allocator.
+ * @arg3: Pointer to existing memory.
+ *
+ * Initialize dynamic allocator using specified memory field. Entry headers
+ * hold 32 bit sizes and offsets to stay at 16 bytes, so the region is at most
+ * UINT32_MAX bytes (4 GB).
+ *
+ * Return: error code on error, ALLOCATOR_INVALID_REGION if the region is over
+ *         4 GB, TH_OK on clean exit.
+ */
+{
+	if (_da == NULL || !region_ok(&_region))
+		return ALLOCATOR_INVALID_INPUT;
+	/*Entry headers hold 32 bit offsets into the region*/
+	if (_region.len > UINT32_MAX)
+		return ALLOCATOR_INVALID_REGION;
+    _da->region = _region;
+    _ALC_BOOKKEEPER_NEW(_da->bookkeeper);
+    _da->first = NULL;
+    _da->last = NULL;
+    _da->search_from = NULL;
+    _da->tlsf = NULL;
+    _TH_MUTEX_INIT(_da->is_in_use);
+    return ALLOCATOR_OK;
+}
+
+ALLOCATOR_API
+int
+_dynalc_fls(uint32_t _x)
+/*Index of the most significant set bit, -1 for zero*/
+{
+#if defined(__GNUC__)
+	return (_x == 0) ? -1 : 31 - __builtin_clz(_x);
+#else
+	int n = -1;
+	while (_x != 0) {
+		_x >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+ALLOCATOR_API
+int
+_dynalc_ffs(uint32_t _x)
+/*Index of the least significant set bit, -1 for zero*/
+{
+#if defined(__GNUC__)
+	return (_x == 0) ? -1 : __builtin_ctz(_x);
+#else
+	int n = 0;
+	if (_x == 0)
+		return -1;
+	while ((_x & 1) == 0) {
+		_x >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+#define _DYNALC_BLOCK_DATA(block) ((uint8_t*)((block) + 1))
+#define _DYNALC_BLOCK_LINKS(block) ((_dynalc_links*)((block) + 1))
+#define _DYNALC_BLOCK_NEXT_PHYS(block) \
+	((_dynalc_block*)(_DYNALC_BLOCK_DATA(block) + (block)->size))
+
+ALLOCATOR_API
+void
+_dynalc_tlsf_mapping(uint32_t _size, int* _fl, int* _sl)
+{
+	int fl;
+	if (_size < _DYNALC_TLSF_SMALL) {
+		*_fl = 0;
+		*_sl = _size / (_DYNALC_TLSF_SMALL / _DYNALC_TLSF_SL_COUNT);
+		return;
+	}
+	fl = _dynalc_fls(_size);
+	*_sl = (int)(_size >> (fl - _DYNALC_TLSF_SL_LOG2)) ^ _DYNALC_TLSF_SL_COUNT;
+	*_fl = fl - (_DYNALC_TLSF_FL_SHIFT - 1);
+}
+
+ALLOCATOR_API
+void
+_dynalc_tlsf_insert(_dynalc_tlsf* _t, _dynalc_block* _b)
+{
+	_dynalc_block* head;
+	int fl, sl;
+	_dynalc_tlsf_mapping(_b->size, &fl, &sl);
+	head = _t->heads[fl][sl];
+	_DYNALC_BLOCK_LINKS(_b)->next = head;
+	_DYNALC_BLOCK_LINKS(_b)->prev = NULL;
+	if (head != NULL)
+		_DYNALC_BLOCK_LINKS(head)->prev = _b;
+	_t->heads[fl][sl] = _b;
+	_t->fl_bitmap |= 1u << fl;
+	_t->sl_bitmap[fl] |= 1u << sl;
+	_b->state = _DYNALC_BLOCK_FREE;
+}
+
+ALLOCATOR_API
+void
+_dynalc_tlsf_remove(_dynalc_tlsf* _t, _dynalc_block* _b)
+{
+	_dynalc_block* next = _DYNALC_BLOCK_LINKS(_b)->next;
+	_dynalc_block* prev = _DYNALC_BLOCK_LINKS(_b)->prev;
+	int fl, sl;
+	_dynalc_tlsf_mapping(_b->size, &fl, &sl);
+	if (next != NULL)
+		_DYNALC_BLOCK_LINKS(next)->prev = prev;
+	if (prev != NULL) {
+		_DYNALC_BLOCK_LINKS(prev)->next = next;
+	} else {
+		_t->heads[fl][sl] = next;
+		if (next == NULL) {
+			_t->sl_bitmap[fl] &= ~(1u << sl);
+			if (_t->sl_bitmap[fl] == 0)
+				_t->fl_bitmap &= ~(1u << fl);
+		}
+	}
+	_b->state = _DYNALC_BLOCK_USED;
+}
+
+ALLOCATOR_API
+_dynalc_block*
+_dynalc_tlsf_find(_dynalc_tlsf* _t, uint32_t _size)
+/**
+ * _dynalc_tlsf_find() - find a free block of at least @arg2 bytes.
+ *
+ * The size is rounded up to the next class boundary, so any block in the
+ * found class fits without searching the list.
+ */
+{
+	uint32_t sl_map;
+	uint32_t fl_map;
+	int fl, sl;
+	if (_size >= _DYNALC_TLSF_SMALL)
+		_size += (1u << (_dynalc_fls(_size) - _DYNALC_TLSF_SL_LOG2)) - 1;
+	_dynalc_tlsf_mapping(_size, &fl, &sl);
+	if (fl >= _DYNALC_TLSF_FL_COUNT)
+		return NULL;
+	sl_map = _t->sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0) {
+		fl_map = (fl + 1 < 32) ? _t->fl_bitmap & (~0u << (fl + 1)) : 0;
+		if (fl_map == 0)
+			return NULL;
+		fl = _dynalc_ffs(fl_map);
+		sl_map = _t->sl_bitmap[fl];
+	}
+	sl = _dynalc_ffs(sl_map);
+	return _t->heads[fl][sl];
+}
+
+ALLOCATOR_BACKEND
+allocator_status
+_dynalc_tlsf_reset(dynallocator* _da)
+/*Place the control structure and one free block spanning the region,
+  followed by a used sentinel so coalescing never walks off the end*/
+{
+	_dynalc_tlsf* t;
+	_dynalc_block* first;
+	_dynalc_block* sentinel;
+	uint8_t* end = _da->region.mem + _da->region.len;
+	int i, j;
+
+	t = (_dynalc_tlsf*)_TH_ALIGN((unsigned long)_da->region.mem);
+	first = (_dynalc_block*)_TH_ALIGN((unsigned long)(t + 1));
+	if ((uint8_t*)(first + 2) + sizeof(_dynalc_links) > end)
+		return ALLOCATOR_INVALID_REGION;
+
+	t->fl_bitmap = 0;
+	for (i = 0; i < _DYNALC_TLSF_FL_COUNT; i++) {
+		t->sl_bitmap[i] = 0;
+		for (j = 0; j < _DYNALC_TLSF_SL_COUNT; j++)
+			t->heads[i][j] = NULL;
+	}
+	first->prev_phys = NULL;
+	first->size = ((end - _DYNALC_BLOCK_DATA(first)) - sizeof(_dynalc_block))
+	              & ~(uint32_t)(_TH_ALIGNMENT - 1);
+	sentinel = _DYNALC_BLOCK_NEXT_PHYS(first);
+	sentinel->prev_phys = first;
+	sentinel->size = 0;
+	sentinel->state = _DYNALC_BLOCK_USED;
+	_dynalc_tlsf_insert(t, first);
+	_da->tlsf = t;
+	return ALLOCATOR_OK;
+}
+
+ALLOCATOR_API
+allocator_status
+dynalc_init_tlsf(dynallocator* _da, memregion _region)
+/**
+ * dynalc_init_tlsf() - Initialize Dynamic Allocator in TLSF mode.
+ * @arg1: Ptr to allocator to initialize.
+ * @arg2: Memory region for the allocator.
+ *
+ * Like dynalc_init(), at most UINT32_MAX bytes too, but malloc and free run
+ * in constant time. The region must also hold the control structure, a few
+ * kilobytes, and a vmregion is committed whole up front.
+ *
+ * Return: error code on error, ALLOCATOR_OK on clean exit.
+ */
+{
+	allocator_status status = dynalc_init(_da, _region);
+	if (status != ALLOCATOR_OK)
+		return status;
+	/*Blocks are split and merged anywhere in the region*/
+	if (!_ALC_REGION_COMMIT_ALL(_region))
+		return ALLOCATOR_INVALID_REGION;
+	return _dynalc_tlsf_reset(_da);
+}
+
+ALLOCATOR_BACKEND
+uint8_t*
+_dynalc_tlsf_malloc(_dynalc_tlsf* _t, uint32_t _size)
+{
+	_dynalc_block* b;
+	_dynalc_block* rest;
+
+	if (_size < sizeof(_dynalc_links))
+		_size = sizeof(_dynalc_links);
+	_size = _TH_ALIGN(_size);
+	b = _dynalc_tlsf_find(_t, _size);
+	if (b == NULL)
+		return NULL;
+	_dynalc_tlsf_remove(_t, b);
+
+	/*Split off the tail if it can hold a block of its own*/
+	if (b->size >= _size + sizeof(_dynalc_block) + sizeof(_dynalc_links)) {
+		rest = (_dynalc_block*)(_DYNALC_BLOCK_DATA(b) + _size);
+		rest->prev_phys = b;
+		rest->size = b->size - _size - sizeof(_dynalc_block);
+		_DYNALC_BLOCK_NEXT_PHYS(rest)->prev_phys = rest;
+		b->size = _size;
+		_dynalc_tlsf_insert(_t, rest);
+	}
+	return _DYNALC_BLOCK_DATA(b);
+}
+
+ALLOCATOR_BACKEND
+char
+_dynalc_tlsf_free(_dynalc_tlsf* _t, uint8_t* _ptr)
+/*Return 0 if the pointer is not a used block*/
+{
+	_dynalc_block* b = ((_dynalc_block*)_ptr) - 1;
+	_dynalc_block* prev;
+	_dynalc_block* next;
+
+	if (b->state != _DYNALC_BLOCK_USED)
+		return 0;
+	/*Merge with free physical neighbours*/
+	prev = b->prev_phys;
+	if (prev != NULL && prev->state == _DYNALC_BLOCK_FREE) {
+		_dynalc_tlsf_remove(_t, prev);
+		prev->size += sizeof(_dynalc_block) + b->size;
+		b = prev;
+	}
+	next = _DYNALC_BLOCK_NEXT_PHYS(b);
+	if (next->state == _DYNALC_BLOCK_FREE) {
+		_dynalc_tlsf_remove(_t, next);
+		b->size += sizeof(_dynalc_block) + next->size;
+	}
+	_DYNALC_BLOCK_NEXT_PHYS(b)->prev_phys = b;
+	_dynalc_tlsf_insert(_t, b);
+	return 1;
+}
+
+ALLOCATOR_BACKEND
+char
+_dynalc_tlsf_resize(_dynalc_tlsf* _t, uint8_t* _ptr, uint32_t _size)
+/**
+ * _dynalc_tlsf_resize() - resize a used block in place.
+ *
+ * Grows by taking in the next physical block if it is free, and shrinks by
+ * splitting off the tail, which merges with free space after it.
+ *
+ * Return: 1 if the block was resized, 0 if it has to be moved.
+ */
+{
+	_dynalc_block* b = ((_dynalc_block*)_ptr) - 1;
+	_dynalc_block* next;
+	_dynalc_block* rest;
+
+	if (b->state != _DYNALC_BLOCK_USED)
+		return 0;
+	if (_size < sizeof(_dynalc_links))
+		_size = sizeof(_dynalc_links);
+	_size = _TH_ALIGN(_size);
+	if (_size > b->size) {
+		next = _DYNALC_BLOCK_NEXT_PHYS(b);
+		if (next->state != _DYNALC_BLOCK_FREE ||
+		    b->size + sizeof(_dynalc_block) + next->size < _size)
+			return 0;
+		_dynalc_tlsf_remove(_t, next);
+		b->size += sizeof(_dynalc_block) + next->size;
+		_DYNALC_BLOCK_NEXT_PHYS(b)->prev_phys = b;
+	}
+	if (b->size >= _size + sizeof(_dynalc_block) + sizeof(_dynalc_links)) {
+		rest = (_dynalc_block*)(_DYNALC_BLOCK_DATA(b) + _size);
+		rest->prev_phys = b;
+		rest->size = b->size - _size - sizeof(_dynalc_block);
+		rest->state = _DYNALC_BLOCK_USED;
+		b->size = _size;
+		_dynalc_tlsf_free(_t, _DYNALC_BLOCK_DATA(rest));
+	}
+	return 1;
 }
 
-ALLOCATOR_API
-allocator_status
-dynalc_init(dynallocator* _da, memregion _region)
+ALLOCATOR_BACKEND
+uint8_t*
+_dynalc_tlsf_malloc_aligned(_dynalc_tlsf* _t, uint32_t _size, uint32_t _align)
 /**
- * dynAllocator_set() - Initialize Dynamic Allocator without allocation.
- * @arg1: Ptr to allocator to initialize.
- * @arg2: Size of memory pool for initialized allocator.
- * @arg3: Pointer to existing memory.
+ * _dynalc_tlsf_malloc_aligned() - allocate with alignment above _TH_ALIGNMENT.
  *
- * Initialize dynamic allocator using specified memory field.
- *
- * Return: error code on error, TH_OK on clean exit.
+ * Takes a block large enough for any placement, then gives the gap before
+ * the aligned data back as a free block and shrinks the tail, so no padding
+ * stays with the allocation. The gap is 0 or large enough to be a block.
  */
 {
-	if (_da == NULL || !region_ok(&_region))
-		return ALLOCATOR_INVALID_INPUT;
-    _da->region = _region;
-    _ALC_BOOKKEEPER_NEW(_da->bookkeeper);
-    _da->first = NULL;
-    _da->last = NULL;
-    return ALLOCATOR_OK;
+	const uint32_t gap_min = sizeof(_dynalc_block) + sizeof(_dynalc_links);
+	_dynalc_block* b;
+	_dynalc_block* aligned;
+	uint8_t* p;
+	uint8_t* data;
+
+	if (_align <= _TH_ALIGNMENT)
+		return _dynalc_tlsf_malloc(_t, _size);
+	if (_size > UINT32_MAX - _align - gap_min)
+		return NULL;
+	p = _dynalc_tlsf_malloc(_t, _size + _align + gap_min);
+	if (p == NULL)
+		return NULL;
+	b = ((_dynalc_block*)p) - 1;
+	data = (uint8_t*)_TH_ALIGN_TO((unsigned long)p, _align);
+	if (data != p) {
+		if ((uint32_t)(data - p) < gap_min)
+			data += _align;
+		aligned = ((_dynalc_block*)data) - 1;
+		aligned->prev_phys = b;
+		aligned->size = b->size - (data - p);
+		aligned->state = _DYNALC_BLOCK_USED;
+		_DYNALC_BLOCK_NEXT_PHYS(aligned)->prev_phys = aligned;
+		b->size = (data - p) - sizeof(_dynalc_block);
+		_dynalc_tlsf_free(_t, p);
+	}
+	_dynalc_tlsf_resize(_t, data, _size);
+	return data;
 }
 
+/*Header position so the entry data after it is aligned to ALIGN*/
+#define _DYNALC_ENTRY_START(start, ALIGN) \
+	( (uint8_t*)(_TH_ALIGN_TO((unsigned long)(start) + sizeof(_dynalc_header), (ALIGN)) \
+	             - sizeof(_dynalc_header)) )
+
 ALLOCATOR_BACKEND
 uint8_t*
-_dynalc_entry_create(uint8_t* _start, uint8_t* _next, uint32_t _size)
+_dynalc_entry_create(dynallocator* _da,
+                     uint8_t* _start,
+                     uint8_t* _prev,
+                     uint8_t* _next,
+                     uint32_t _size)
 /**
- * _th_allocator_entry_create() - create chain entry at specified location.
- * @arg1: Ptr to start entry.
- * @arg2: Ptr to next entry in chain.
- * @arg3: Size of entry data.
+ * _dynalc_entry_create() - create chain entry at specified location.
+ * @arg1: Ptr to dynamic allocator.
+ * @arg2: Ptr to start entry.
+ * @arg3: Ptr to previous entry in chain.
+ * @arg4: Ptr to next entry in chain.
+ * @arg5: Size of entry data.
  *
- * Creates an aligned chain entry at specified location.
- * If entry is last in chain, specify NULL at @arg2.
+ * Creates an aligned chain entry at specified location and links it in
+ * between @arg3 and @arg4.
+ * If entry is first or last in chain, specify NULL at @arg3 or @arg4.
  *
  * Return: NULL on error, entry data ptr on clean exit.
  */
 {
 	_dynalc_header* hptr = NULL;
+	uint8_t* data = NULL;
 	if (_start == NULL || _size < 1)
 		return NULL;
 
 	hptr = (_dynalc_header*)_TH_ALIGN((unsigned long)_start);
+	data = _ALLOCATOR_HEADER2DATA(hptr);
+	if (!_ALC_REGION_COMMIT(_da->region, data + _size))
+		return NULL;
 	hptr->next = _next;
 	hptr->size = _size;
-	return _ALLOCATOR_HEADER2DATA(hptr);
+	hptr->prev = (_prev != NULL) ? _prev - _da->region.mem : 0;
+	if (_prev != NULL)
+		_ALLOCATOR_DATA2HEADER(_prev)->next = data;
+	else
+		_da->first = data;
+	if (_next != NULL)
+		_ALLOCATOR_DATA2HEADER(_next)->prev = data - _da->region.mem;
+	else
+		_da->last = data;
+	return data;
 }
 
 ALLOCATOR_API
 void*
 dynalc_malloc(dynallocator* _da, int _size)
 /**
- * dynAllocator_malloc() - create entry.
+ * dynalc_malloc() - create entry, see dynalc_malloc_aligned().
+ * @arg1: Ptr to dynamic allocator.
+ * @arg2: size of entry to create.
+ *
+ * Return: NULL if entry cannot be created, created entry data ptr on clean
+ *         exit.
+ */
+{
+	return dynalc_malloc_aligned(_da, _size, _TH_ALIGNMENT);
+}
+
+ALLOCATOR_API
+void*
+dynalc_malloc_aligned(dynallocator* _da, int _size, uint32_t _align)
+/**
+ * dynalc_malloc_aligned() - create entry with aligned data.
  * @arg1: Ptr to dynamic allocator.
  * @arg2: size of entry to create.
+ * @arg3: alignment of the entry data, a power of two. Smaller than
+ *        _TH_ALIGNMENT means _TH_ALIGNMENT.
  *
  * Creates an allocation. Follows fit methodology of "first fit".
  * Finds first fitting entry location from index zero.
  *
+ * In TLSF mode, see dynalc_init_tlsf(), the smallest fitting size class
+ * is found in O(1) instead.
+ *
  * Order of fit search:             Big'Oh:
  * - First element in chain         - O(1)
  * - Before first element in chain  - O(1)
  * - Between 2 elements in chain    - O(N)
  * - As last element in chain       - O(N)
  *
+ * The search skips the packed start of the chain, so filling a chain without
+ * holes is O(1) per allocation.
+ *
+ * Entries placed for a larger alignment only pad in front of their header.
+ * Resize them with dynalc_realloc_aligned(), dynalc_realloc() moves them to
+ * an entry aligned to _TH_ALIGNMENT.
+ *
  * Return: NULL if entry cannot be created, created entry data ptr on clean 
  *         exit.
  */
@@ -397,95 +1861,101 @@ dynalc_malloc(dynallocator* _da, int _size)
 	uint8_t* next_header_start = NULL;
 	uint8_t* prev = NULL;
 	uint8_t* prev_data_end = NULL;
+	uint8_t* start = NULL;
 	uint32_t total_size = _size + sizeof(_dynalc_header);
+	char packed = 1;
+	_ALC_STATS_TIMER(t)
 
 	if (_da == NULL || _size < 1 ||
-        total_size > _da->region.len)
+        total_size > _da->region.len || !_TH_IS_POW2(_align))
 		return NULL;
+	if (_align < _TH_ALIGNMENT)
+		_align = _TH_ALIGNMENT;
 
     _TH_MUTEX_WAIT_THEN_TAKE(_da->is_in_use);
+	if (_da->tlsf != NULL) {
+		fit = _dynalc_tlsf_malloc_aligned(_da->tlsf, _size, _align);
+		goto FOUND_FIT;
+	}
+	start = _DYNALC_ENTRY_START(_da->region.mem, _align);
 	/* Allocation fit as first element in chain
 	 * */
 	if (_da->first == NULL) {
-		fit = _dynalc_entry_create(_da->region.mem, NULL, _size);
-		_da->first = fit;
-		_da->last = _da->first;
+		if (start + total_size <= _da->region.mem + _da->region.len)
+			fit = _dynalc_entry_create(_da, start, NULL, NULL, _size);
         goto FOUND_FIT;
 	}
 	/* Allocation fit before first element in chain
 	 * */
-	if (total_size < _da->first - _da->region.mem) {
-		fit = _dynalc_entry_create(_da->region.mem, _da->first, _size);
-		_da->first = fit;
+	if (start + total_size <= (uint8_t*)_ALLOCATOR_DATA2HEADER(_da->first)) {
+		fit = _dynalc_entry_create(_da, start, NULL, _da->first, _size);
+		_da->search_from = NULL;
         goto FOUND_FIT;
 	}
 	/* Allocation between element ptrs in chain
 	 * */
-	next = _da->first;
+	next = (_da->search_from != NULL) ? _da->search_from : _da->first;
 	while (next != NULL) {
 		prev = next;
 		next = _ALLOCATOR_DATA2HEADER(next)->next;
 		prev_data_end = prev + _ALLOCATOR_DATA2HEADER(prev)->size;
+		if (next == NULL)
+			break;
 		next_header_start = (uint8_t*)_ALLOCATOR_DATA2HEADER(next);
-		if (next_header_start - prev_data_end >= total_size) {
-			fit = _dynalc_entry_create(prev_data_end, next, _size);
-			_ALLOCATOR_DATA2HEADER(prev)->next = fit;
+		/*Entry headers are aligned, so the gap must fit the padding too*/
+		start = _DYNALC_ENTRY_START(prev_data_end, _align);
+		if (start + total_size <= next_header_start) {
+			fit = _dynalc_entry_create(_da, start, prev, next, _size);
             goto FOUND_FIT;
 		}
+		/*Move the search start past gaps too small for any entry*/
+		if (packed && next_header_start - (uint8_t*)_TH_ALIGN((unsigned long)prev_data_end) <
+		    (long)_TH_ALIGN(sizeof(_dynalc_header) + 1))
+			_da->search_from = next;
+		else
+			packed = 0;
 	}
 	/* Allocation as last element in chain
 	 * */
-	if (prev_data_end + total_size <= _da->region.mem + _da->region.len) {
-		fit = _dynalc_entry_create(prev_data_end, NULL, _size);
-		_ALLOCATOR_DATA2HEADER(prev)->next = fit;
-		_da->last = fit;
+	start = _DYNALC_ENTRY_START(prev_data_end, _align);
+	if (start + total_size <= _da->region.mem + _da->region.len) {
+		fit = _dynalc_entry_create(_da, start, prev, NULL, _size);
         goto FOUND_FIT;
 	}
 
 FOUND_FIT:
-    _ALC_BOOKKEEPER_INCREMENT(_da->bookkeeper);
+    if (fit != NULL) {
+        _ALC_BOOKKEEPER_INCREMENT(_da->bookkeeper);
+        /*Both modes keep the entry size at the same place in the header*/
+        _ALC_STATS_ALLOC(_da->bookkeeper, _size, _ALLOCATOR_DATA2HEADER(fit)->size);
+        _ALC_STATS_ALLOC_CYCLES(_da->bookkeeper, t);
+    }
     _TH_MUTEX_GIVE(_da->is_in_use);
     return fit;
 }
 
 ALLOCATOR_BACKEND
-void*
-_dynalc_find_entry(dynallocator* _da, void* _ptr, void** _prev_entry)
+char
+_dynalc_entry_prev(dynallocator* _da, uint8_t* _ptr, uint8_t** _prev)
 /**
- * dynAllocator_find_entry() - Find entry in chain.
+ * _dynalc_entry_prev() - check entry and find its previous entry.
  * @arg1: Ptr to dynamic allocator.
- * @arg2: Ptr to entry to find.
- * @arg3: (Output) PtrPtr to prev entry.
+ * @arg2: Ptr to entry.
+ * @arg3: (Output) Ptr to previous entry, NULL if @arg2 is first.
  *
- * Enforces explicit freeing of all chain entries.
- * Sets internal allocation counter to 0.
+ * An entry is part of the chain if its previous entry links to it.
  *
- * Return: found entry on clean exit, NULL on error.
- *         If entry was found, return ptr to that entry's previous entry,
- *         return NULL if found entry is first, or if @arg3 is NULL.
+ * Return: 1 if @arg2 is an entry in the chain, 0 otherwise.
  */
 {
-	uint8_t* prev = NULL;
-	/*Freeable entry is first entry*/
-	if (_ptr == _da->first) {
-		if (_prev_entry != NULL)
-			*_prev_entry = NULL;
-		return _da->first;
-	}
-
-	/*Find freeable entry inside entry chain*/
-	prev = _da->first;
-	while (prev != NULL) {
-		if (_ptr == _ALLOCATOR_DATA2HEADER(prev)->next) {
-			if (_prev_entry != NULL)
-				*_prev_entry = prev;
-			return _ALLOCATOR_DATA2HEADER(prev)->next;
-		}
-		prev = _ALLOCATOR_DATA2HEADER(prev)->next;
-	}
-	if (_prev_entry != NULL)
-		*_prev_entry = NULL;
-	return NULL;
+	_dynalc_header* h = _ALLOCATOR_DATA2HEADER(_ptr);
+	*_prev = NULL;
+	if (h->prev == 0)
+		return _da->first == _ptr;
+	if (h->prev >= _da->region.len)
+		return 0;
+	*_prev = _da->region.mem + h->prev;
+	return _ALLOCATOR_DATA2HEADER(*_prev)->next == _ptr;
 }
 
 ALLOCATOR_API
@@ -496,47 +1966,171 @@ dynalc_free(dynallocator* _da, void* _ptr)
  * @arg1: Ptr to dynamic allocator.
  * @arg2: Ptr to entry.
  *
- * Removes a chain entry.
+ * Removes a chain entry in O(1), the entry header links both neighbours.
+ * The free space before and after the entry becomes one gap, as the chain
+ * only holds allocations.
+ * Pointers that are not an entry in the chain are ignored.
  * Decrements internal allocation counter.
  *
  * Return: NULL.
  */
 {
-    void* prev = NULL;
-	void* entry = NULL;
-
-    _TH_MUTEX_WAIT_THEN_TAKE(_da->is_in_use);
+	_dynalc_header* h = NULL;
+	uint8_t* prev = NULL;
+	_ALC_STATS_TIMER(t)
 
 	if (_da == NULL || _ptr == NULL            ||
-        (uint8_t*)_ptr < _da->region.mem ||
+        (uint8_t*)_ptr < _da->region.mem + sizeof(_dynalc_header) ||
         (uint8_t*)_ptr > _da->region.mem + _da->region.len)
-        goto HAS_FREED;
+        return NULL;
 
+    _TH_MUTEX_WAIT_THEN_TAKE(_da->is_in_use);
+	if (_da->tlsf != NULL) {
+#ifdef ALLOCATOR_STATS
+		/*Read before the block merges with its neighbours*/
+		if (((_dynalc_block*)_ptr - 1)->state == _DYNALC_BLOCK_USED)
+			_ALC_STATS_FREE(_da->bookkeeper, ((_dynalc_block*)_ptr - 1)->size);
+#endif /*ALLOCATOR_STATS*/
+		if (_dynalc_tlsf_free(_da->tlsf, (uint8_t*)_ptr)) {
+			_ALC_BOOKKEEPER_DECREMENT(_da->bookkeeper);
+			_ALC_STATS_FREE_CYCLES(_da->bookkeeper, t);
+		}
+		goto HAS_FREED;
+	}
 
-	entry = _dynalc_find_entry(_da, _ptr, &prev);
 	/*Check if entry is part of chain*/
-	if (prev == NULL && entry == NULL)
-        goto HAS_FREED;
+	if (!_dynalc_entry_prev(_da, (uint8_t*)_ptr, &prev))
+		goto HAS_FREED;
+	h = _ALLOCATOR_DATA2HEADER(_ptr);
 
     /*Remove found entry from allocator
      */
     _ALC_BOOKKEEPER_DECREMENT(_da->bookkeeper);
-	if (prev == NULL && entry == _da->first) {
-        /*entry is first in chain*/
-		_da->first = _ALLOCATOR_DATA2HEADER(_da->first)->next; 
-		if (_da->last == _da->first)
-			_da->last = NULL;
-        goto HAS_FREED;
-	}
-	/*Remove entry from inside chain*/
-	_ALLOCATOR_DATA2HEADER(prev)->next = _ALLOCATOR_DATA2HEADER(entry)->next;
-
+    _ALC_STATS_FREE(_da->bookkeeper, h->size);
+	/*The gap after prev grows, so the search must start at prev again*/
+	if (_da->search_from != NULL && (uint8_t*)_ptr <= _da->search_from)
+		_da->search_from = prev;
+	if (prev == NULL)
+		_da->first = h->next;
+	else
+		_ALLOCATOR_DATA2HEADER(prev)->next = h->next;
+	if (h->next == NULL)
+		_da->last = prev;
+	else
+		_ALLOCATOR_DATA2HEADER(h->next)->prev = h->prev;
+
+    _ALC_STATS_FREE_CYCLES(_da->bookkeeper, t);
 
 HAS_FREED:
     _TH_MUTEX_GIVE(_da->is_in_use);
     return NULL;
 }
 
+ALLOCATOR_API
+void*
+dynalc_realloc(dynallocator* _da, void* _oldptr, uint32_t _newsize)
+/**
+ * dynalc_realloc() - resize entry, see dynalc_realloc_aligned().
+ * @arg1: Ptr to dynamic allocator.
+ * @arg2: Ptr to entry, NULL to create one.
+ * @arg3: New size of entry, 0 to remove it.
+ *
+ * Return: Ptr to resized entry, NULL if it could not be resized, the old
+ *         entry is then left untouched.
+ */
+{
+	return dynalc_realloc_aligned(_da, _oldptr, _newsize, _TH_ALIGNMENT);
+}
+
+ALLOCATOR_API
+void*
+dynalc_realloc_aligned(dynallocator* _da, void* _oldptr, uint32_t _newsize,
+                       uint32_t _align)
+/**
+ * dynalc_realloc_aligned() - resize entry and keep its data aligned.
+ * @arg1: Ptr to dynamic allocator.
+ * @arg2: Ptr to entry, NULL to create one.
+ * @arg3: New size of entry, 0 to remove it.
+ * @arg4: alignment of the entry data, a power of two, as given to
+ *        dynalc_malloc_aligned().
+ *
+ * Resizes in place when possible, the data is then never copied.
+ * A shrinking entry gives its tail back to the gap after it. A growing
+ * entry takes from the gap after it, which in TLSF mode is the next free
+ * block. Otherwise, or if the entry is not aligned to @arg4, the entry is
+ * moved to a new allocation with that alignment.
+ *
+ * Return: Ptr to resized entry, NULL if it could not be resized, the old
+ *         entry is then left untouched.
+ */
+{
+	_dynalc_header* h = NULL;
+	uint8_t* prev = NULL;
+	uint8_t* limit = NULL;
+	uint8_t* out = NULL;
+	uint32_t n;
+	uint32_t i;
+	char in_place = 0;
+
+	if (_da == NULL || !_TH_IS_POW2(_align))
+		return NULL;
+	if (_oldptr == NULL)
+		return dynalc_malloc_aligned(_da, _newsize, _align);
+	if (_newsize == 0)
+		return dynalc_free(_da, _oldptr);
+	if ((uint8_t*)_oldptr < _da->region.mem + sizeof(_dynalc_header) ||
+        (uint8_t*)_oldptr > _da->region.mem + _da->region.len)
+		return NULL;
+
+    _TH_MUTEX_WAIT_THEN_TAKE(_da->is_in_use);
+	h = _ALLOCATOR_DATA2HEADER(_oldptr);
+	n = h->size;
+	if (((unsigned long)_oldptr & (_align - 1)) != 0) {
+		/*Checked like below, the move frees it*/
+		if (_da->tlsf != NULL ? ((_dynalc_block*)h)->state != _DYNALC_BLOCK_USED
+		                      : !_dynalc_entry_prev(_da, (uint8_t*)_oldptr, &prev))
+			goto INVALID;
+	} else if (_da->tlsf != NULL) {
+		if (((_dynalc_block*)h)->state != _DYNALC_BLOCK_USED)
+			goto INVALID;
+		in_place = _dynalc_tlsf_resize(_da->tlsf, (uint8_t*)_oldptr, _newsize);
+	} else {
+		if (!_dynalc_entry_prev(_da, (uint8_t*)_oldptr, &prev))
+			goto INVALID;
+		limit = (h->next != NULL) ? (uint8_t*)_ALLOCATOR_DATA2HEADER(h->next)
+		                          : _da->region.mem + _da->region.len;
+		if ((uint8_t*)_oldptr + _newsize <= limit &&
+		    _ALC_REGION_COMMIT(_da->region, (uint8_t*)_oldptr + _newsize)) {
+			/*A shrinking entry opens a gap the search must see*/
+			if (_newsize < h->size && _da->search_from != NULL &&
+			    (uint8_t*)_oldptr < _da->search_from)
+				_da->search_from = (uint8_t*)_oldptr;
+			h->size = _newsize;
+			in_place = 1;
+		}
+	}
+	if (in_place)
+		_ALC_STATS_BYTES(_da->bookkeeper, _da->bookkeeper.bytes - n + h->size);
+    _TH_MUTEX_GIVE(_da->is_in_use);
+	if (in_place)
+		return _oldptr;
+
+	/*Move to a new allocation*/
+	out = (uint8_t*)dynalc_malloc_aligned(_da, _newsize, _align);
+	if (out == NULL)
+		return NULL;
+	if (_newsize < n)
+		n = _newsize;
+	for (i = 0; i < n; i++)
+		out[i] = ((uint8_t*)_oldptr)[i];
+	dynalc_free(_da, _oldptr);
+	return out;
+
+INVALID:
+    _TH_MUTEX_GIVE(_da->is_in_use);
+	return NULL;
+}
+
 ALLOCATOR_API
 allocator_status
 dynalc_free_all(dynallocator* _da)
@@ -558,12 +2152,91 @@ dynalc_free_all(dynallocator* _da)
     _TH_MUTEX_WAIT_THEN_TAKE(_da->is_in_use);
 	_da->first = NULL;
 	_da->last = NULL;
+	_da->search_from = NULL;
+	if (_da->tlsf != NULL)
+		_dynalc_tlsf_reset(_da);
+	else
+		_ALC_REGION_DECOMMIT(_da->region, _da->region.mem);
     _ALC_BOOKKEEPER_CLEAR(_da->bookkeeper);
 
     _TH_MUTEX_GIVE(_da->is_in_use);
 	return ALLOCATOR_OK;
 }
 
+#ifdef ALLOCATOR_STATS
+ALLOCATOR_API
+alc_fragmentation
+dynalc_fragmentation(dynallocator* _da)
+/**
+ * dynalc_fragmentation() - measure the free space.
+ * @arg1: Ptr to dynamic allocator.
+ *
+ * Walks the gaps between entries, or the physical blocks in TLSF mode, so
+ * it is O(n) in the number of entries.
+ *
+ * Return: free bytes, the largest free gap and the external fragmentation
+ *         ratio. Gaps include the space a header would take.
+ */
+{
+	alc_fragmentation f = {0, 0, 0.0};
+	_dynalc_block* b;
+	uint8_t* gap_start;
+	uint8_t* next;
+	uint64_t gap;
+
+	if (_da == NULL || !region_ok(&_da->region))
+		return f;
+    _TH_MUTEX_WAIT_THEN_TAKE(_da->is_in_use);
+	if (_da->tlsf != NULL) {
+		b = (_dynalc_block*)_TH_ALIGN((unsigned long)(_da->tlsf + 1));
+		for (; b->size > 0; b = _DYNALC_BLOCK_NEXT_PHYS(b)) {
+			if (b->state != _DYNALC_BLOCK_FREE)
+				continue;
+			f.free_bytes += b->size;
+			if (b->size > f.largest_free)
+				f.largest_free = b->size;
+		}
+	} else {
+		gap_start = _da->region.mem;
+		next = _da->first;
+		while (1) {
+			gap = ((next != NULL) ? (uint8_t*)_ALLOCATOR_DATA2HEADER(next)
+			                      : _da->region.mem + _da->region.len) - gap_start;
+			f.free_bytes += gap;
+			if (gap > f.largest_free)
+				f.largest_free = gap;
+			if (next == NULL)
+				break;
+			gap_start = next + _ALLOCATOR_DATA2HEADER(next)->size;
+			next = _ALLOCATOR_DATA2HEADER(next)->next;
+		}
+	}
+    _TH_MUTEX_GIVE(_da->is_in_use);
+	if (f.free_bytes > 0)
+		f.ratio = 1.0 - (double)f.largest_free / (double)f.free_bytes;
+	return f;
+}
+
+ALLOCATOR_API
+void
+dynalc_stats_dump(FILE* _out, dynallocator* _da)
+/**
+ * dynalc_stats_dump() - Print statistics and fragmentation of allocator.
+ * @arg1: Stream to print to.
+ * @arg2: Ptr to dynamic allocator.
+ */
+{
+	alc_fragmentation f;
+	if (_out == NULL || _da == NULL)
+		return;
+	f = dynalc_fragmentation(_da);
+	alc_stats_dump(_out, (_da->tlsf != NULL) ? "dynallocator (tlsf)" : "dynallocator", &_da->bookkeeper);
+	fprintf(_out, "  region: %llu, free: %llu, largest free gap: %llu, fragmentation: %.3f\n",
+	        (unsigned long long)_da->region.len, (unsigned long long)f.free_bytes,
+	        (unsigned long long)f.largest_free, f.ratio);
+}
+#endif /*ALLOCATOR_STATS*/
+
 ALLOCATOR_API
 allocator_status
 blkalc_init(blkallocator* _ba,
@@ -588,27 +2261,203 @@ blkalc_init(blkallocator* _ba,
  *         exit.
  */
 {
-    blk_handle tmp_handle;
-	if (_ba == NULL || _memory == NULL ||
-        _block_size < 1 || _block_count < 1 ||
-        _block_size != _TH_ALIGN(_block_size))
+	if (_block_size != _TH_ALIGN(_block_size))
 		return ALLOCATOR_INVALID_INPUT;
+	return blkalc_init_aligned(_ba, _memory, _block_size, _block_count, _TH_ALIGNMENT);
+}
 
-    _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
+ALLOCATOR_API
+allocator_status
+blkalc_init_aligned(blkallocator* _ba,
+                    uint8_t* _memory,
+                    uint32_t _block_size,
+                    uint32_t _block_count,
+                    uint32_t _align)
+/**
+ * blkalc_init_aligned() - Setup block allocator with aligned blocks.
+ *
+ * @arg1: Ptr to block allocator.
+ * @arg2: Ptr to memory for allocator.
+ * @arg3: size of single block specified in bytes.
+ * @arg4: amount blocks to be allocated.
+ * @arg5: alignment of every block, a power of two. Smaller than
+ *        _TH_ALIGNMENT means _TH_ALIGNMENT. BLKALC_CACHE_LINE for blocks on
+ *        cache lines of their own.
+ *
+ * The block size is rounded up to the alignment, the memory must be at least
+ * BLKALC_OPTIMAL_MEMSIZE_ALIGNED().
+ *
+ * Return: error management code, ALLOCATOR_INVALID_INPUT for error,
+ *         ALLOCATOR_OK for clean exit.
+ */
+{
+	if (_ba == NULL || _memory == NULL ||
+        _block_size < 1 || _block_count < 1 || !_TH_IS_POW2(_align))
+		return ALLOCATOR_INVALID_INPUT;
+	if (_align < _TH_ALIGNMENT)
+		_align = _TH_ALIGNMENT;
 
-	_ba->block_size = _TH_ALIGN(_block_size);
+    _TH_MUTEX_INIT(_ba->is_in_use);
+	_ba->block_size = _TH_ALIGN_TO(_block_size, _align);
 	_ba->block_count = _block_count;
+	_ba->block_align = _align;
     _ALC_BOOKKEEPER_NEW(_ba->bookkeeper);
+#ifndef TH_DISABLE_MUTEX
+    _ba->lockfree = 0;
+#endif /*TH_DISABLE_MUTEX*/
 
+    /*The handle stack comes first, blocks follow at the next alignment*/
     _ba->handle_stack = (blk_handle*)_memory;
-    _ba->region = region(_memory, _block_size * _block_count);
-    for (_ba->stack_top = 0; _ba->stack_top < _block_count; _ba->stack_top++) {
-        tmp_handle = (blk_handle) {_ba, _ba->stack_top};
-        _ba->handle_stack[_ba->stack_top] = tmp_handle;
+    _ba->region = region(_memory, BLKALC_OPTIMAL_MEMSIZE_ALIGNED(_block_count, _block_size, _align));
+    /*Pushed in reverse so blocks are handed out from the start of the region*/
+    for (_ba->stack_top = 0; _ba->stack_top < _block_count; _ba->stack_top++)
+        _ba->handle_stack[_ba->stack_top] =
+            (blk_handle) {_ba, _block_count - 1 - _ba->stack_top};
+    return ALLOCATOR_OK;
+}
+
+#ifndef TH_DISABLE_MUTEX
+/*The lock-free free list is a Treiber stack of block indices. The memory of
+  the handle stack holds the index of the next free block per block. The
+  head packs the top index with a tag that every push and pop increments,
+  so a head that was popped and pushed back in between fails the CAS (ABA)*/
+#define _BLKALC_NONE 0xffffffffu
+#define _BLKALC_HEAD(idx, tag) ( ((uint64_t)(tag) << 32) | (uint32_t)(idx) )
+#define _BLKALC_HEAD_IDX(head) ( (uint32_t)(head) )
+#define _BLKALC_HEAD_TAG(head) ( (uint32_t)((head) >> 32) )
+#define _BLKALC_LINKS(ba) ( (atomic_uint*)(ba)->handle_stack )
+
+ALLOCATOR_API
+allocator_status
+blkalc_init_lockfree(blkallocator* _ba,
+                     uint8_t* _memory,
+                     uint32_t _block_size,
+                     uint32_t _block_count)
+/**
+ * blkalc_init_lockfree() - Setup block allocator in lock-free mode.
+ *
+ * @arg1: Ptr to block allocator.
+ * @arg2: Ptr to memory for allocator.
+ * @arg3: size of single block specified in bytes.
+ * @arg4: amount blocks to be allocated.
+ *
+ * Like blkalc_init(), but take and return never lock, any number of threads
+ * can take and return blocks at once. Use a blk_magazine per thread to
+ * batch the shared operations. The bookkeeper is not updated, the counts
+ * are kept atomically and read with blkalc_bookkeeper(). There are no
+ * ALLOCATOR_STATS histograms in this mode, blocks in magazines count as
+ * taken.
+ *
+ * Return: error management code, ALLOCATOR_INVALID_INPUT for error,
+ *         ALLOCATOR_OK for clean exit.
+ */
+{
+    if (_block_size != _TH_ALIGN(_block_size))
+        return ALLOCATOR_INVALID_INPUT;
+    return blkalc_init_lockfree_aligned(_ba, _memory, _block_size, _block_count, _TH_ALIGNMENT);
+}
+
+ALLOCATOR_API
+allocator_status
+blkalc_init_lockfree_aligned(blkallocator* _ba,
+                             uint8_t* _memory,
+                             uint32_t _block_size,
+                             uint32_t _block_count,
+                             uint32_t _align)
+/**
+ * blkalc_init_lockfree_aligned() - Setup lock-free block allocator with
+ *                                  aligned blocks.
+ *
+ * See blkalc_init_lockfree() and blkalc_init_aligned().
+ */
+{
+    uint32_t i;
+    allocator_status status = blkalc_init_aligned(_ba, _memory, _block_size, _block_count, _align);
+    if (status != ALLOCATOR_OK)
+        return status;
+    for (i = 0; i < _block_count; i++)
+        atomic_init(&_BLKALC_LINKS(_ba)[i], (i + 1 < _block_count) ? i + 1 : _BLKALC_NONE);
+    atomic_init(&_ba->free_head, _BLKALC_HEAD(0, 0));
+    atomic_init(&_ba->n_taken, 0);
+    atomic_init(&_ba->n_total, 0);
+    _ba->lockfree = 1;
+    return ALLOCATOR_OK;
+}
+#endif /*TH_DISABLE_MUTEX*/
+
+ALLOCATOR_BACKEND
+uint32_t
+_blkalc_pop(blkallocator* _ba, uint32_t* _ids, uint32_t _n)
+/**
+ * _blkalc_pop() - take up to @arg3 free blocks at once.
+ *
+ * In lock-free mode the chain below the head is walked first, and taken with
+ * a single CAS. An unchanged tagged head means the walked chain is unchanged.
+ *
+ * Return: amount of block indices written to @arg2.
+ */
+{
+    uint32_t k = 0;
+#ifndef TH_DISABLE_MUTEX
+    uint_least64_t head;
+    uint32_t idx;
+    if (_ba->lockfree) {
+        head = atomic_load_explicit(&_ba->free_head, memory_order_acquire);
+        do {
+            idx = _BLKALC_HEAD_IDX(head);
+            for (k = 0; idx != _BLKALC_NONE && k < _n; k++) {
+                _ids[k] = idx;
+                idx = atomic_load_explicit(&_BLKALC_LINKS(_ba)[idx], memory_order_relaxed);
+            }
+            if (k == 0)
+                return 0;
+        } while (!atomic_compare_exchange_weak_explicit(&_ba->free_head, &head,
+                     _BLKALC_HEAD(idx, _BLKALC_HEAD_TAG(head) + 1),
+                     memory_order_acquire, memory_order_acquire));
+        atomic_fetch_add_explicit(&_ba->n_taken, k, memory_order_relaxed);
+        atomic_fetch_add_explicit(&_ba->n_total, k, memory_order_relaxed);
+        return k;
+    }
+#endif /*TH_DISABLE_MUTEX*/
+    _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
+    for (k = 0; k < _n && _ba->stack_top > 0; k++) {
+        _ids[k] = _ba->handle_stack[--_ba->stack_top].blockid;
+        _ALC_BOOKKEEPER_INCREMENT(_ba->bookkeeper);
+        _ALC_STATS_ALLOC(_ba->bookkeeper, _ba->block_size, _ba->block_size);
     }
+    _TH_MUTEX_GIVE(_ba->is_in_use);
+    return k;
+}
 
+ALLOCATOR_BACKEND
+void
+_blkalc_push(blkallocator* _ba, uint32_t* _ids, uint32_t _n)
+/*Give back @arg3 block indices at once, in lock-free mode with one CAS*/
+{
+    uint32_t i;
+#ifndef TH_DISABLE_MUTEX
+    uint_least64_t head;
+    if (_ba->lockfree) {
+        for (i = 0; i + 1 < _n; i++)
+            atomic_store_explicit(&_BLKALC_LINKS(_ba)[_ids[i]], _ids[i + 1], memory_order_relaxed);
+        head = atomic_load_explicit(&_ba->free_head, memory_order_relaxed);
+        do {
+            atomic_store_explicit(&_BLKALC_LINKS(_ba)[_ids[_n - 1]],
+                                  _BLKALC_HEAD_IDX(head), memory_order_relaxed);
+        } while (!atomic_compare_exchange_weak_explicit(&_ba->free_head, &head,
+                     _BLKALC_HEAD(_ids[0], _BLKALC_HEAD_TAG(head) + 1),
+                     memory_order_release, memory_order_relaxed));
+        atomic_fetch_sub_explicit(&_ba->n_taken, _n, memory_order_relaxed);
+        return;
+    }
+#endif /*TH_DISABLE_MUTEX*/
+    _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
+    for (i = 0; i < _n; i++) {
+        _ba->handle_stack[_ba->stack_top++] = (blk_handle) {_ba, _ids[i]};
+        _ALC_BOOKKEEPER_DECREMENT(_ba->bookkeeper);
+        _ALC_STATS_FREE(_ba->bookkeeper, _ba->block_size);
+    }
     _TH_MUTEX_GIVE(_ba->is_in_use);
-    return ALLOCATOR_OK;
 }
 
 ALLOCATOR_API
@@ -623,16 +2472,29 @@ blkalc_take(blkallocator* _ba)
  */
 {
     blk_handle out;
+    _ALC_STATS_TIMER(t)
 	if (_ba == NULL)
 		return BLKHANDLE_INVALID;
     if (!region_ok(&_ba->region))
 		return BLKHANDLE_INVALID;
+#ifndef TH_DISABLE_MUTEX
+    if (_ba->lockfree) {
+        if (_blkalc_pop(_ba, &out.blockid, 1) == 0)
+            return BLKHANDLE_INVALID;
+        out.blkalc = _ba;
+        return out;
+    }
+#endif /*TH_DISABLE_MUTEX*/
 
     _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
-    if (_ba->stack_top <= 0)
+    if (_ba->stack_top <= 0) {
         out = BLKHANDLE_INVALID;
-    else
-        out = _ba->handle_stack[_ba->stack_top--];
+    } else {
+        out = _ba->handle_stack[--_ba->stack_top];
+        _ALC_BOOKKEEPER_INCREMENT(_ba->bookkeeper);
+        _ALC_STATS_ALLOC(_ba->bookkeeper, _ba->block_size, _ba->block_size);
+        _ALC_STATS_ALLOC_CYCLES(_ba->bookkeeper, t);
+    }
     _TH_MUTEX_GIVE(_ba->is_in_use);
     return out;
 }
@@ -646,10 +2508,20 @@ blk_handle_return(blk_handle _handle)
  * @arg2: specified block to return.
  */
 {
+    _ALC_STATS_TIMER(t)
 	if (!blk_ok(&_handle))
 		return;
+#ifndef TH_DISABLE_MUTEX
+    if (_handle.blkalc->lockfree) {
+        _blkalc_push(_handle.blkalc, &_handle.blockid, 1);
+        return;
+    }
+#endif /*TH_DISABLE_MUTEX*/
     _TH_MUTEX_WAIT_THEN_TAKE(_handle.blkalc->is_in_use);
-    _handle.blkalc->handle_stack[++_handle.blkalc->stack_top] = _handle;
+    _handle.blkalc->handle_stack[_handle.blkalc->stack_top++] = _handle;
+    _ALC_BOOKKEEPER_DECREMENT(_handle.blkalc->bookkeeper);
+    _ALC_STATS_FREE(_handle.blkalc->bookkeeper, _handle.blkalc->block_size);
+    _ALC_STATS_FREE_CYCLES(_handle.blkalc->bookkeeper, t);
     _TH_MUTEX_GIVE(_handle.blkalc->is_in_use);
 }
 
@@ -674,15 +2546,130 @@ blkalc_n_available(blkallocator* _ba)
  */
 {
     uint32_t n = 0;
-    _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
 	if (_ba == NULL)
-        n = 0;
-    else
-        n = _ba->block_count - _ba->bookkeeper.curr;
+        return 0;
+#ifndef TH_DISABLE_MUTEX
+    if (_ba->lockfree)
+        return _ba->block_count - atomic_load_explicit(&_ba->n_taken, memory_order_relaxed);
+#endif /*TH_DISABLE_MUTEX*/
+    _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
+    n = _ba->block_count - _ba->bookkeeper.curr;
     _TH_MUTEX_GIVE(_ba->is_in_use);
 	return n;
 }
 
+ALLOCATOR_API
+_allocation_bookkeeper
+blkalc_bookkeeper(blkallocator* _ba)
+/**
+ * blkalc_bookkeeper() - Copy of the bookkeeper, in any mode.
+ *
+ * @arg1: Ptr to block allocator.
+ *
+ * In lock-free mode the live and total counts come from the atomic
+ * counters, and the bytes in use from the live count. For alc_stats_dump().
+ *
+ * Return: the statistics of the allocator.
+ */
+{
+    _allocation_bookkeeper book;
+    _ALC_BOOKKEEPER_NEW(book);
+	if (_ba == NULL)
+        return book;
+#ifndef TH_DISABLE_MUTEX
+    if (_ba->lockfree) {
+        book.curr = atomic_load_explicit(&_ba->n_taken, memory_order_relaxed);
+        book.total = atomic_load_explicit(&_ba->n_total, memory_order_relaxed);
+        _ALC_STATS_BYTES(book, (uint64_t)book.curr * _ba->block_size);
+        return book;
+    }
+#endif /*TH_DISABLE_MUTEX*/
+    _TH_MUTEX_WAIT_THEN_TAKE(_ba->is_in_use);
+    book = _ba->bookkeeper;
+    _TH_MUTEX_GIVE(_ba->is_in_use);
+	return book;
+}
+
+ALLOCATOR_API
+blk_magazine
+blkalc_magazine(blkallocator* _ba)
+/**
+ * blkalc_magazine() - Create an empty magazine for one thread.
+ *
+ * @arg1: Ptr to block allocator.
+ *
+ * Return: magazine, give its blocks back with blk_magazine_flush().
+ */
+{
+    blk_magazine m;
+    m.blkalc = _ba;
+    m.n = 0;
+    return m;
+}
+
+ALLOCATOR_API
+blk_handle
+blk_magazine_take(blk_magazine* _m)
+/**
+ * blk_magazine_take() - Take a block from the magazine.
+ *
+ * @arg1: Ptr to magazine.
+ *
+ * Refills half the magazine from the allocator when it is empty.
+ *
+ * Return: Taken block, BLKHANDLE_INVALID if the allocator is empty.
+ */
+{
+    if (_m == NULL || _m->blkalc == NULL)
+        return BLKHANDLE_INVALID;
+    if (_m->n == 0)
+        _m->n = _blkalc_pop(_m->blkalc, _m->ids, BLKALC_MAGAZINE_SIZE / 2);
+    if (_m->n == 0)
+        return BLKHANDLE_INVALID;
+    return (blk_handle) {_m->blkalc, _m->ids[--_m->n]};
+}
+
+ALLOCATOR_API
+void
+blk_magazine_return(blk_magazine* _m, blk_handle _handle)
+/**
+ * blk_magazine_return() - Return a block to the magazine.
+ *
+ * @arg1: Ptr to magazine.
+ * @arg2: block to return.
+ *
+ * Flushes half the magazine to the allocator when it is full. Blocks of
+ * another allocator are returned to that allocator.
+ */
+{
+    if (_m == NULL || !blk_ok(&_handle))
+        return;
+    if (_handle.blkalc != _m->blkalc) {
+        blk_handle_return(_handle);
+        return;
+    }
+    if (_m->n == BLKALC_MAGAZINE_SIZE) {
+        _m->n -= BLKALC_MAGAZINE_SIZE / 2;
+        _blkalc_push(_m->blkalc, _m->ids + _m->n, BLKALC_MAGAZINE_SIZE / 2);
+    }
+    _m->ids[_m->n++] = _handle.blockid;
+}
+
+ALLOCATOR_API
+void
+blk_magazine_flush(blk_magazine* _m)
+/**
+ * blk_magazine_flush() - Return all cached blocks to the allocator.
+ *
+ * @arg1: Ptr to magazine.
+ */
+{
+    if (_m == NULL || _m->blkalc == NULL || _m->n == 0)
+        return;
+    _blkalc_push(_m->blkalc, _m->ids, _m->n);
+    _m->n = 0;
+}
+
 ALLOCATOR_API
 void*
 _blkalc_ptr(blk_handle _handle)
@@ -705,8 +2692,9 @@ _blkalc_ptr(blk_handle _handle)
     ba = _handle.blkalc;
 	if (!region_ok(&ba->region))
 		return NULL;
-	offset = (ba->block_count * ba->block_size) + (ba->block_size * (_handle.blockid));
-	return (void*)_TH_ALIGN((unsigned long)(ba->region.mem + offset));
+	offset = ba->block_size * _handle.blockid;
+	return (void*)(_TH_ALIGN_TO((unsigned long)(ba->handle_stack + ba->block_count), ba->block_align)
+	               + offset);
 }
 
 #endif /*ALLOCATOR_IMPLEMENTATION*/
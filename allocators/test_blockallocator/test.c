@@ -1,7 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "testlib.h"
+#include "../test_stress.h"
 
 #define ALLOCATOR_IMPLEMENTATION
 //#define MEMALLOCATOR_NO_ASSERT
@@ -35,11 +39,11 @@ test_custom_struct(void)
 	blk_handle pos1 = blkalc_take(&pos_alloc);
 	TL_TEST(blk_ok(&pos1));
 	TL_PRINT("pos1 = %d\n", pos1.blockid);
-	TL_TEST(*blk_ptr(pos1, int) == 0);
+	TL_TEST(pos1.blockid == 0);
 	blk_handle pos2 = blkalc_take(&pos_alloc);
 	TL_TEST(blk_ok(&pos2));
 	TL_PRINT("pos1 = %d\n", pos1.blockid);
-	TL_TEST(*blk_ptr(pos2, int) == 1);
+	TL_TEST(pos2.blockid == 1);
 	TL_TEST(blkalc_n_available(&pos_alloc) == 18);
 
 	pos* pos2_ptr = blk_ptr(pos2, pos);
@@ -129,11 +133,209 @@ void alignment_test(void) {
 
 }
 
+void
+test_aligned(void)
+{
+	static uint8_t mem[BLKALC_OPTIMAL_MEMSIZE_ALIGNED(8, 20, BLKALC_CACHE_LINE)];
+	blkallocator ba = {0};
+	blk_handle h;
+	uint8_t* p;
+	uint8_t* prev = NULL;
+	uint32_t i;
+
+	TL_TEST(blkalc_init_aligned(&ba, mem, 20, 8, 3) == ALLOCATOR_INVALID_INPUT);
+	TL_TEST(blkalc_init_aligned(&ba, mem, 20, 8, BLKALC_CACHE_LINE) == ALLOCATOR_OK);
+	TL_TESTM(ba.block_size == BLKALC_CACHE_LINE, "blocks are padded to a whole line");
+	for (i = 0; i < 8; i++) {
+		h = blkalc_take(&ba);
+		p = blk_ptr(h, uint8_t);
+		TL_TEST(p != NULL && (unsigned long)p % BLKALC_CACHE_LINE == 0);
+		TL_TEST(p + 20 <= mem + sizeof(mem));
+		TL_TEST(prev == NULL || p - prev == BLKALC_CACHE_LINE);
+		memset(p, i, 20);
+		prev = p;
+	}
+	TL_TEST(blkalc_n_available(&ba) == 0);
+}
+
+/*Multithreaded tests, every thread holds a few blocks at a time and checks
+  that no other thread wrote to them while they were held*/
+#define STRESS_HELD 8
+#define STRESS_BLOCK_SIZE 64
+/*Magazines may cache blocks on top of the held ones*/
+#define STRESS_BLOCKS (STRESS_THREADS * (STRESS_HELD + BLKALC_MAGAZINE_SIZE))
+
+typedef struct {
+	blkallocator* ba;
+	uint8_t* mem;
+	char lockfree;
+	char magazine;
+}blk_stress;
+
+void*
+stress_worker(void* _arg)
+{
+	stress_arg* a = (stress_arg*)_arg;
+	blk_stress* s = (blk_stress*)a->alc;
+	blk_magazine m = blkalc_magazine(s->ba);
+	blk_handle held[STRESS_HELD];
+	uint8_t* p;
+	int i, j, k;
+
+	for (i = 0; i < a->rounds; i++) {
+		for (j = 0; j < STRESS_HELD; j++) {
+			held[j] = (s->magazine) ? blk_magazine_take(&m) : blkalc_take(s->ba);
+			if (!blk_ok(&held[j])) {
+				a->failed++;
+				continue;
+			}
+			memset(blk_ptr(held[j], uint8_t), a->id, STRESS_BLOCK_SIZE);
+		}
+		for (j = 0; j < STRESS_HELD; j++) {
+			if (!blk_ok(&held[j]))
+				continue;
+			p = blk_ptr(held[j], uint8_t);
+			for (k = 0; k < STRESS_BLOCK_SIZE; k++)
+				if (p[k] != a->id) {
+					a->corrupt++;
+					break;
+				}
+			if (s->magazine)
+				blk_magazine_return(&m, held[j]);
+			else
+				blk_handle_return(held[j]);
+		}
+	}
+	blk_magazine_flush(&m);
+	return NULL;
+}
+
+/*Lock-free mode needs the atomics of the mutex*/
+#ifndef TH_DISABLE_MUTEX
+void
+test_lockfree(void)
+{
+	const uint32_t count = 20;
+	static uint8_t mem[BLKALC_OPTIMAL_MEMSIZE(20, STRESS_BLOCK_SIZE)];
+	blkallocator ba = {0};
+	blk_handle h[20];
+	blk_magazine m;
+	uint32_t seen = 0;
+	uint32_t i;
+
+	TL_TEST(blkalc_init_lockfree(&ba, mem, STRESS_BLOCK_SIZE + 1, count) == ALLOCATOR_INVALID_INPUT);
+	TL_TEST(blkalc_init_lockfree(&ba, mem, STRESS_BLOCK_SIZE, count) == ALLOCATOR_OK);
+	TL_TEST(blkalc_n_available(&ba) == count);
+
+	for (i = 0; i < count; i++) {
+		h[i] = blkalc_take(&ba);
+		if (blk_ok(&h[i]) && h[i].blockid < count)
+			seen |= 1u << h[i].blockid;
+	}
+	TL_TESTM(seen == (1u << count) - 1, "every block is taken once");
+	TL_TEST(blkalc_n_available(&ba) == 0);
+	TL_TEST(blkalc_bookkeeper(&ba).curr == count);
+	TL_TEST(blkalc_bookkeeper(&ba).total == count);
+	h[0] = blkalc_take(&ba);
+	TL_TEST(!blk_ok(&h[0]));
+
+	blk_handle_return(h[5]);
+	TL_TEST(blkalc_n_available(&ba) == 1);
+	h[0] = blkalc_take(&ba);
+	TL_TEST(blk_ok(&h[0]) && h[0].blockid == 5);
+	for (i = 0; i < count; i++)
+		blk_handle_return(h[i]);
+	TL_TEST(blkalc_n_available(&ba) == count);
+	TL_TEST(blkalc_bookkeeper(&ba).curr == 0);
+	TL_TEST(blkalc_bookkeeper(&ba).total == count + 1);
+
+	/*Magazines take half their size at once and give everything back*/
+	m = blkalc_magazine(&ba);
+	h[0] = blk_magazine_take(&m);
+	TL_TEST(blk_ok(&h[0]));
+	TL_TEST(blkalc_n_available(&ba) == count - BLKALC_MAGAZINE_SIZE / 2);
+	TL_TEST(m.n == BLKALC_MAGAZINE_SIZE / 2 - 1);
+	blk_magazine_return(&m, h[0]);
+	blk_magazine_flush(&m);
+	TL_TEST(blkalc_n_available(&ba) == count);
+	TL_TEST(m.n == 0);
+
+	TL_TEST(blkalc_init_lockfree_aligned(&ba, mem, 20, count / 2, BLKALC_CACHE_LINE) == ALLOCATOR_OK);
+	h[0] = blkalc_take(&ba);
+	TL_TEST((unsigned long)blk_ptr(h[0], uint8_t) % BLKALC_CACHE_LINE == 0);
+	TL_TEST(blkalc_n_available(&ba) == count / 2 - 1);
+}
+
+void
+stress_reset(void* _alc)
+{
+	blk_stress* s = (blk_stress*)_alc;
+	if (s->lockfree)
+		blkalc_init_lockfree(s->ba, s->mem, STRESS_BLOCK_SIZE, STRESS_BLOCKS);
+	else
+		blkalc_init(s->ba, s->mem, STRESS_BLOCK_SIZE, STRESS_BLOCKS);
+}
+
+void
+test_threaded_stress(void)
+{
+	const uint32_t count = STRESS_BLOCKS;
+	const int rounds = 20000;
+	static uint8_t mem[BLKALC_OPTIMAL_MEMSIZE(STRESS_BLOCKS, STRESS_BLOCK_SIZE)];
+	blkallocator ba = {0};
+	blk_stress s = {&ba, mem, 0, 0};
+	int corrupt;
+	int failed;
+
+	TL_TEST(blkalc_init(&ba, mem, STRESS_BLOCK_SIZE, count) == ALLOCATOR_OK);
+	stress_run(stress_worker, &s, STRESS_THREADS, rounds, &corrupt, &failed);
+	TL_TEST(corrupt == 0);
+	TL_TEST(failed == 0);
+	TL_TEST(blkalc_n_available(&ba) == count);
+	TL_TEST(ba.bookkeeper.total == (uint32_t)(STRESS_THREADS * STRESS_HELD * rounds));
+
+	for (s.magazine = 0; s.magazine < 2; s.magazine++) {
+		blkalc_init_lockfree(&ba, mem, STRESS_BLOCK_SIZE, count);
+		stress_run(stress_worker, &s, STRESS_THREADS, rounds, &corrupt, &failed);
+		TL_TEST(corrupt == 0);
+		TL_TEST(failed == 0);
+		TL_TEST(blkalc_n_available(&ba) == count);
+		TL_TEST(blkalc_bookkeeper(&ba).curr == 0);
+	}
+
+}
+
+void
+test_contention_benchmark(void)
+{
+	static uint8_t mem[BLKALC_OPTIMAL_MEMSIZE(STRESS_BLOCKS, STRESS_BLOCK_SIZE)];
+	blkallocator ba = {0};
+	blk_stress s = {&ba, mem, 0, 0};
+
+	TL_PRINT("Take/return pairs of 1 to %d threads sharing one block allocator\n",
+	         STRESS_THREADS);
+	TL_PRINT("\tlocked:\n");
+	stress_scaling(stress_worker, &s, stress_reset, 80000, STRESS_HELD, "pairs");
+	s.lockfree = 1;
+	TL_PRINT("\tlock-free:\n");
+	stress_scaling(stress_worker, &s, stress_reset, 80000, STRESS_HELD, "pairs");
+	s.magazine = 1;
+	TL_PRINT("\tlock-free, magazines:\n");
+	stress_scaling(stress_worker, &s, stress_reset, 80000, STRESS_HELD, "pairs");
+}
+#endif /*TH_DISABLE_MUTEX*/
+
 int main(int argc, char **argv) {
 	(void)argc;
 	(void)argv;
 
 	TL(test_custom_struct(););
+	TL(test_aligned(););
+#ifndef TH_DISABLE_MUTEX
+	TL(test_lockfree(););
+	TL(test_threaded_stress(););
+	TL(test_contention_benchmark(););
+#endif /*TH_DISABLE_MUTEX*/
 	//TL(test_odd_block_size(););
 	//TL(alignment_test(););
 	tl_summary();
@@ -1,12 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "testlib.h"
+#include "../test_stress.h"
 
-#define TH_ALLOCATOR_IMPLEMENTATION
-//#define TH_NO_MUTEX
-#include "../th_allocator.h"
+#define ALLOCATOR_IMPLEMENTATION
+#define ALLOCATOR_VMREGION
+#define ALLOCATOR_STATS
+//#define TH_DISABLE_MUTEX
+#include "../allocator.h"
 
 typedef struct {
 	int x;
@@ -39,13 +46,13 @@ th_allocator_debug(dynallocator* _da, FILE* _out)
 	if (_da == NULL || _out == NULL)
 		return;
 
-	fprintf(_out,"(memsize=%d, start=%p, aloc_curr=%d, aloc_tot=%d)\n",
-	              _da->region.len, _da->region.mem,
+	fprintf(_out,"(memsize=%lu, start=%p, aloc_curr=%d, aloc_tot=%d)\n",
+	              (unsigned long)_da->region.len, _da->region.mem,
 	              _da->bookkeeper.curr,
                   _da->bookkeeper.total);
 
 	p = _da->first;
-	ph = _TH_ALLOCATOR_DATA2HEADER(p);
+	ph = _ALLOCATOR_DATA2HEADER(p);
 	while (p != NULL) {
        
 		fprintf(_out, "\t[%d] (size=%d, aligned=%s%s, S=%ld, E=%ld, N=%ld)\n",
@@ -55,9 +62,9 @@ th_allocator_debug(dynallocator* _da, FILE* _out)
                (_TH_IS_ALIGNED((unsigned long)p)) ? "Y": "N",
 		       (uint8_t*)ph - _da->region.mem,
 		       (uint8_t*)p + ph->size - _da->region.mem,
-		       (uint8_t*)_TH_ALLOCATOR_DATA2HEADER(ph->next) - _da->region.mem);
+		       (uint8_t*)_ALLOCATOR_DATA2HEADER(ph->next) - _da->region.mem);
 		p = ph->next;
-		ph = _TH_ALLOCATOR_DATA2HEADER(p);
+		ph = _ALLOCATOR_DATA2HEADER(p);
         i++;
 	}
 }
@@ -65,7 +72,7 @@ th_allocator_debug(dynallocator* _da, FILE* _out)
 void
 test_init_destroy(void)
 {
-    uint8_t memory[TH_MB_2_B(2)] = {0};
+    uint8_t memory[ALC_MB_2_B(2)] = {0};
 	dynallocator da = {0};
 	dynalc_init(&da, region(memory, sizeof(memory)));
 
@@ -81,7 +88,7 @@ void
 test_first_fit_first_allocation(void)
 {
 	v2* p = NULL;
-    uint8_t memory[TH_MB_2_B(2)] = {0};
+    uint8_t memory[ALC_MB_2_B(2)] = {0};
 	dynallocator da = {0};
 	dynalc_init(&da, region(memory, sizeof(memory)));
 
@@ -91,8 +98,8 @@ test_first_fit_first_allocation(void)
 	p->y = 5;
 	v2_print(p);
 	TL_TEST(da.first != NULL && da.first == (uint8_t*)p);
-	TL_TEST(_TH_ALLOCATOR_DATA2HEADER(p)->next == NULL);
-	TL_TEST(_TH_ALLOCATOR_DATA2HEADER(p)->size == sizeof(v2));
+	TL_TEST(_ALLOCATOR_DATA2HEADER(p)->next == NULL);
+	TL_TEST(_ALLOCATOR_DATA2HEADER(p)->size == sizeof(v2));
 
 	TL_TEST(da.first == (uint8_t*)p);
 	TL_TEST(da.bookkeeper.curr == 1);
@@ -109,7 +116,7 @@ test_first_fit_consecutive_allocations(void)
 {
 	unsigned int N = 8;
 
-    uint8_t memory[TH_MB_2_B(2)] = {0};
+    uint8_t memory[ALC_MB_2_B(2)] = {0};
 	dynallocator da = {0};
 	dynalc_init(&da, region(memory, sizeof(memory)));
 
@@ -146,7 +153,7 @@ test_first_fit_freeing_of_allocations_first_last(void)
 	const unsigned int N = 4;
 	unsigned int i;
 
-    uint8_t memory[TH_MB_2_B(2)] = {0};
+    uint8_t memory[ALC_MB_2_B(2)] = {0};
 	dynallocator da = {0};
 	dynalc_init(&da, region(memory, sizeof(memory)));
 
@@ -165,7 +172,7 @@ test_first_fit_freeing_of_allocations_first_last(void)
 
 	dynalc_free(&da, p[N-1]);
 	if (p[N-2] != NULL)
-		TL_TESTM(_TH_ALLOCATOR_DATA2HEADER(p[N-2])->next == NULL, "last allocation is removed from chain");
+		TL_TESTM(_ALLOCATOR_DATA2HEADER(p[N-2])->next == NULL, "last allocation is removed from chain");
 	TL_TEST(da.bookkeeper.curr == N - 2);
 	th_allocator_debug(&da, stdout);
 	dynalc_free_all(&da);
@@ -178,7 +185,7 @@ test_first_fit_freeing_of_allocations_inside_chain(void)
 	int i;
 	uint32_t allocs = 0;
 
-    uint8_t memory[TH_MB_2_B(2)] = {0};
+    uint8_t memory[ALC_MB_2_B(2)] = {0};
 	dynallocator da = {0};
 	dynalc_init(&da, region(memory, sizeof(memory)));
     
@@ -194,12 +201,12 @@ test_first_fit_freeing_of_allocations_inside_chain(void)
 	th_allocator_debug(&da, stdout);
 
 	dynalc_free(&da, p[1]);
-	TL_TESTM(_TH_ALLOCATOR_DATA2HEADER(p[0])->next == (uint8_t*)p[2], "sucessfully removed allocation 2");
+	TL_TESTM(_ALLOCATOR_DATA2HEADER(p[0])->next == (uint8_t*)p[2], "sucessfully removed allocation 2");
 	TL_TEST(da.bookkeeper.curr == allocs - 1);
 	th_allocator_debug(&da, stdout);
 
 	dynalc_free(&da, p[2]);
-	TL_TESTM(_TH_ALLOCATOR_DATA2HEADER(p[0])->next == (uint8_t*)p[3], "sucessfully removed allocation 3");
+	TL_TESTM(_ALLOCATOR_DATA2HEADER(p[0])->next == (uint8_t*)p[3], "sucessfully removed allocation 3");
 
 	TL_TEST(da.bookkeeper.curr == allocs - 2);
 	th_allocator_debug(&da, stdout);
@@ -214,7 +221,7 @@ test_first_fit_allocation_after_free(void)
 	v2* p_new1 = NULL;
 	v2* p_new2 = NULL;
 
-    uint8_t memory[TH_MB_2_B(2)] = {0};
+    uint8_t memory[ALC_MB_2_B(2)] = {0};
 	dynallocator da = {0};
 	dynalc_init(&da, region(memory, sizeof(memory)));
 
@@ -250,6 +257,68 @@ test_first_fit_allocation_after_free(void)
 	dynalc_free_all(&da);
 }
 
+void
+test_first_fit_free_links(void)
+{
+	const int N = 4;
+	int i;
+	v2* p[N];
+    static uint8_t memory[ALC_KB_2_B(4)];
+	dynallocator da = {0};
+	dynalc_init(&da, region(memory, sizeof(memory)));
+
+	for (i = 0; i < N; i++)
+		p[i] = dynalc_malloc(&da, sizeof(v2));
+	TL_TEST(_ALLOCATOR_DATA2HEADER(p[0])->prev == 0);
+	TL_TEST(memory + _ALLOCATOR_DATA2HEADER(p[2])->prev == (uint8_t*)p[1]);
+
+	dynalc_free(&da, p[N-1]);
+	TL_TESTM(da.last == (uint8_t*)p[N-2], "freeing the last entry moves last");
+	dynalc_free(&da, p[1]);
+	TL_TEST(memory + _ALLOCATOR_DATA2HEADER(p[2])->prev == (uint8_t*)p[0]);
+	TL_TEST(da.bookkeeper.curr == (uint32_t)N - 2);
+
+	dynalc_free(&da, p[1]);
+	TL_TESTM(da.bookkeeper.curr == (uint32_t)N - 2, "double free is ignored");
+	dynalc_free(&da, (uint8_t*)p[2] + 8);
+	TL_TESTM(da.bookkeeper.curr == (uint32_t)N - 2, "pointers inside an entry are ignored");
+
+	dynalc_free(&da, p[0]);
+	dynalc_free(&da, p[2]);
+	TL_TEST(da.first == NULL && da.last == NULL);
+	TL_TEST(da.bookkeeper.curr == 0);
+}
+
+void
+test_first_fit_padded_gaps(void)
+{
+	static uint8_t memory[ALC_KB_2_B(4)];
+	dynallocator da = {0};
+	uint8_t* a;
+	uint8_t* b;
+	uint8_t* c;
+	uint8_t* fit;
+	int gap;
+	dynalc_init(&da, region(memory, sizeof(memory)));
+
+	/*Odd sizes leave padding in front of every header*/
+	a = (uint8_t*)dynalc_malloc(&da, 3);
+	b = (uint8_t*)dynalc_malloc(&da, 40);
+	c = (uint8_t*)dynalc_malloc(&da, 3);
+	dynalc_free(&da, b);
+
+	/*Fits the gap only if the header padding is ignored*/
+	gap = (uint8_t*)_ALLOCATOR_DATA2HEADER(c) - (a + 3) - sizeof(_dynalc_header);
+	fit = (uint8_t*)dynalc_malloc(&da, gap);
+	TL_TEST(fit != NULL);
+	TL_TESTM(fit > c || fit + gap <= (uint8_t*)_ALLOCATOR_DATA2HEADER(c),
+	         "entries in a gap stop before the next header");
+	TL_TEST(_ALLOCATOR_DATA2HEADER(c)->size == 3);
+	TL_TEST(_ALLOCATOR_DATA2HEADER(c)->next == ((fit > c) ? fit : NULL));
+	TL_TEST(da.bookkeeper.curr == 3);
+	dynalc_free_all(&da);
+}
+
 void
 test_first_fit_max_allocations(void)
 {
@@ -269,15 +338,165 @@ test_first_fit_max_allocations(void)
 	}
 	TL_PRINT("size of entry = %d\n", entrysize);
     printf("used memory = %d\n", correct * entrysize);
-    printf("allocator memory size = %d\n", da.region.len);
+    printf("allocator memory size = %lu\n", (unsigned long)da.region.len);
     printf("correct allocations=%d\n", correct);
 	TL_TESTM(correct == 8, "Check if all allocations were successful.");
 	TL_TESTM(p[8] == NULL || p[9] == NULL, "No allocations occours when allocator is full");
+	TL_TESTM(da.bookkeeper.curr == 8, "failed allocations are not counted");
 	th_allocator_debug(&da, stdout);
 
 	dynalc_free_all(&da);
 }
 
+void
+test_tlsf_malloc_free(void)
+{
+	const int N = 100;
+	int i, k;
+	int intact = 0;
+	int aligned = 0;
+	uint8_t* p[N];
+	int sizes[N];
+	static uint8_t memory[ALC_KB_2_B(64)];
+	dynallocator da = {0};
+
+	TL_TEST(dynalc_init_tlsf(&da, region(memory, 1024)) == ALLOCATOR_INVALID_REGION);
+	TL_TEST(dynalc_init_tlsf(&da, region(memory, sizeof(memory))) == ALLOCATOR_OK);
+	TL_TEST(da.tlsf != NULL);
+
+	for (i = 0; i < N; i++) {
+		sizes[i] = 1 + (i * 37) % 300;
+		p[i] = dynalc_malloc(&da, sizes[i]);
+		if (p[i] == NULL)
+			continue;
+		memset(p[i], i, sizes[i]);
+		aligned += _TH_IS_ALIGNED((unsigned long)p[i]);
+	}
+	TL_TEST(aligned == N);
+	TL_TEST(da.bookkeeper.curr == (uint32_t)N);
+	TL_TEST(_ALLOCATOR_DATA2HEADER(p[1])->size >= (uint32_t)sizes[1]);
+
+	/*Free every other allocation, the rest must be untouched*/
+	for (i = 0; i < N; i += 2)
+		dynalc_free(&da, p[i]);
+	for (i = 0; i < N; i += 2)
+		p[i] = dynalc_malloc(&da, sizes[i]);
+	for (i = 0; i < N; i++) {
+		if (i % 2 == 0) {
+			intact += p[i] != NULL;
+			continue;
+		}
+		for (k = 0; k < sizes[i] && p[i][k] == i; k++)
+			;
+		intact += k == sizes[i];
+	}
+	TL_TEST(intact == N);
+
+	/*Freeing coalesces, so the whole region is available again*/
+	for (i = 0; i < N; i++)
+		dynalc_free(&da, p[i]);
+	TL_TEST(da.bookkeeper.curr == 0);
+	dynalc_free(&da, p[0]);
+	TL_TESTM(da.bookkeeper.curr == 0, "double free is ignored");
+	p[0] = dynalc_malloc(&da, ALC_KB_2_B(56));
+	TL_TEST(p[0] != NULL);
+	TL_TEST(dynalc_malloc(&da, ALC_KB_2_B(16)) == NULL);
+	dynalc_free_all(&da);
+	TL_TEST(dynalc_malloc(&da, ALC_KB_2_B(56)) != NULL);
+}
+
+void
+test_tlsf_max_allocations(void)
+{
+	int first = 0;
+	int again = 0;
+	v2* p[512];
+	static uint8_t memory[ALC_KB_2_B(8)];
+	dynallocator da = {0};
+	dynalc_init_tlsf(&da, region(memory, sizeof(memory)));
+
+	while (first < 512 && (p[first] = dynalc_malloc(&da, sizeof(v2))) != NULL)
+		first++;
+	TL_TEST(first > 0 && first < 512);
+	dynalc_free_all(&da);
+	TL_TEST(da.bookkeeper.curr == 0);
+	while (again < 512 && (p[again] = dynalc_malloc(&da, sizeof(v2))) != NULL)
+		again++;
+	TL_TESTM(again == first, "free_all gives back the whole region");
+}
+
+char
+bytes_are(uint8_t* _p, int _n, uint8_t _v)
+{
+	int i;
+	for (i = 0; i < _n; i++)
+		if (_p[i] != _v)
+			return 0;
+	return 1;
+}
+
+void
+test_realloc(dynallocator* _da)
+{
+	uint8_t* a;
+	uint8_t* b;
+	uint8_t* c;
+	uint8_t* r;
+
+	a = dynalc_realloc(_da, NULL, 64);
+	b = dynalc_malloc(_da, 64);
+	c = dynalc_malloc(_da, 64);
+	TL_TEST(a != NULL && b != NULL && c != NULL);
+	memset(a, 1, 64);
+	memset(b, 2, 64);
+	memset(c, 3, 64);
+
+	/*Shrink and grow back without moving*/
+	TL_TEST(dynalc_realloc(_da, b, 16) == b);
+	TL_TEST(dynalc_realloc(_da, b, 64) == b);
+	TL_TEST(bytes_are(b, 16, 2));
+
+	/*Grow into the space of a freed neighbour*/
+	dynalc_free(_da, b);
+	r = dynalc_realloc(_da, a, 128);
+	TL_TESTM(r == a, "grown in place");
+	TL_TEST(bytes_are(a, 64, 1));
+	TL_TEST(bytes_are(c, 64, 3));
+
+	/*Blocked by c, so the entry moves and keeps its data*/
+	r = dynalc_realloc(_da, a, 1024);
+	TL_TESTM(r != NULL && r != a, "moved");
+	TL_TEST(bytes_are(r, 64, 1));
+	TL_TEST(_da->bookkeeper.curr == 2);
+
+	TL_TEST(dynalc_realloc(_da, a, 16) == NULL);
+	TL_TESTM(_da->bookkeeper.curr == 2, "freed entries are not resized");
+	TL_TEST(dynalc_realloc(_da, r, 0) == NULL);
+	TL_TEST(dynalc_realloc(_da, c, ALC_MB_2_B(2)) == NULL);
+	TL_TEST(bytes_are(c, 64, 3));
+	dynalc_free(_da, c);
+	TL_TEST(_da->bookkeeper.curr == 0);
+}
+
+void
+test_realloc_first_fit(void)
+{
+	static uint8_t memory[ALC_KB_2_B(16)];
+	dynallocator da = {0};
+	dynalc_init(&da, region(memory, sizeof(memory)));
+	test_realloc(&da);
+	TL_TEST(da.first == NULL);
+}
+
+void
+test_realloc_tlsf(void)
+{
+	static uint8_t memory[ALC_KB_2_B(16)];
+	dynallocator da = {0};
+	dynalc_init_tlsf(&da, region(memory, sizeof(memory)));
+	test_realloc(&da);
+}
+
 void
 test_fragmentation(int iterations, int _min, int _max)
 {
@@ -314,7 +533,7 @@ test_fragmentation(int iterations, int _min, int _max)
 		if (p_da[access] == NULL) {
 			p_da[access] = dynalc_malloc(&allocator, mem); 
 		} else {
-			p_da[access] = dynalc_free(&allocator, p_da); 
+			p_da[access] = dynalc_free(&allocator, p_da[access]);
 		}
 		tl_timer_stop(&timer_da);
 		/*malloc*/
@@ -354,6 +573,471 @@ test_fragmentation_tests(void)
 	test_fragmentation(1000000, 10000, 100000);
 }
 
+/*Multithreaded tests, every thread holds a few allocations of random size at
+  a time and checks that no other thread wrote to them while they were held*/
+#define STRESS_HELD 8
+#define STRESS_MIN 16
+#define STRESS_MAX 256
+
+void*
+stress_worker(void* _arg)
+{
+	stress_arg* a = (stress_arg*)_arg;
+	dynallocator* da = (dynallocator*)a->alc;
+	uint8_t* held[STRESS_HELD];
+	int sizes[STRESS_HELD];
+	/*testlib random is not thread safe, so every thread has its own*/
+	uint32_t seed = a->id * 2654435761u;
+	int i, j, k;
+
+	for (i = 0; i < a->rounds; i++) {
+		for (j = 0; j < STRESS_HELD; j++) {
+			seed = seed * 1664525u + 1013904223u;
+			sizes[j] = STRESS_MIN + (seed >> 8) % (STRESS_MAX - STRESS_MIN);
+			held[j] = dynalc_malloc(da, sizes[j]);
+			if (held[j] == NULL) {
+				a->failed++;
+				continue;
+			}
+			memset(held[j], a->id, sizes[j]);
+		}
+		for (j = 0; j < STRESS_HELD; j++) {
+			if (held[j] == NULL)
+				continue;
+			for (k = 0; k < sizes[j]; k++)
+				if (held[j][k] != a->id) {
+					a->corrupt++;
+					break;
+				}
+			dynalc_free(da, held[j]);
+		}
+	}
+	return NULL;
+}
+
+static uint8_t stress_memory[ALC_MB_2_B(1)];
+
+void
+stress_reset(void* _alc)
+{
+	dynalc_init((dynallocator*)_alc, region(stress_memory, sizeof(stress_memory)));
+}
+
+void
+test_threaded_stress(void)
+{
+	const int rounds = 5000;
+	dynallocator da = {0};
+	int corrupt;
+	int failed;
+
+	dynalc_init(&da, region(stress_memory, sizeof(stress_memory)));
+	stress_run(stress_worker, &da, STRESS_THREADS, rounds, &corrupt, &failed);
+	TL_TEST(corrupt == 0);
+	TL_TEST(failed == 0);
+	TL_TEST(da.bookkeeper.curr == 0);
+	TL_TEST(da.bookkeeper.total == (uint32_t)(STRESS_THREADS * STRESS_HELD * rounds));
+	TL_TEST(da.first == NULL);
+
+	dynalc_init_tlsf(&da, region(stress_memory, sizeof(stress_memory)));
+	stress_run(stress_worker, &da, STRESS_THREADS, rounds, &corrupt, &failed);
+	TL_TEST(corrupt == 0);
+	TL_TEST(failed == 0);
+	TL_TEST(da.bookkeeper.curr == 0);
+}
+
+void
+test_contention_benchmark(void)
+{
+	dynallocator da = {0};
+
+	TL_PRINT("malloc/free pairs of %d threads sharing one dynamic allocator\n",
+	         STRESS_THREADS);
+	stress_scaling(stress_worker, &da, stress_reset, 40000, STRESS_HELD, "pairs");
+}
+
+/*Churn of small allocations, a random slot is allocated if empty and freed
+  otherwise. Reports total time and the slowest single call*/
+typedef struct {
+	double total;
+	double worst;
+	int failed;
+}churn_result;
+
+churn_result
+churn(dynallocator* _da, int _iterations, int _slots, int _min, int _max)
+{
+	churn_result r = {0, 0, 0};
+	void** p = (void**)calloc(_slots, sizeof(void*));
+	double start;
+	double t;
+	int access;
+	int i;
+
+	tl_rand_seed(1234);
+	for (i = 0; i < _iterations; i++) {
+		access = tl_rand_ubetween(0, _slots - 1);
+		start = wall_sec();
+		if (p[access] == NULL) {
+			if (_da != NULL)
+				p[access] = dynalc_malloc(_da, tl_rand_ubetween(_min, _max));
+			else
+				p[access] = malloc(tl_rand_ubetween(_min, _max));
+			r.failed += p[access] == NULL;
+		} else {
+			if (_da != NULL)
+				dynalc_free(_da, p[access]);
+			else
+				free(p[access]);
+			p[access] = NULL;
+		}
+		t = wall_sec() - start;
+		r.total += t;
+		if (t > r.worst)
+			r.worst = t;
+	}
+	for (i = 0; i < _slots; i++)
+		if (_da == NULL)
+			free(p[i]);
+	free(p);
+	return r;
+}
+
+void
+test_tlsf_benchmark(void)
+{
+	const int iterations = 200000;
+	const int slots = 2000;
+	uint8_t* memory = (uint8_t*)malloc(ALC_MB_2_B(4));
+	dynallocator da = {0};
+	churn_result ff;
+	churn_result tlsf;
+	churn_result ma;
+
+	dynalc_init(&da, region(memory, ALC_MB_2_B(4)));
+	ff = churn(&da, iterations, slots, 16, 512);
+	dynalc_init_tlsf(&da, region(memory, ALC_MB_2_B(4)));
+	tlsf = churn(&da, iterations, slots, 16, 512);
+	ma = churn(NULL, iterations, slots, 16, 512);
+	free(memory);
+
+	TL_PRINT("Churn of %d calls over %d slots, sizes 16-512:\n", iterations, slots);
+	TL_PRINT("\tFirst fit: %lfs, worst call %.2lfus\n", ff.total, ff.worst * 1e6);
+	TL_PRINT("\tTLSF:      %lfs, worst call %.2lfus\n", tlsf.total, tlsf.worst * 1e6);
+	TL_PRINT("\tmalloc():  %lfs, worst call %.2lfus\n", ma.total, ma.worst * 1e6);
+	TL_TEST(ff.failed == 0 && tlsf.failed == 0);
+}
+
+void
+test_free_random_order_benchmark(void)
+{
+	const int N = 100000;
+	const int size = 32;
+	const uint32_t memsize = N * (_TH_ALIGN(size) + sizeof(_dynalc_header)) + ALC_KB_2_B(8);
+	uint8_t* memory = (uint8_t*)malloc(memsize);
+	void** p = (void**)malloc(N * sizeof(void*));
+	int* order = (int*)malloc(N * sizeof(int));
+	tl_timer_s timer_ff = {0};
+	tl_timer_s timer_tlsf = {0};
+	tl_timer_s timer_malloc = {0};
+	dynallocator da = {0};
+	int allocated;
+	int i, j, tmp;
+
+	/*Shuffled free order*/
+	tl_rand_seed(4321);
+	for (i = 0; i < N; i++)
+		order[i] = i;
+	for (i = N - 1; i > 0; i--) {
+		j = tl_rand_ubetween(0, i);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	dynalc_init(&da, region(memory, memsize));
+	for (allocated = 0, i = 0; i < N; i++)
+		allocated += (p[i] = dynalc_malloc(&da, size)) != NULL;
+	TL_TEST(allocated == N);
+	tl_timer_start(&timer_ff);
+	for (i = 0; i < N; i++)
+		dynalc_free(&da, p[order[i]]);
+	tl_timer_stop(&timer_ff);
+	TL_TEST(da.bookkeeper.curr == 0);
+	TL_TEST(da.first == NULL && da.last == NULL);
+
+	dynalc_init_tlsf(&da, region(memory, memsize));
+	for (allocated = 0, i = 0; i < N; i++)
+		allocated += (p[i] = dynalc_malloc(&da, size)) != NULL;
+	TL_TEST(allocated == N);
+	tl_timer_start(&timer_tlsf);
+	for (i = 0; i < N; i++)
+		dynalc_free(&da, p[order[i]]);
+	tl_timer_stop(&timer_tlsf);
+	TL_TEST(da.bookkeeper.curr == 0);
+
+	for (i = 0; i < N; i++)
+		p[i] = malloc(size);
+	tl_timer_start(&timer_malloc);
+	for (i = 0; i < N; i++)
+		free(p[order[i]]);
+	tl_timer_stop(&timer_malloc);
+
+	TL_PRINT("Freeing %d blocks of size %d in random order:\n", N, size);
+	TL_PRINT("\tFirst fit: %lfs\n", timer_ff.elapsed_sec);
+	TL_PRINT("\tTLSF:      %lfs\n", timer_tlsf.elapsed_sec);
+	TL_PRINT("\tfree():    %lfs\n", timer_malloc.elapsed_sec);
+	free(order);
+	free(p);
+	free(memory);
+}
+
+void
+test_realloc_benchmark(void)
+{
+	const int steps = 4096;
+	const int step = 64;
+	uint32_t memsize = ALC_MB_2_B(2);
+	uint8_t* memory = (uint8_t*)malloc(memsize);
+	tl_timer_s timer_realloc = {0};
+	tl_timer_s timer_copy = {0};
+	tl_timer_s timer_malloc = {0};
+	dynallocator da = {0};
+	uint8_t* p = NULL;
+	uint8_t* q = NULL;
+	uint8_t* other[64];
+	int moved = 0;
+	int i;
+
+	/*A growing buffer between other allocations, like a dynamic array*/
+	dynalc_init_tlsf(&da, region(memory, memsize));
+	tl_timer_start(&timer_realloc);
+	for (i = 1; i <= steps; i++) {
+		q = dynalc_realloc(&da, p, i * step);
+		moved += q != p;
+		p = q;
+		if (i % 64 == 0)
+			other[i / 64 - 1] = dynalc_malloc(&da, 32);
+	}
+	tl_timer_stop(&timer_realloc);
+	TL_TEST(p != NULL);
+
+	dynalc_init_tlsf(&da, region(memory, memsize));
+	p = NULL;
+	tl_timer_start(&timer_copy);
+	for (i = 1; i <= steps; i++) {
+		q = dynalc_malloc(&da, i * step);
+		if (p != NULL) {
+			memcpy(q, p, (i - 1) * step);
+			dynalc_free(&da, p);
+		}
+		p = q;
+		if (i % 64 == 0)
+			other[i / 64 - 1] = dynalc_malloc(&da, 32);
+	}
+	tl_timer_stop(&timer_copy);
+	TL_TEST(p != NULL);
+
+	p = NULL;
+	tl_timer_start(&timer_malloc);
+	for (i = 1; i <= steps; i++) {
+		p = realloc(p, i * step);
+		if (i % 64 == 0)
+			other[i / 64 - 1] = malloc(32);
+	}
+	tl_timer_stop(&timer_malloc);
+	free(p);
+	for (i = 0; i < 64; i++)
+		free(other[i]);
+	free(memory);
+
+	TL_PRINT("Growing a buffer to %d bytes in steps of %d:\n", steps * step, step);
+	TL_PRINT("\tdynalc_realloc():  %lfs, moved %d times\n", timer_realloc.elapsed_sec, moved);
+	TL_PRINT("\tmalloc/copy/free:  %lfs\n", timer_copy.elapsed_sec);
+	TL_PRINT("\trealloc():         %lfs\n", timer_malloc.elapsed_sec);
+	TL_TEST(moved < steps / 2);
+}
+
+void
+test_aligned(dynallocator* _da)
+{
+	uint8_t* p[32];
+	uint32_t align;
+	int i;
+
+	TL_TEST(dynalc_malloc_aligned(_da, 16, 24) == NULL);
+	for (i = 0; i < 32; i++) {
+		align = 1u << (i % 9);
+		p[i] = (uint8_t*)dynalc_malloc_aligned(_da, 8 + i * 5, align);
+		TL_TEST(p[i] != NULL && (unsigned long)p[i] % align == 0);
+		memset(p[i], i, 8 + i * 5);
+	}
+	for (i = 0; i < 32; i += 2)
+		dynalc_free(_da, p[i]);
+	/*Gaps left by freed entries are reused with the new alignment*/
+	for (i = 0; i < 32; i += 2) {
+		p[i] = (uint8_t*)dynalc_malloc_aligned(_da, 8 + i * 5, 64);
+		TL_TEST(p[i] != NULL && (unsigned long)p[i] % 64 == 0);
+		memset(p[i], i, 8 + i * 5);
+	}
+	for (i = 0; i < 32; i++)
+		TL_TEST(bytes_are(p[i], 8 + i * 5, i));
+	TL_TEST(dynalc_realloc(_da, p[31], 8) == p[31]);
+	/*Moving keeps the alignment, a larger one moves the entry*/
+	TL_TEST(dynalc_realloc_aligned(_da, p[30], 200, 24) == NULL);
+	p[30] = (uint8_t*)dynalc_realloc_aligned(_da, p[30], 2000, 256);
+	TL_TEST(p[30] != NULL && (unsigned long)p[30] % 256 == 0);
+	TL_TEST(bytes_are(p[30], 8 + 30 * 5, 30));
+	p[29] = (uint8_t*)dynalc_realloc_aligned(_da, p[29], 8 + 29 * 5, 512);
+	TL_TEST(p[29] != NULL && (unsigned long)p[29] % 512 == 0);
+	TL_TEST(bytes_are(p[29], 8 + 29 * 5, 29));
+	for (i = 0; i < 32; i++)
+		dynalc_free(_da, p[i]);
+	TL_TEST(_da->bookkeeper.curr == 0);
+}
+
+void
+test_aligned_first_fit(void)
+{
+	static uint8_t memory[ALC_KB_2_B(16)];
+	dynallocator da = {0};
+	dynalc_init(&da, region(memory, sizeof(memory)));
+	test_aligned(&da);
+	TL_TEST(da.first == NULL);
+}
+
+void
+test_aligned_tlsf(void)
+{
+	static uint8_t memory[ALC_KB_2_B(16)];
+	dynallocator da = {0};
+	uint8_t* whole;
+	dynalc_init_tlsf(&da, region(memory, sizeof(memory)));
+	test_aligned(&da);
+	/*Leading gaps went back to the free lists and merged*/
+	whole = (uint8_t*)dynalc_malloc(&da, ALC_KB_2_B(12));
+	TL_TEST(whole != NULL);
+	dynalc_free(&da, whole);
+}
+
+#ifdef ALLOCATOR_STATS
+void
+test_stats(dynallocator* _da)
+{
+	const uint32_t peak = 4 * (100 + 1000 + 10);
+	uint8_t* a[4];
+	uint8_t* b[4];
+	uint8_t* c[4];
+	alc_fragmentation f;
+	uint32_t sum = 0;
+	int i;
+
+	f = dynalc_fragmentation(_da);
+	TL_TESTM(f.ratio == 0.0 && f.free_bytes == f.largest_free, "empty region is one gap");
+	for (i = 0; i < 4; i++) {
+		a[i] = (uint8_t*)dynalc_malloc(_da, 100);
+		b[i] = (uint8_t*)dynalc_malloc(_da, 1000);
+		c[i] = (uint8_t*)dynalc_malloc(_da, 10);
+	}
+	TL_TEST(_da->bookkeeper.bytes >= peak);
+	TL_TEST(_da->bookkeeper.bytes_peak == _da->bookkeeper.bytes);
+	TL_TEST(_da->bookkeeper.sizes[6] == 4 && _da->bookkeeper.sizes[9] == 4 &&
+	        _da->bookkeeper.sizes[3] == 4);
+	for (i = 0; i < ALC_STATS_BUCKETS; i++)
+		sum += _da->bookkeeper.alloc_cycles[i];
+	TL_TEST(sum == 12);
+
+	/*Holes between live entries fragment the free space*/
+	for (i = 0; i < 4; i++)
+		dynalc_free(_da, b[i]);
+	f = dynalc_fragmentation(_da);
+	TL_TEST(f.ratio > 0.0 && f.ratio < 1.0);
+	TL_TEST(f.largest_free < f.free_bytes);
+	TL_TEST(_da->bookkeeper.bytes < _da->bookkeeper.bytes_peak);
+	dynalc_stats_dump(stdout, _da);
+
+	for (i = 0; i < 4; i++) {
+		dynalc_free(_da, a[i]);
+		dynalc_free(_da, c[i]);
+	}
+	TL_TEST(_da->bookkeeper.bytes == 0);
+	TL_TEST(_da->bookkeeper.bytes_peak >= peak);
+	TL_TEST(_da->bookkeeper.total == 12);
+	f = dynalc_fragmentation(_da);
+	TL_TESTM(f.ratio == 0.0, "freed entries merge back into one gap");
+	sum = 0;
+	for (i = 0; i < ALC_STATS_BUCKETS; i++)
+		sum += _da->bookkeeper.free_cycles[i];
+	TL_TEST(sum == 12);
+}
+
+void
+test_stats_first_fit(void)
+{
+	static uint8_t memory[ALC_KB_2_B(16)];
+	dynallocator da = {0};
+	dynalc_init(&da, region(memory, sizeof(memory)));
+	test_stats(&da);
+}
+
+void
+test_stats_tlsf(void)
+{
+	static uint8_t memory[ALC_KB_2_B(16)];
+	dynallocator da = {0};
+	dynalc_init_tlsf(&da, region(memory, sizeof(memory)));
+	test_stats(&da);
+}
+#endif /*ALLOCATOR_STATS*/
+
+#ifdef _ALLOCATOR_VMREGION
+void
+test_vmregion(void)
+{
+	vmregion vm = {0};
+	dynallocator da = {0};
+	uint8_t* p[64];
+	uint64_t committed;
+	int i;
+
+	/*Entry headers limit the dynamic allocator to 4 GB*/
+	vmregion_reserve(&vm, 5ull * 1024 * 1024 * 1024);
+	TL_TEST(dynalc_init(&da, vmregion_region(&vm)) == ALLOCATOR_INVALID_REGION);
+	vmregion_release(&vm);
+
+	TL_TEST(vmregion_reserve(&vm, ALC_MB_2_B(64)) == ALLOCATOR_OK);
+	TL_TEST(dynalc_init(&da, vmregion_region(&vm)) == ALLOCATOR_OK);
+	TL_TEST(vm.committed == 0);
+	for (i = 0; i < 64; i++) {
+		p[i] = (uint8_t*)dynalc_malloc(&da, ALC_KB_2_B(16));
+		TL_TEST(p[i] != NULL);
+		memset(p[i], i, ALC_KB_2_B(16));
+	}
+	TL_TESTM(vm.committed < ALC_MB_2_B(2), "the chain commits as it grows");
+
+	/*Freed gaps are reused without committing more*/
+	committed = vm.committed;
+	dynalc_free(&da, p[10]);
+	TL_TEST(dynalc_malloc(&da, ALC_KB_2_B(8)) == p[10]);
+	TL_TEST(vm.committed == committed);
+	TL_TEST(dynalc_realloc(&da, p[63], ALC_MB_2_B(1)) == p[63]);
+	TL_TEST(vm.committed > committed);
+	memset(p[63], 1, ALC_MB_2_B(1));
+
+	dynalc_free_all(&da);
+	TL_TEST(vm.committed == VMREGION_COMMIT_STEP);
+	TL_TEST(dynalc_malloc(&da, ALC_MB_2_B(64)) == NULL);
+
+	/*TLSF mode commits the region up front*/
+	TL_TEST(dynalc_init_tlsf(&da, vmregion_region(&vm)) == ALLOCATOR_OK);
+	TL_TEST(vm.committed == vm.reserved);
+	p[0] = (uint8_t*)dynalc_malloc(&da, ALC_MB_2_B(32));
+	TL_TEST(p[0] != NULL);
+	memset(p[0], 1, ALC_MB_2_B(32));
+	vmregion_release(&vm);
+}
+#endif /*_ALLOCATOR_VMREGION*/
+
 int main(int argc, char **argv) {
 	(void)argc;
 	(void)argv;
@@ -364,9 +1048,31 @@ int main(int argc, char **argv) {
     TL(test_first_fit_freeing_of_allocations_first_last(););
     TL(test_first_fit_freeing_of_allocations_inside_chain(););
     TL(test_first_fit_allocation_after_free(););
+    TL(test_first_fit_free_links(););
+    TL(test_first_fit_padded_gaps(););
     TL(test_first_fit_max_allocations(););
+    TL(test_tlsf_malloc_free(););
+    TL(test_tlsf_max_allocations(););
+    TL(test_realloc_first_fit(););
+    TL(test_realloc_tlsf(););
+    TL(test_aligned_first_fit(););
+    TL(test_aligned_tlsf(););
+#ifdef ALLOCATOR_STATS
+    TL(test_stats_first_fit(););
+    TL(test_stats_tlsf(););
+#endif /*ALLOCATOR_STATS*/
+#ifdef _ALLOCATOR_VMREGION
+    TL(test_vmregion(););
+#endif /*_ALLOCATOR_VMREGION*/
 
     TL(test_fragmentation_tests(););
+    TL(test_tlsf_benchmark(););
+    TL(test_free_random_order_benchmark(););
+    TL(test_realloc_benchmark(););
+#ifndef TH_DISABLE_MUTEX
+    TL(test_threaded_stress(););
+    TL(test_contention_benchmark(););
+#endif /*TH_DISABLE_MUTEX*/
 
 	tl_summary();
 	return 0;
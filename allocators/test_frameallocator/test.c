@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "testlib.h"
+#define ALLOCATOR_IMPLEMENTATION
+#define ALLOCATOR_STATS
+#include "../allocator.h"
+
+#define memsize 4096
+#define scratch_size 1024
+
+char
+bytes_are(uint8_t* _p, int _n, uint8_t _v)
+{
+	int i;
+	for (i = 0; i < _n; i++)
+		if (_p[i] != _v)
+			return 0;
+	return 1;
+}
+
+void
+test_frame_lifetime(void)
+{
+	uint8_t memory[memsize] = {0};
+	frameallocator fa = {0};
+	uint8_t* a;
+	uint8_t* b;
+	uint8_t* c;
+
+	TL_TEST(framealc_init(&fa, region(NULL, memsize), region(NULL, 0)) == ALLOCATOR_INVALID_INPUT);
+	TL_TEST(framealc_init(&fa, region(memory, memsize), region(NULL, 0)) == ALLOCATOR_OK);
+	TL_TEST(framealc_alloc(&fa, 0) == NULL);
+
+	/*Frame 1*/
+	a = (uint8_t*)framealc_alloc(&fa, 100);
+	TL_TEST(a != NULL && (unsigned long)a % _TH_ALIGNMENT == 0);
+	memset(a, 1, 100);
+	b = (uint8_t*)framealc_alloc(&fa, 3);
+	c = (uint8_t*)framealc_alloc(&fa, 8);
+	TL_TEST(b != NULL && c != NULL && (unsigned long)c % _TH_ALIGNMENT == 0);
+	TL_TEST(framealc_frame_bytes(&fa) == (uint32_t)(c + 8 - memory));
+	framealc_swap(&fa);
+
+	/*Frame 2, frame 1 is still valid*/
+	TL_TEST(framealc_frame_bytes(&fa) == 0);
+	b = (uint8_t*)framealc_alloc(&fa, 100);
+	TL_TEST(b >= memory + memsize / 2 && b < memory + memsize);
+	memset(b, 2, 100);
+	TL_TEST(bytes_are(a, 100, 1));
+	framealc_swap(&fa);
+
+	/*Frame 3 reuses the memory of frame 1*/
+	c = (uint8_t*)framealc_alloc(&fa, 100);
+	TL_TESTM(c == a, "oldest frame was reset");
+	memset(c, 3, 100);
+	TL_TEST(bytes_are(b, 100, 2));
+
+	/*Full frames do not spill into each other*/
+	TL_TEST(framealc_alloc(&fa, memsize / 2) == NULL);
+	TL_TEST(framealc_alloc(&fa, memsize / 2 - 112) != NULL);
+	TL_TEST(bytes_are(b, 100, 2));
+}
+
+void
+test_overflow(void)
+{
+	uint8_t memory[256] = {0};
+	uint8_t scratch[scratch_size] = {0};
+	frameallocator fa = {0};
+	uint8_t* in_frame;
+	uint8_t* low;
+	uint8_t* high;
+
+	framealc_init(&fa, region(memory, sizeof(memory)), region(scratch, scratch_size));
+
+	/*Frame 0 overflows from the bottom of the scratch region*/
+	in_frame = (uint8_t*)framealc_alloc(&fa, 100);
+	low = (uint8_t*)framealc_alloc(&fa, 100);
+	TL_TEST(in_frame >= memory && in_frame < memory + sizeof(memory));
+	TL_TESTM(low == scratch, "overflow into scratch");
+	memset(low, 1, 100);
+	TL_TEST(framealc_frame_bytes(&fa) == 100 + 100);
+	TL_TEST(fa.scratch.bookkeeper.curr == 1 && fa.scratch.bookkeeper.bytes == 100);
+	framealc_swap(&fa);
+
+	/*Frame 1 overflows from the top and leaves frame 0 alone*/
+	framealc_alloc(&fa, 100);
+	high = (uint8_t*)framealc_alloc(&fa, 100);
+	TL_TEST(high != NULL && high > low + 100 && high + 100 <= scratch + scratch_size);
+	TL_TEST((unsigned long)high % _TH_ALIGNMENT == 0);
+	memset(high, 2, 100);
+	TL_TEST(bytes_are(low, 100, 1));
+	TL_TEST(framealc_alloc(&fa, scratch_size) == NULL);
+	TL_TEST(fa.scratch.bookkeeper.curr == 2);
+	framealc_swap(&fa);
+
+	/*Frame 0 again, only its own overflow was dropped*/
+	TL_TEST(fa.scratch.bookkeeper.curr == 1);
+	TL_TEST(fa.scratch.bookkeeper.bytes == scratch_size - fa.scratch.high);
+	TL_TEST(fa.scratch.bookkeeper.bytes_peak >= 200);
+	framealc_alloc(&fa, 100);
+	TL_TEST(framealc_alloc(&fa, 100) == low);
+	TL_TEST(bytes_are(high, 100, 2));
+
+	TL_TEST(fa.last_frame_bytes >= 200);
+	TL_TEST(fa.high_water == fa.last_frame_bytes);
+	TL_TEST(fa.overflow_frames == 2);
+	framealc_swap(&fa);
+	TL_TEST(fa.overflow_frames == 3);
+}
+
+void
+test_frame_benchmark(void)
+{
+	const int frames = 2000;
+	const int allocs = 500;
+	const int max_size = 128;
+	const uint32_t size = 2 * allocs * _TH_ALIGN(max_size);
+	uint8_t* memory = (uint8_t*)malloc(size);
+	void** ptrs = (void**)malloc(allocs * sizeof(void*));
+	tl_timer_s timer_frame = {0};
+	tl_timer_s timer_malloc = {0};
+	frameallocator fa = {0};
+	int failed = 0;
+	int i, j;
+
+	/*Temporaries that live for one frame, as in a game loop*/
+	framealc_init(&fa, region(memory, size), region(NULL, 0));
+	tl_timer_start(&timer_frame);
+	for (i = 0; i < frames; i++) {
+		for (j = 0; j < allocs; j++) {
+			ptrs[j] = framealc_alloc(&fa, 1 + (i + j) % max_size);
+			failed += ptrs[j] == NULL;
+		}
+		framealc_swap(&fa);
+	}
+	tl_timer_stop(&timer_frame);
+
+	tl_timer_start(&timer_malloc);
+	for (i = 0; i < frames; i++) {
+		for (j = 0; j < allocs; j++)
+			ptrs[j] = malloc(1 + (i + j) % max_size);
+		for (j = 0; j < allocs; j++)
+			free(ptrs[j]);
+	}
+	tl_timer_stop(&timer_malloc);
+
+	TL_PRINT("%d frames of %d temporary allocations:\n", frames, allocs);
+	TL_PRINT("\tframe allocator: %lfs, high water %u bytes\n",
+	         timer_frame.elapsed_sec, fa.high_water);
+	TL_PRINT("\tmalloc/free:     %lfs\n", timer_malloc.elapsed_sec);
+	TL_TEST(failed == 0);
+	TL_TEST(fa.high_water <= size / 2);
+	free(ptrs);
+	free(memory);
+}
+
+int main(int argc, char **argv) {
+	(void)argc;
+	(void)argv;
+	TL(test_frame_lifetime());
+	TL(test_overflow());
+	TL(test_frame_benchmark());
+
+	tl_summary();
+	return 0;
+}
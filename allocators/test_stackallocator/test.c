@@ -1,8 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
 #include "testlib.h"
-#define TH_ALLOCATOR_IMPLEMENTATION
-#include "../th_allocator.h"
+#include "../test_stress.h"
+#define ALLOCATOR_IMPLEMENTATION
+#define ALLOCATOR_VMREGION
+#include "../allocator.h"
 
 #define memsize 4096
 #define scratch_size 5000
@@ -104,11 +111,260 @@ void test_scratch_buffer(void)
     stackalc_reset(&sa);
 }
 
+void
+test_markers(void)
+{
+    uint8_t memory[memsize] = {0};
+	stackallocator sa = {0};
+	stack_marker outer;
+	stack_marker inner;
+	uint8_t* kept;
+	uint8_t* p;
+
+	stackalc_new(&sa, region(memory, memsize), NULL);
+	kept = (uint8_t*)stackalc_alloc(&sa, 10);
+	outer = stackalc_mark(&sa);
+	TL_TEST(outer.offset == sa.offset && outer.count == 1);
+	p = (uint8_t*)stackalc_alloc(&sa, 100);
+	inner = stackalc_mark(&sa);
+	stackalc_alloc(&sa, 200);
+
+	/*Release the inner scope only*/
+	TL_TEST(stackalc_rewind(&sa, inner) == ALLOCATOR_OK);
+	TL_TEST(sa.offset == inner.offset);
+	TL_TEST(sa.bookkeeper.curr == 2);
+	TL_TEST(stackalc_alloc(&sa, 1) != NULL);
+
+	/*The outer scope takes the inner one with it*/
+	TL_TEST(stackalc_rewind(&sa, outer) == ALLOCATOR_OK);
+	TL_TEST(sa.bookkeeper.curr == 1);
+	TL_TESTM(stackalc_alloc(&sa, 100) == p, "memory after marker is reused");
+	TL_TEST(kept == memory);
+	stackalc_rewind(&sa, outer);
+	TL_TESTM(stackalc_rewind(&sa, inner) == ALLOCATOR_INVALID_INPUT,
+	         "marker already rewound past");
+	TL_TEST(sa.offset == outer.offset);
+	stackalc_reset(&sa);
+	TL_TEST(sa.bookkeeper.curr == 0);
+}
+
+void
+test_double_ended(void)
+{
+    uint8_t memory[256] = {0};
+	dstackallocator dsa = {0};
+	stack_marker low;
+	stack_marker high;
+	uint8_t* a;
+	uint8_t* b;
+	uint8_t* c;
+
+	TL_TEST(dstackalc_new(&dsa, region(NULL, 256)) == ALLOCATOR_INVALID_INPUT);
+	TL_TEST(dstackalc_new(&dsa, region(memory, 256)) == ALLOCATOR_OK);
+
+	a = (uint8_t*)dstackalc_alloc(&dsa, DSTACK_LOW, 10);
+	b = (uint8_t*)dstackalc_alloc(&dsa, DSTACK_HIGH, 10);
+	TL_TEST(a == memory);
+	TL_TEST(b != NULL && b + 10 <= memory + 256 && b + 10 + _TH_ALIGNMENT > memory + 256);
+	TL_TEST((unsigned long)b % _TH_ALIGNMENT == 0);
+
+	/*Each end has its own scopes*/
+	low = dstackalc_mark(&dsa, DSTACK_LOW);
+	high = dstackalc_mark(&dsa, DSTACK_HIGH);
+	c = (uint8_t*)dstackalc_alloc(&dsa, DSTACK_LOW, 50);
+	TL_TEST(c != NULL && c > a && c + 50 <= b);
+	TL_TEST(dstackalc_alloc(&dsa, DSTACK_HIGH, 50) != NULL);
+	TL_TESTM(dstackalc_alloc(&dsa, DSTACK_HIGH, 150) == NULL, "ends do not cross");
+	TL_TEST(dsa.bookkeeper.curr == 4);
+	TL_TEST(dstackalc_rewind(&dsa, DSTACK_HIGH, high) == ALLOCATOR_OK);
+	TL_TEST(dsa.high == high.offset);
+	TL_TEST(dsa.low == (uint32_t)(c + 50 - memory));
+	TL_TEST(dsa.bookkeeper.curr == 3);
+	TL_TEST(dstackalc_rewind(&dsa, DSTACK_LOW, low) == ALLOCATOR_OK);
+	TL_TEST(dsa.bookkeeper.curr == 2);
+	TL_TEST(dstackalc_alloc(&dsa, DSTACK_LOW, 50) == c);
+
+	/*A low marker is not a valid high marker*/
+	TL_TEST(dstackalc_rewind(&dsa, DSTACK_HIGH, low) == ALLOCATOR_INVALID_INPUT);
+	high.offset = 257;
+	TL_TEST(dstackalc_rewind(&dsa, DSTACK_HIGH, high) == ALLOCATOR_INVALID_INPUT);
+
+	dstackalc_reset(&dsa);
+	TL_TEST(dsa.low == 0 && dsa.high == 256);
+	TL_TEST(dsa.bookkeeper.curr == 0);
+	TL_TEST(dstackalc_alloc(&dsa, DSTACK_LOW, 256) == memory);
+	TL_TEST(dstackalc_alloc(&dsa, DSTACK_HIGH, 1) == NULL);
+}
+
+void
+test_aligned(void)
+{
+    uint8_t memory[memsize] = {0};
+	stackallocator sa = {0};
+	uint32_t align;
+	uint8_t* prev_end;
+	uint8_t* p;
+
+	stackalc_new(&sa, region(memory, memsize), NULL);
+	TL_TEST(stackalc_alloc_aligned(&sa, 10, 48) == NULL);
+	TL_TEST(stackalc_alloc_aligned(&sa, 10, 0) == NULL);
+	TL_TEST(stackalc_alloc_aligned(&sa, 0, 64) == NULL);
+	for (align = 1; align <= 256; align *= 2) {
+		stackalc_alloc(&sa, 1);
+		prev_end = memory + sa.offset;
+		p = (uint8_t*)stackalc_alloc_aligned(&sa, 24, align);
+		TL_TEST(p != NULL && (unsigned long)p % align == 0);
+		/*Only the padding up to the alignment is skipped*/
+		TL_TEST(p >= prev_end && p - prev_end < (long)(align < _TH_ALIGNMENT ? _TH_ALIGNMENT : align));
+	}
+	TL_TEST(stackalc_alloc_aligned(&sa, memsize, 64) == NULL);
+}
+
+#ifdef _ALLOCATOR_VMREGION
+void
+test_vmregion(void)
+{
+	const uint64_t reserve = 6ull * 1024 * 1024 * 1024;
+	vmregion vm = {0};
+	stackallocator sa = {0};
+	stack_marker m;
+	uint8_t* p;
+	int i;
+
+	TL_TEST(vmregion_reserve(&vm, reserve) == ALLOCATOR_OK);
+	TL_TEST(vm.reserved == reserve && vm.committed == 0);
+	TL_TEST(stackalc_new(&sa, vmregion_region(&vm), NULL) == ALLOCATOR_OK);
+	TL_TESTM(sa.region.len == reserve, "regions are larger than 4 GB");
+
+	/*Pages are committed as the stack grows*/
+	p = (uint8_t*)stackalc_alloc(&sa, 100);
+	TL_TEST(p == vm.mem);
+	TL_TEST(vm.committed == VMREGION_COMMIT_STEP);
+	m = stackalc_mark(&sa);
+	for (i = 0; i < 10; i++) {
+		p = (uint8_t*)stackalc_alloc(&sa, ALC_KB_2_B(100));
+		TL_TEST(p != NULL);
+		memset(p, i, ALC_KB_2_B(100));
+	}
+	TL_TEST(vm.committed >= sa.offset && vm.committed < sa.offset + VMREGION_COMMIT_STEP);
+	TL_PRINT("%lu bytes used, %lu committed of %lu reserved\n",
+	         (unsigned long)sa.offset, (unsigned long)vm.committed,
+	         (unsigned long)vm.reserved);
+
+	/*Rewinding keeps the pages, resetting gives them back*/
+	stackalc_rewind(&sa, m);
+	TL_TEST(vm.committed > VMREGION_COMMIT_STEP);
+	stackalc_reset(&sa);
+	TL_TEST(vm.committed == VMREGION_COMMIT_STEP);
+	p = (uint8_t*)stackalc_alloc(&sa, 2 * VMREGION_COMMIT_STEP);
+	TL_TEST(p != NULL);
+	memset(p, 1, 2 * VMREGION_COMMIT_STEP);
+	vmregion_release(&vm);
+	TL_TEST(vm.mem == NULL);
+}
+#endif /*_ALLOCATOR_VMREGION*/
+
+/*Multithreaded tests, every thread allocates from the same stack and checks
+  afterwards that no other thread was handed the same memory*/
+#define STRESS_ALLOC_SIZE 24
+
+typedef struct {
+	stackallocator* sa;
+	/*Every thread writes its allocations to out[(id - 1) * rounds], if set*/
+	uint8_t** out;
+	memregion mem;
+}stack_stress;
+
+void*
+stress_worker(void* _arg)
+{
+	stress_arg* a = (stress_arg*)_arg;
+	stack_stress* s = (stack_stress*)a->alc;
+	uint8_t* p;
+	int i;
+
+	for (i = 0; i < a->rounds; i++) {
+		p = (uint8_t*)stackalc_alloc(s->sa, STRESS_ALLOC_SIZE);
+		if (p == NULL || p == s->sa->scratch_buffer) {
+			a->failed++;
+			continue;
+		}
+		memset(p, a->id, STRESS_ALLOC_SIZE);
+		if (s->out != NULL)
+			s->out[(a->id - 1) * a->rounds + i] = p;
+	}
+	return NULL;
+}
+
+void
+stress_reset(void* _alc)
+{
+	stack_stress* s = (stack_stress*)_alc;
+	stackalc_new(s->sa, s->mem, NULL);
+}
+
+void
+test_threaded_stress(void)
+{
+	const int rounds = 10000;
+	const uint32_t size = STRESS_THREADS * rounds * _TH_ALIGN(STRESS_ALLOC_SIZE);
+	uint8_t* memory = (uint8_t*)malloc(size);
+	uint8_t** out = (uint8_t**)calloc(STRESS_THREADS * rounds, sizeof(uint8_t*));
+	stackallocator sa = {0};
+	stack_stress s = {&sa, out, region(memory, size)};
+	int corrupt = 0;
+	int failed;
+	int i, k;
+
+	stress_reset(&s);
+	stress_run(stress_worker, &s, STRESS_THREADS, rounds, &corrupt, &failed);
+	TL_TEST(failed == 0);
+	TL_TEST(sa.bookkeeper.total == (uint32_t)(STRESS_THREADS * rounds));
+	/*Allocations overlap if another thread overwrote the pattern*/
+	for (i = 0; i < STRESS_THREADS * rounds; i++) {
+		if (out[i] == NULL)
+			continue;
+		for (k = 0; k < STRESS_ALLOC_SIZE; k++)
+			if (out[i][k] != i / rounds + 1) {
+				corrupt++;
+				break;
+			}
+	}
+	TL_TEST(corrupt == 0);
+	free(out);
+	free(memory);
+}
+
+void
+test_contention_benchmark(void)
+{
+	const int total_rounds = 400000;
+	const uint32_t size = total_rounds * _TH_ALIGN(STRESS_ALLOC_SIZE);
+	uint8_t* memory = (uint8_t*)malloc(size);
+	stackallocator sa = {0};
+	stack_stress s = {&sa, NULL, region(memory, size)};
+
+	TL_PRINT("Allocations of %d threads sharing one stack allocator\n",
+	         STRESS_THREADS);
+	stress_scaling(stress_worker, &s, stress_reset, total_rounds, 1, "allocs");
+	free(memory);
+}
+
 int main(int argc, char **argv) {
 	(void)argc;
 	(void)argv;
     TL(test_custom_struct());
 	TL(test_scratch_buffer());
+	TL(test_markers());
+	TL(test_double_ended());
+	TL(test_aligned());
+#ifdef _ALLOCATOR_VMREGION
+	TL(test_vmregion());
+#endif /*_ALLOCATOR_VMREGION*/
+#ifndef TH_DISABLE_MUTEX
+	TL(test_threaded_stress());
+	TL(test_contention_benchmark());
+#endif /*TH_DISABLE_MUTEX*/
 
     tl_summary();
 	return 0;
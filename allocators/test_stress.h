@@ -0,0 +1,82 @@
+/*
+Multithreaded harness shared by the allocator tests, include after testlib.h.
+
+A worker is run on every thread with its own stress_arg, it allocates and
+frees through the allocator in stress_arg.alc and counts corrupt (written by
+another thread while held) and failed allocations. The same worker is used
+by the stress test and the contention benchmark of each allocator.
+*/
+#ifndef TEST_STRESS_H
+#define TEST_STRESS_H
+
+#include <pthread.h>
+#include <time.h>
+
+#ifndef STRESS_THREADS
+#define STRESS_THREADS 8
+#endif /*STRESS_THREADS*/
+
+typedef struct {
+	void* alc;
+	int id;
+	int rounds;
+	int corrupt;
+	int failed;
+}stress_arg;
+
+typedef void* (*stress_worker_fn)(void* _arg);
+
+double
+wall_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double
+stress_run(stress_worker_fn _worker, void* _alc, int _threads, int _rounds,
+           int* _corrupt, int* _failed)
+/*Runs _worker on _threads threads, ids start at 1. Returns wall seconds*/
+{
+	pthread_t threads[STRESS_THREADS];
+	stress_arg args[STRESS_THREADS];
+	double start;
+	int i;
+
+	start = wall_sec();
+	for (i = 0; i < _threads; i++) {
+		args[i] = (stress_arg) {_alc, i + 1, _rounds, 0, 0};
+		pthread_create(&threads[i], NULL, _worker, &args[i]);
+	}
+	*_corrupt = 0;
+	*_failed = 0;
+	for (i = 0; i < _threads; i++) {
+		pthread_join(threads[i], NULL);
+		*_corrupt += args[i].corrupt;
+		*_failed += args[i].failed;
+	}
+	return wall_sec() - start;
+}
+
+void
+stress_scaling(stress_worker_fn _worker, void* _alc, void (*_reset)(void* _alc),
+               int _total_rounds, int _ops_per_round, const char* _ops)
+/*Splits the rounds over 1, 2, 4.. threads and prints the throughput of each,
+  _reset reinitializes the allocator before every run*/
+{
+	double sec;
+	int corrupt;
+	int failed;
+	int n;
+
+	for (n = 1; n <= STRESS_THREADS; n *= 2) {
+		_reset(_alc);
+		sec = stress_run(_worker, _alc, n, _total_rounds / n, &corrupt, &failed);
+		TL_PRINT("\t%d thread(s): %lfs, %.2lf M%s/s\n",
+		         n, sec, (double)_total_rounds * _ops_per_round / sec / 1e6, _ops);
+		TL_TEST(corrupt == 0 && failed == 0);
+	}
+}
+
+#endif /*TEST_STRESS_H*/
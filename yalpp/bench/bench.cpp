@@ -0,0 +1,110 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <new>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define YALCPP_IMPLEMENTATION
+#include "../yal.hpp"
+
+#include "../../yet-another-lisp/bench/suite.h"
+
+const char* std_path = "../../std.yal";
+
+/*Count every heap allocation, exprs are counted by the garbage collector.
+  The default operator delete releases with free(), so only new is replaced.
+  Not inlined, or gcc reports every delete as mismatched against malloc*/
+static size_t bench_news = 0;
+
+__attribute__((noinline)) void*
+operator new(std::size_t _n)
+{
+    bench_news++;
+    if (void* p = std::malloc(_n))
+        return p;
+    throw std::bad_alloc();
+}
+
+int
+run_program(const BenchProgram* _p)
+{
+    yal::Environment e;
+    yal::ExprPtr prg;
+    yal::ExprPtr result;
+    struct rusage usage;
+    std::string out;
+    size_t news;
+    size_t exprs;
+    long runs = 0;
+    bool ok;
+
+    e.load_core();
+    if (!e.load_file(std_path)) {
+        std::cout << std::left << std::setw(16) << _p->name
+                  << " setup failed: could not load " << std_path << std::endl;
+        return 1;
+    }
+    e.load(_p->yalpp);
+    prg = e.read(_p->run);
+
+    news = bench_news;
+    exprs = e.exprs_total();
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> elapsed;
+    do {
+        for (int i = 0; i < _p->repeat; i++)
+            result = e.eval(prg);
+        runs += _p->repeat;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < BENCH_MIN_MS);
+    news = bench_news - news;
+    exprs = e.exprs_total() - exprs;
+    getrusage(RUSAGE_SELF, &usage);
+
+    out = yal::stringify(result);
+    ok = out == _p->expected;
+    std::cout << std::left << std::setw(16) << _p->name << " " << std::right
+              << std::setw(6) << runs << " "
+              << std::setw(12) << std::fixed << std::setprecision(3) << elapsed.count() / runs << " "
+              << std::setw(10) << usage.ru_maxrss << " "
+              << std::setw(12) << exprs / runs << " "
+              << std::setw(12) << news / runs << "  "
+              << (ok ? "ok" : out) << std::endl;
+    return !ok;
+}
+
+int
+main(int argc, char **argv) {
+    int failed = 0;
+    int status;
+    pid_t pid;
+
+    std::cout << std::left << std::setw(16) << "program" << " " << std::right
+              << std::setw(6) << "runs" << " "
+              << std::setw(12) << "ms/run" << " "
+              << std::setw(10) << "peak-rss" << " "
+              << std::setw(12) << "exprs/run" << " "
+              << std::setw(12) << "news/run" << "  result" << std::endl;
+    for (int i = 0; i < BENCH_PROGRAMS_LEN; i++) {
+        /*Only run the programs named on the command line, if any*/
+        int j = 1;
+        for (; j < argc; j++)
+            if (std::strcmp(argv[j], bench_programs[i].name) == 0)
+                break;
+        if (argc > 1 && j == argc)
+            continue;
+        std::cout.flush();
+        pid = fork();
+        if (pid == 0)
+            std::exit(run_program(&bench_programs[i]));
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    std::cout << "peak-rss in kilobytes, " << failed << " program(s) failed" << std::endl;
+    return failed != 0;
+}
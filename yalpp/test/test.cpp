@@ -79,7 +79,7 @@ repl_test(yal::Environment* _e, const char* _p, const char* _gt)
 /*======================================================================*/
 /*======================================================================*/
 
-struct ExprData*;
+class ExprData;
 
 struct Callable {
     ExprData* binds;
@@ -99,7 +99,7 @@ struct String {
     std::string str;
 };
 
-class ExprData* {
+class ExprData {
     std::uint8_t m_type;
     std::variant<int,
                  float,
@@ -123,14 +123,13 @@ test_sizes(void)
     const size_t enumtypesz = sizeof(yal::TYPE);
     std::cout << "sizeof ExprPtr = " << exprsz << std::endl; 
     std::cout << "sizeof cons = " << conssz << std::endl; 
-    std::cout << "sizeof smallsz = " << yal::smallXsz << std::endl; 
     std::cout << "sizeof type = " << enumtypesz << std::endl; 
 
     std::cout << "sizeof iostream = " << sizeof(std::iostream) << std::endl; 
-    std::cout << "sizeof ExprData* = " << sizeof(ExprData*) << std::endl; 
+    std::cout << "sizeof ExprData = " << sizeof(ExprData) << std::endl; 
     std::cout << "sizeof yal::ExprPtr = " << sizeof(yal::ExprPtr) << std::endl; 
     
-    TL_TEST(sizeof(ExprData*) > sizeof(yal::ExprPtr));
+    TL_TEST(sizeof(ExprData) > sizeof(yal::ExprPtr));
 }
 
 void
@@ -1526,6 +1525,288 @@ test_scope(void)
     std::cout << e.gc_info() << std::endl;
 }
 
+void
+test_callsite_cache(void)
+{
+    yal::Environment e;
+    e.load_core();
+    e.load_file(std_path);
+    size_t hits = e.callsite_hits();
+    size_t misses = e.callsite_misses();
+
+    TL_TEST(repl_test(&e, "(fn! twice (x) (* 2 x))", "twice"));
+    TL_TEST(repl_test(&e, "(fn! callit (v) (twice v))", "callit"));
+    TL_TEST(repl_test(&e, "(callit 3)", "6"));
+    TL_TEST(repl_test(&e, "(callit 4)", "8"));
+    TL_TEST(e.callsite_hits() > hits);
+
+    /*std functions called from a scope that shadows a global ('list' in
+      reduce) still hit for every other name*/
+    hits = e.callsite_hits();
+    misses = e.callsite_misses();
+    TL_TEST(repl_test(&e, "(reduce + 0 (range 0 50))", "1275"));
+    TL_TEST(repl_test(&e, "(callit 5)", "10"));
+    hits = e.callsite_hits() - hits;
+    misses = e.callsite_misses() - misses;
+    std::cout << "call-site hits " << hits << ", misses " << misses << std::endl;
+    TL_TEST(hits > 4 * misses);
+
+    /*a local binding must still shadow a cached global*/
+    TL_TEST(repl_test(&e, "(fn! shadow (twice) (callit 3))", "shadow"));
+    TL_TEST(repl_test(&e, "(shadow (lambda (x) (+ x 100)))", "103"));
+    TL_TEST(repl_test(&e, "(callit 5)", "10"));
+
+    /*also when the global is defined after the local was bound*/
+    TL_TEST(repl_test(&e, "(fn! late (thrice) (global! thrice (lambda (x) (* 3 x))) (thrice 2))", "late"));
+    TL_TEST(repl_test(&e, "(late (lambda (x) (+ x 100)))", "102"));
+    TL_TEST(repl_test(&e, "(late (lambda (x) (+ x 200)))", "202"));
+    TL_TEST(repl_test(&e, "(thrice 2)", "6"));
+
+    std::cout << e.gc_info() << std::endl;
+}
+
+void
+test_binary_serialization(void)
+{
+    yal::Environment e;
+    e.load_core();
+    const char* prg = "(1 -2 3.5 \"mystr\" sym (a . 4) (nested (sym sym)) -70000)";
+    yal::ExprPtr data = e.read(prg);
+    std::string bytes = e.write_binary(data);
+    TL_TEST(yal::stringify(e.read_binary(bytes)) == prg);
+    TL_TEST(is_nil(e.read_binary(bytes.substr(0, bytes.size() - 1))));
+    TL_TEST(is_nil(e.read_binary("(1 2 3)")));
+
+    TL_TEST(repl_test(&e, "(write-binary \"test.bin\" '(1 2.5 \"s\" (a b a)))",
+                      "(1 2.5 \"s\" (a b a))"));
+    TL_TEST(repl_test(&e, "(read-binary \"test.bin\")", "(1 2.5 \"s\" (a b a))"));
+    std::remove("test.bin");
+}
+
+void
+test_binary_throughput(void)
+{
+    const int entries = 20000;
+    const int iterations = 5;
+    tl_timer_s timer_text_write = {0, 0};
+    tl_timer_s timer_text_read = {0, 0};
+    tl_timer_s timer_binary_write = {0, 0};
+    tl_timer_s timer_binary_read = {0, 0};
+    yal::Environment e;
+    std::stringstream ss;
+    std::string text;
+    std::string bytes;
+
+    ss << "(";
+    for (int i = 0; i < entries; i++)
+        ss << "(entity " << i << " " << i * 0.5f << " \"name" << i << "\" (pos " << -i << " 2))";
+    ss << ")";
+    yal::ExprPtr data = e.read(ss.str());
+
+    for (int i = 0; i < iterations; i++) {
+        tl_timer_start(&timer_text_write);
+        text = yal::stringify(data);
+        tl_timer_stop(&timer_text_write);
+        tl_timer_start(&timer_text_read);
+        e.read(text);
+        tl_timer_stop(&timer_text_read);
+
+        tl_timer_start(&timer_binary_write);
+        bytes = e.write_binary(data);
+        tl_timer_stop(&timer_binary_write);
+        tl_timer_start(&timer_binary_read);
+        e.read_binary(bytes);
+        tl_timer_stop(&timer_binary_read);
+    }
+    TL_TEST(yal::stringify(e.read_binary(bytes)) == text);
+
+    TL_PRINT("Serialization of %d entries (%d iterations)\n", entries, iterations);
+    TL_PRINT("\ttext:   %zu bytes, stringify %lfs, read %lfs\n", text.size(),
+             timer_text_write.elapsed_sec, timer_text_read.elapsed_sec);
+    TL_PRINT("\tbinary: %zu bytes, write %lfs, read %lfs\n", bytes.size(),
+             timer_binary_write.elapsed_sec, timer_binary_read.elapsed_sec);
+    TL_TEST(bytes.size() < text.size());
+}
+
+void
+test_lex_numbers(void)
+{
+    yal::Environment e;
+    e.load_core();
+
+    TL_TEST(lex_type_test(&e, "100_000_000", yal::TYPE_REAL));
+    TL_TEST(read_test(&e, "100_000_000", "100000000"));
+    TL_TEST(read_test(&e, "+7", "7"));
+    TL_TEST(read_test(&e, "-0.5"));
+    TL_TEST(lex_type_test(&e, "1e3", yal::TYPE_DECIMAL));
+    TL_TEST(read_test(&e, "9223372036854775807"));
+    TL_TEST(lex_type_test(&e, "99999999999999999999", yal::TYPE_DECIMAL));
+    TL_TEST(lex_type_test(&e, "1+", yal::TYPE_SYMBOL));
+    TL_TEST(lex_type_test(&e, "2nd", yal::TYPE_SYMBOL));
+    TL_TEST(lex_type_test(&e, "12.5.3", yal::TYPE_SYMBOL));
+    TL_TEST(repl_test(&e, "(_PLUS2 4000000000 1)", "4000000001"));
+}
+
+void
+test_lex_numbers_throughput(void)
+{
+    const int numbers = 1000000;
+    const char* path = "numbers.yal";
+    tl_timer_s timer_read = {0, 0};
+    tl_timer_s timer_stl = {0, 0};
+    yal::Environment e;
+    std::ofstream ofs(path);
+    std::ifstream ifs;
+    std::stringstream ss;
+    std::string token;
+    int64_t sum = 0;
+
+    ofs << "(";
+    for (int i = 0; i < numbers; i++) {
+        if (i % 2 == 0)
+            ofs << i * 1000003LL << " ";
+        else
+            ofs << i * 0.25f << " ";
+    }
+    ofs << ")";
+    ofs.close();
+
+    ifs.open(path);
+    ss << ifs.rdbuf();
+    ifs.close();
+    std::remove(path);
+
+    tl_timer_start(&timer_read);
+    yal::ExprPtr data = e.read(ss.str());
+    tl_timer_stop(&timer_read);
+    TL_TEST(yal::len(data) == numbers);
+
+    /*Reference: the same file parsed with std::stoll/std::stof only*/
+    ss.seekg(1);
+    tl_timer_start(&timer_stl);
+    while (ss >> token && token != ")") {
+        if (token.find(".") == std::string::npos)
+            sum += std::stoll(token);
+        else
+            sum += (int64_t)std::stof(token);
+    }
+    tl_timer_stop(&timer_stl);
+    TL_IGNORE_VAR(sum);
+
+    TL_PRINT("Reading %d numbers\n", numbers);
+    TL_PRINT("\tread():            %lfs\n", timer_read.elapsed_sec);
+    TL_PRINT("\tstd::stoll/stof(): %lfs\n", timer_stl.elapsed_sec);
+}
+
+void
+test_eval_with_budget(void)
+{
+    yal::Environment e;
+    e.load_core();
+    e.load_file(std_path);
+    TL_TEST(repl_test(&e, "(fn! count (n) (if (< n 1) 0 (+ 1 (count (- n 1)))))", "count"));
+
+    /*The evaluation is spread over several frames and the host can keep
+      evaluating in between them*/
+    int frames = 1;
+    std::unique_ptr<yal::Continuation> c = e.eval_with_budget(e.read("(count 100)"), 500);
+    while (!c->resume(500)) {
+        TL_TEST(repl_test(&e, "(+ 1 2)", "3"));
+        frames++;
+    }
+    std::cout << "frames=" << frames << " steps=" << c->steps() << std::endl;
+    TL_TEST(frames > 1);
+    TL_TEST(c->steps() <= size_t(frames + 1) * 500);
+    TL_TEST(yal::stringify(c->result()) == "100");
+
+    /*A runaway script is suspended and can be aborted*/
+    TL_TEST(repl_test(&e, "(fn! forever () (forever))", "forever"));
+    c = e.eval_with_budget(e.read("(forever)"), 1000);
+    TL_TEST(c->resume(1000) == false);
+    TL_TEST(c->steps() == 2000);
+    c.reset();
+    TL_TEST(repl_test(&e, "(count 3)", "3"));
+
+    /*Collections between the slices of a suspended evaluation free the
+      garbage of the host, but not the partial results of the evaluation*/
+    TL_TEST(repl_test(&e, "(fn! names (n) (if (< n 1) NIL (cons (stringify n) (names (- n 1)))))", "names"));
+    c = e.eval_with_budget(e.read("(names 20)"), 100);
+    size_t collected = 0;
+    for (frames = 1; !c->resume(100); frames++) {
+        collected += e.garbage_collect();
+        TL_TEST(repl_test(&e, "(names 2)", "(\"2\" \"1\")"));
+    }
+    TL_TEST(frames > 2);
+    TL_TEST(collected > 0);
+    TL_TEST(len(c->result()) == 20);
+    TL_TEST(yal::stringify(first(c->result())) == "\"20\"");
+    c.reset();
+    TL_TEST(e.garbage_collect() > 0);
+
+    /*Later evaluations reuse the worker of finished ones*/
+    for (int i = 0; i < 10; i++) {
+        c = e.eval_with_budget(e.read("(count 5)"), 1000);
+        TL_TEST(c->done() && yal::stringify(c->result()) == "5");
+    }
+
+    /*A continuation can outlive its environment, which aborts it*/
+    std::unique_ptr<yal::Environment> gone = std::make_unique<yal::Environment>();
+    gone->load_core();
+    gone->load("(fn! forever () (forever))");
+    c = gone->eval_with_budget(gone->read("(forever)"), 100);
+    TL_TEST(c->done() == false);
+    gone.reset();
+    TL_TEST(c->done());
+    TL_TEST(c->resume(100));
+    TL_TEST(c->result() == nullptr);
+    c.reset();
+}
+
+void
+test_pmap(void)
+{
+    yal::Environment e;
+    e.load_core();
+    e.load_file(std_path);
+
+    TL_TEST(repl_test(&e, "(fn! sq (x) (* x x))", "sq"));
+    TL_TEST(repl_test(&e, "(pmap sq '(1 2 3))", "(1 4 9)"));
+    TL_TEST(repl_test(&e, "(pmap car '((1 2) (3 4)))", "(1 3)"));
+    TL_TEST(repl_test(&e, "(= (pmap sq (range 1 200) 4) (transform sq (range 1 200)))", "T"));
+
+    /*workers see the variables of the calling scope*/
+    TL_TEST(repl_test(&e, "(global! offset 1000)", "offset"));
+    TL_TEST(repl_test(&e, "(last (pmap (lambda (x) (+ x offset)) (range 1 100) 3))", "1100"));
+    TL_TEST(repl_test(&e, "(pmap 3 '(1))", "(error \"[pmap]\" \"expects function to map with, got\" 3)"));
+
+    /*the workers are reused and get the current values*/
+    TL_TEST(repl_test(&e, "(global! xs (range 1 100))", "xs"));
+    TL_TEST(repl_test(&e, "(fn! add-all (n) (car (pmap (lambda (x) (+ x n)) xs 3)))", "add-all"));
+    TL_TEST(repl_test(&e, "(add-all 1)", "2"));
+    TL_TEST(repl_test(&e, "(add-all 2)", "3"));
+
+    /*side effects are lost on short and long lists alike, and do not reach
+      the next call on the same worker*/
+    TL_TEST(repl_test(&e, "(fn! leak (x) (global! leaked x) x)", "leak"));
+    TL_TEST(repl_test(&e, "(pmap leak '(1 2))", "(1 2)"));
+    TL_TEST(repl_test(&e, "leaked", "NIL"));
+    TL_TEST(repl_test(&e, "(len (pmap leak xs 3))", "100"));
+    TL_TEST(repl_test(&e, "leaked", "NIL"));
+    TL_TEST(repl_test(&e, "(pmap (lambda (x) (if leaked 'kept 'lost)) '(1))", "(lost)"));
+
+    /*a local shadowing a core function is seen, and undone afterwards*/
+    TL_TEST(repl_test(&e, "(fn! shift (range) (pmap (lambda (x) (+ x range)) '(1 2)))", "shift"));
+    TL_TEST(repl_test(&e, "(shift 7)", "(8 9)"));
+    TL_TEST(repl_test(&e, "(pmap (lambda (x) (range 0 x)) '(1 2))", "((0 1) (0 1 2))"));
+
+    /*only the variables fn refers to are copied, and the ones the workers
+      cannot get a copy of are reported, not dropped*/
+    TL_TEST(repl_test(&e, "(global! ops (list car))", "ops"));
+    TL_TEST(repl_test(&e, "(pmap sq '(1 2 3))", "(1 4 9)"));
+    TL_TEST(repl_test(&e, "(pmap (lambda (x) (car ops)) (range 1 100) 2)",
+                      "(error \"[pmap]\" \"cannot copy variable to the workers, it is not serializable\" (ops (#<buildin>)))"));
+}
+
 void
 test_extended_math(void)
 {
@@ -1611,6 +1892,13 @@ main(int argc, char **argv)
     //TL(test_macros());
     //TL(test_quasiquote());
     //TL(test_funcall());
+    TL(test_callsite_cache());
+    TL(test_binary_serialization());
+    TL(test_binary_throughput());
+    TL(test_lex_numbers());
+    TL(test_lex_numbers_throughput());
+    TL(test_eval_with_budget());
+    TL(test_pmap());
 
     /*NOT WORKING*/
     //TL(test_scope_management());
@@ -15,8 +15,15 @@
 #include <chrono>
 #include <memory>
 #include <cassert>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <charconv>
+#include <cstdint>
 
 #include <unordered_map>
+#include <unordered_set>
 //https://www.educative.io/answers/what-is-a-hash-map-in-cpp
 
 #ifndef YALCPP_H
@@ -47,11 +54,25 @@ class ExprData;
 using ExprPtr = std::shared_ptr<ExprData>;
 class VariableScope;
 class Environment;
+class Continuation;
 typedef ExprPtr(*BuildinFn)(VariableScope*, ExprPtr);
 
+/*Inline cache of a call site '(foo ...)', holding the global variable entry
+  that 'foo' resolved to. Global entries are only replaced when a global is
+  removed, which bumps the epoch of the environment, so the cache stays valid
+  while 'foo' is still the called symbol, the epoch matches and no local
+  scope binds it.*/
+struct CallSite {
+    ExprPtr symbol{nullptr};
+    ExprPtr entry{nullptr};
+    size_t epoch = 0;
+};
+
 class ExprData {
     bool is_marked = false;
     uint8_t type = TYPE_INVALID;
+    /*call-site cache slot + 1 in the garbage collector, 0 for none*/
+    uint32_t callsite = 0;
 //   union {
 //       int real;
 //       float decimal;
@@ -73,7 +94,7 @@ class ExprData {
            ExprPtr cdr;
        };
 
-    std::variant < int, float, char*, cons, BuildinFn
+    std::variant < int64_t, float, char*, cons, BuildinFn
                    > data;
 
 
@@ -106,7 +127,7 @@ public:
     friend void clear_mark(ExprPtr _e);
     
     /*value accessors*/
-    friend int         get_real(ExprPtr _e);
+    friend int64_t     get_real(ExprPtr _e);
     friend float       get_decimal(ExprPtr _e);
     friend std::string get_str(ExprPtr _e);
     friend const char* get_cstr(ExprPtr _e);
@@ -114,6 +135,7 @@ public:
     friend const char* get_csym(ExprPtr _e);
     friend ExprPtr     get_binds(ExprPtr _e);
     friend ExprPtr     get_body(ExprPtr _e);
+    friend BuildinFn   get_buildin(ExprPtr _e);
 
     friend ExprPtr car(ExprPtr _e);
     friend ExprPtr cdr(ExprPtr _e);
@@ -178,6 +200,8 @@ ExprPtr eval(VariableScope* _s, ExprPtr _e);
 ExprPtr write(VariableScope* _s, ExprPtr _e);
 ExprPtr newline(VariableScope* _s, ExprPtr _e);
 ExprPtr stringify(VariableScope* _s, ExprPtr _e);
+ExprPtr write_binary(VariableScope* _s, ExprPtr _e);
+ExprPtr read_binary(VariableScope* _s, ExprPtr _e);
 ExprPtr concat2(VariableScope* _s, ExprPtr _e);
 
 ExprPtr defglobal(VariableScope* _s, ExprPtr _e);
@@ -228,6 +252,8 @@ ExprPtr gc_run(VariableScope* _s, ExprPtr _e);
     
 ExprPtr get_vars(VariableScope* _s, ExprPtr _e);
 
+ExprPtr pmap(VariableScope* _s, ExprPtr _e);
+
 }; /*namespace core*/
 
 class GarbageCollector {
@@ -239,12 +265,17 @@ class GarbageCollector {
   */
     std::vector<ExprPtr> m_in_use = {};
     std::size_t m_total = 0;
+    /*call-site caches of cons exprs, slots are reused once their expr dies*/
+    std::vector<CallSite> m_callsites = {};
+    std::vector<uint32_t> m_free_callsites = {};
 public:
     size_t exprs_total_count(void);
     size_t exprs_in_use_count(void);
     size_t garbage_collect(void);
     ExprPtr new_expr(uint8_t _type);
     void destroy_expr(ExprPtr _e);
+    void mark_external(void);
+    CallSite* callsite(ExprPtr _e, bool _create);
     ~GarbageCollector(void);
 };
 
@@ -261,11 +292,13 @@ public:
     bool is_var_const(ExprPtr _var);
     ExprPtr variable_get(const std::string& _name);
     ExprPtr variable_get_this_scope(const std::string& _name);
+    bool binds_locally(const char* _name);
     std::unordered_map<std::string, ExprPtr>& variables_get_all(void);
     void mark_variables(void);
     bool add_global(const std::string& _name, ExprPtr _v);
 	bool add_buildin(const std::string& _name, const BuildinFn _fn);
     bool add_local(const std::string& _name, ExprPtr _v);
+    bool remove_local(const std::string& _name);
     void bind(const std::string& _fnname, ExprPtr _binds, ExprPtr _values);
     
     Throwable NotImplemented(const std::string& _fn);
@@ -277,11 +310,59 @@ public:
 private:
     VariableScope* m_outer = nullptr;
     Environment* m_env;
+    /*true if this or an outer local scope binds a name that is also global*/
+    bool m_shadows_global = false;
     std::unordered_map<std::string, ExprPtr> m_variables;
 };
 
+/*Thread that budgeted evaluations run on. A continuation borrows a worker
+  from its environment and hands it back when it is destroyed, so a host
+  that runs one evaluation at a time keeps reusing a single thread.*/
+class EvalWorker {
+public:
+    EvalWorker(void);
+    ~EvalWorker(void);
+    void start(Continuation* _c);
+
+private:
+    void loop(void);
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Continuation* m_job = nullptr;
+    bool m_quit = false;
+};
+
+/*Thread with its own environment that pmap runs chunks of a list on. The
+  environment loads the core once and is reset to it after every job, so
+  nothing a job defines or changes is seen by the next one.*/
+class MapWorker {
+public:
+    MapWorker(void);
+    ~MapWorker(void);
+    void start(std::function<void(Environment&)> _job);
+    void wait(void);
+
+private:
+    void loop(void);
+    void reset(void);
+
+    std::unique_ptr<Environment> m_env{nullptr};
+    /*global values right after load_core*/
+    std::unordered_map<std::string, ExprPtr> m_core;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::function<void(Environment&)> m_job{nullptr};
+    bool m_busy = false;
+    bool m_quit = false;
+};
+
 class Environment {
     friend class VariableScope;
+    friend class Continuation;
+    friend ExprPtr core::pmap(VariableScope* _s, ExprPtr _e);
     /*garbage management methods*/
     friend bool is_marked(ExprPtr _e);
     friend void set_mark(ExprPtr _e);
@@ -289,26 +370,35 @@ class Environment {
 
 public:
     Environment(void);
+    ~Environment(void);
     VariableScope* global_scope(void);
 
     /*Info*/
     size_t garbage_collect(void);
     size_t exprs_in_use(void);
     size_t exprs_total(void);
+    size_t callsite_hits(void);
+    size_t callsite_misses(void);
     const std::string gc_info(void);
 
     /*Evaluation*/
     ExprPtr read(const std::string& _program);
     ExprPtr eval(ExprPtr _e);
+    std::unique_ptr<Continuation> eval_with_budget(ExprPtr _e, size_t _max_steps);
     /*TODO: put these into private and access as friend*/
     ExprPtr list_eval(VariableScope* _scope, ExprPtr _list);
     ExprPtr scoped_eval(VariableScope* _scope, ExprPtr _e);
 
+    /*Binary Serialization*/
+    std::string write_binary(ExprPtr _e);
+    ExprPtr read_binary(const std::string& _bytes);
+    ExprPtr read_binary(const uint8_t* _data, size_t _len);
+
     /*ExprPtr Creation*/
 	ExprPtr t(void);
 	ExprPtr nil(void);
 	ExprPtr cons(ExprPtr _car, ExprPtr _cdr);
-    ExprPtr real(int _v);
+    ExprPtr real(int64_t _v);
     ExprPtr decimal(float _v);
     ExprPtr symbol(const std::string& _v);
     ExprPtr string(const std::string& _v);
@@ -336,8 +426,67 @@ private:
     ExprPtr m_glob_t = nullptr;
     VariableScope m_global_scope;
     bool m_core_loaded = false;
+    /*budgeted evaluation that currently has control, if any*/
+    Continuation* m_continuation = nullptr;
+    /*budgeted evaluations that have not finished, while there are any the
+      collector also keeps what their stacks refer to*/
+    size_t m_unfinished = 0;
+    /*continuations that are not destroyed yet, detached when this dies*/
+    std::unordered_set<Continuation*> m_continuations;
+    size_t m_callsite_hits = 0;
+    size_t m_callsite_misses = 0;
+    /*bumped when a global is removed, invalidates every call-site cache*/
+    size_t m_def_epoch = 0;
+    ExprPtr callsite_lookup(VariableScope* _scope, ExprPtr _call);
     ExprPtr lex_value(std::string& _token);
     ExprPtr lex(std::list<std::string>& _tokens);
+    /*idle workers for budgeted evaluations, last so they stop first*/
+    std::vector<std::unique_ptr<EvalWorker>> m_workers;
+    /*workers of pmap, created on first use*/
+    std::vector<std::unique_ptr<MapWorker>> m_map_workers;
+};
+
+/*A suspendable evaluation created by Environment::eval_with_budget().
+  Every scoped_eval() is a step, and when the step budget of a resume() is
+  spent the evaluation suspends until the next resume(). The evaluation runs
+  on a worker thread so the recursive evaluator can be suspended
+  mid-expression, but control is strictly handed over, so the host and the
+  evaluation never run at the same time. Destroying an unfinished
+  continuation aborts the evaluation, and so does destroying its
+  environment, after which the continuation is done without a result.
+  A suspended evaluation holds partial results on its own stack, so while
+  one is unfinished the garbage collector keeps every expr that is referenced
+  from outside the heap.*/
+class Continuation {
+    friend class Environment;
+    friend class EvalWorker;
+public:
+    ~Continuation(void);
+    bool resume(size_t _max_steps);
+    bool done(void);
+    ExprPtr result(void);
+    size_t steps(void);
+
+private:
+    struct Aborted {};
+    Continuation(Environment* _env, ExprPtr _e);
+    void run(void);
+    void step(void);
+    void abort(void);
+    void detach(void);
+
+    Environment* m_env;
+    ExprPtr m_expr{nullptr};
+    ExprPtr m_result{nullptr};
+    std::exception_ptr m_error{nullptr};
+    std::unique_ptr<EvalWorker> m_worker{nullptr};
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_budget = 0;
+    size_t m_steps = 0;
+    bool m_running = false;
+    bool m_done = false;
+    bool m_abort = false;
 };
 
 #define YALCPP_IMPLEMENTATION
@@ -376,11 +525,13 @@ is_nil(ExprPtr _e)
     const std::string nil2 = "NIL";
     if (_e == nullptr || type(_e) == TYPE_INVALID)
         return true;
-    if (type(_e) == TYPE_CONS && car(_e) == nullptr && cdr(_e) == nullptr)
+    /*the accessors test for nil themselves, so read the data directly*/
+    if (type(_e) == TYPE_CONS &&
+        std::get<3>(_e->data).car == nullptr && std::get<3>(_e->data).cdr == nullptr)
         return true;
-    if (type(_e) == TYPE_SYMBOL && nil1 == get_sym(_e))
+    if (type(_e) == TYPE_SYMBOL && nil1 == std::get<2>(_e->data))
         return true;
-    if (type(_e) == TYPE_SYMBOL && nil2 == get_sym(_e))
+    if (type(_e) == TYPE_SYMBOL && nil2 == std::get<2>(_e->data))
         return true;
     return false;
 }
@@ -469,7 +620,7 @@ is_dotted(ExprPtr _e)
     return false;
 }
 
-int
+int64_t
 get_real(ExprPtr _e)
 {
     assert(is_real(_e));
@@ -527,6 +678,13 @@ get_body(ExprPtr _e)
     return std::get<3>(_e->data).cdr;
 }
 
+BuildinFn
+get_buildin(ExprPtr _e)
+{
+    assert(is_buildin(_e));
+    return std::get<4>(_e->data);
+}
+
 ExprPtr
 ipreverse(ExprPtr _list)
 {
@@ -562,7 +720,7 @@ ExprPtr
 set_car(ExprPtr _e, ExprPtr _car)
 {
     assert(is_cons(_e));
-    _e->cons.car = _car;
+    std::get<3>(_e->data).car = _car;
     return _e;
 }
 
@@ -570,7 +728,7 @@ ExprPtr
 set_cdr(ExprPtr _e, ExprPtr _cdr)
 {
     assert(is_cons(_e));
-    _e->cons.cdr = _cdr;
+    std::get<3>(_e->data).cdr = _cdr;
     return _e;
 }
     
@@ -578,8 +736,8 @@ ExprPtr
 set_callable(ExprPtr _e, ExprPtr _binds, ExprPtr _body)
 {
     assert(is_lambda(_e) || is_macro(_e));
-    _e->callable.binds = _binds;
-    _e->callable.body = _body;
+    /*callables keep their binds and body as a cons*/
+    _e->data = ExprData::cons{_binds, _body};
     return _e;
 }
 
@@ -624,17 +782,17 @@ set_mark(ExprPtr _e)
     //if (!is_lambda(_e) && !is_macro(_e) && !is_cons(_e)) std::cout << "marked " << _e << std::endl;
     if (is_lambda(_e) || is_macro(_e)) {
         //std::cout << "marked callable" << std::endl;
-        if (!is_marked(_e->callable.binds))
-            set_mark(_e->callable.binds);
-        if (!is_marked(_e->callable.body))
-        set_mark(_e->callable.body);
+        if (!is_marked(get_binds(_e)))
+            set_mark(get_binds(_e));
+        if (!is_marked(get_body(_e)))
+        set_mark(get_body(_e));
     }
     if (is_cons(_e)) {
         //std::cout << "marked cons " << _e << std::endl;
-        if (!is_marked(_e->cons.car))
-            set_mark(_e->cons.car);
-        if (!is_marked(_e->cons.cdr))
-            set_mark(_e->cons.cdr);
+        if (!is_marked(car(_e)))
+            set_mark(car(_e));
+        if (!is_marked(cdr(_e)))
+            set_mark(cdr(_e));
     }
 }
 
@@ -716,12 +874,16 @@ GarbageCollector::destroy_expr(ExprPtr _e)
 {
     if (_e == nullptr)
         return;
+    /*call-site caches refer back into the globals, break the cycle*/
+    if (_e->callsite != 0) {
+        m_callsites[_e->callsite - 1] = CallSite{};
+        m_free_callsites.push_back(_e->callsite);
+        _e->callsite = 0;
+    }
     switch(type(_e)) {
     case TYPE_STRING:
-        delete[] _e->string;
-        break;
     case TYPE_SYMBOL:
-        delete[] _e->symbol;
+        delete[] std::get<2>(_e->data);
         break;
     default:
         break;
@@ -730,6 +892,38 @@ GarbageCollector::destroy_expr(ExprPtr _e)
     //delete _e;
 }
 
+void
+GarbageCollector::mark_external(void)
+{
+    /*m_in_use holds one reference to every expr, any reference beyond that
+      one and the ones from other exprs and call sites comes from outside
+      the heap*/
+    std::unordered_map<ExprData*, long> inner;
+    auto count = [&inner] (const ExprPtr& e) {
+        if (e != nullptr)
+            inner[e.get()]++;
+    };
+    for (ExprPtr& e: m_in_use) {
+        if (e == nullptr)
+            continue;
+        if (is_cons(e) || is_lambda(e) || is_macro(e)) {
+            count(std::get<3>(e->data).car);
+            count(std::get<3>(e->data).cdr);
+        }
+    }
+    for (CallSite& site: m_callsites) {
+        count(site.symbol);
+        count(site.entry);
+    }
+    for (ExprPtr& e: m_in_use) {
+        if (e == nullptr || is_marked(e))
+            continue;
+        auto in = inner.find(e.get());
+        if (e.use_count() > 1 + (in == inner.end() ? 0 : in->second))
+            set_mark(e);
+    }
+}
+
 GarbageCollector::~GarbageCollector(void)
 {
     for (auto v : m_in_use) 
@@ -746,31 +940,53 @@ size_t
 GarbageCollector::garbage_collect(void)
 {
     size_t removed = 0;
-    for (auto it = m_in_use.begin(); it != m_in_use.end(); it++) {
-        ExprPtr expr = *it;
+    size_t kept = 0;
+    /*survivors are moved to the front, so the sweep is a single pass*/
+    for (size_t i = 0; i < m_in_use.size(); i++) {
+        ExprPtr expr = m_in_use[i];
         if (expr == nullptr) {
             continue;
         }
         if (is_marked(expr)) {
             //std::cout << "unmarkeded " << expr << std::endl;
             clear_mark(expr);
+            m_in_use[kept++] = expr;
         } else {
             //std::cout << "destroyed " << expr << std::endl;
             destroy_expr(expr);
-            it = m_in_use.erase(it);
             removed++;
         }
     }
+    m_in_use.resize(kept);
     return removed;
 }
 
+CallSite*
+GarbageCollector::callsite(ExprPtr _e, bool _create)
+{
+    if (_e->callsite == 0 && _create) {
+        if (m_free_callsites.empty()) {
+            m_callsites.emplace_back();
+            _e->callsite = m_callsites.size();
+        } else {
+            _e->callsite = m_free_callsites.back();
+            m_free_callsites.pop_back();
+        }
+    }
+    if (_e->callsite == 0)
+        return nullptr;
+    return &m_callsites[_e->callsite - 1];
+}
+
 size_t
 GarbageCollector::exprs_total_count(void)
 {
     return m_total; 
 }
 
-VariableScope::VariableScope(Environment* _env, VariableScope* _outer) : m_outer(_outer), m_env(_env) {};
+VariableScope::VariableScope(Environment* _env, VariableScope* _outer)
+    : m_outer(_outer), m_env(_env),
+      m_shadows_global(_outer != nullptr && _outer->m_shadows_global) {};
 
 VariableScope*
 VariableScope::global_scope(void)
@@ -839,6 +1055,15 @@ VariableScope::variable_get_this_scope(const std::string& _s)
     return m_variables[_s];
 }
 
+bool
+VariableScope::binds_locally(const char* _name)
+{
+    for (VariableScope* scope = this; scope->m_outer != nullptr; scope = scope->m_outer)
+        if (scope->m_variables.find(_name) != scope->m_variables.end())
+            return true;
+    return false;
+}
+
 bool
 VariableScope::add_local(const std::string& _name, ExprPtr _v)
 {
@@ -847,12 +1072,28 @@ VariableScope::add_local(const std::string& _name, ExprPtr _v)
         return false;
     entry = env()->list({_v});
     m_variables.insert({_name, entry});
+    if (m_outer != nullptr && !m_shadows_global && !is_nil(env()->global_scope()->variable_get_this_scope(_name)))
+        m_shadows_global = true;
+    return true;
+}
+
+bool
+VariableScope::remove_local(const std::string& _name)
+{
+    if (m_variables.erase(_name) == 0)
+        return false;
+    /*call sites may still hold the removed entry*/
+    env()->m_def_epoch++;
     return true;
 }
 
 bool
 VariableScope::add_global(const std::string& _name, ExprPtr _v)
 {
+    /*locals that already bind the name now hide a global*/
+    if (binds_locally(_name.c_str()))
+        for (VariableScope* scope = this; scope->m_outer != nullptr; scope = scope->m_outer)
+            scope->m_shadows_global = true;
     return global_scope()->add_local(_name, _v);
 }
 
@@ -908,6 +1149,9 @@ Environment::garbage_collect()
     set_mark(m_glob_nil);
     set_mark(m_glob_t);
     m_global_scope.mark_variables();
+    /*suspended evaluations refer to their partial results from their stacks*/
+    if (m_unfinished > 0)
+        m_gc.mark_external();
     return m_gc.garbage_collect();
 }
 
@@ -929,17 +1173,33 @@ Environment::exprs_total(void)
     return m_gc.exprs_total_count() + 2; 
 }
 
+size_t
+Environment::callsite_hits(void)
+{
+    return m_callsite_hits;
+}
+
+size_t
+Environment::callsite_misses(void)
+{
+    return m_callsite_misses;
+}
+
 const std::string
 Environment::gc_info(void)
 {
     auto total = exprs_total();
     auto in_use = exprs_in_use();
+    auto lookups = m_callsite_hits + m_callsite_misses;
     std::stringstream ss;
     ss << "ExprPtr size:      " << sizeof(yal::ExprPtr) << " bytes" << std::endl
        << "Total ExprPtr's:   " << total << std::endl
        << "Current ExprPtr's: " << in_use << std::endl
        << "Current memory: " << float(in_use * sizeof(yal::ExprPtr)) / 1000000
-       << " MB";
+       << " MB" << std::endl
+       << "Call-site cache:   " << m_callsite_hits << " hits, "
+       << m_callsite_misses << " misses ("
+       << (lookups == 0 ? 0.0f : 100.0f * m_callsite_hits / lookups) << "% hit rate)";
     return ss.str();
 }
 
@@ -967,6 +1227,13 @@ Environment::Environment(void) : m_global_scope(this, nullptr)
     m_glob_t = symbol("T");
 }
 
+Environment::~Environment(void)
+{
+    /*unwind the evaluations that are left while their exprs still exist*/
+    for (Continuation* c: m_continuations)
+        c->detach();
+}
+
 std::string
 _try_get_special_token(const char* _start)    
 {
@@ -1067,9 +1334,6 @@ tokenize(const std::string& _str) {
 ExprPtr
 Environment::lex_value(std::string& _token)
 {
-
-    /*TODO: We should do cool stuff like allowing _ in numbers and remove them before
-            lexing so that 100_000_000 is a valid number. */
     auto looks_like_number = [] (std::string& _token) {
         if (_token.size() > 1 && (_token[0] == '-' || _token[0] == '+'))
             return (_token[1] >= '0' && _token[1] <= '9');
@@ -1080,22 +1344,48 @@ Environment::lex_value(std::string& _token)
             return false;
         return (_token[0] == '\"');
     };
-    auto token_value_type = [] (std::string& _token) {
-        if (_token.find(".") == std::string::npos)
-            return TYPE_REAL;
-        return TYPE_DECIMAL;
-    };
 
     if (looks_like_string(_token)) {
         return string(_token.substr(1, _token.size()-2));
     }
     if (looks_like_number(_token)) {
-        if (token_value_type(_token) == TYPE_REAL) {
-            return real(std::stoi(_token));
+        /*Single pass that strips '_' separators, so 100_000_000 is a valid
+          number, and finds out if the number is a real or a decimal*/
+        char digits[128];
+        size_t n = 0;
+        bool is_decimal = false;
+        for (size_t i = (_token[0] == '+') ? 1 : 0; i < _token.size(); i++) {
+            if (_token[i] == '_')
+                continue;
+            if (_token[i] == '.' || _token[i] == 'e' || _token[i] == 'E')
+                is_decimal = true;
+            if (n == sizeof(digits) - 1)
+                return symbol(_token);
+            digits[n++] = _token[i];
         }
-        else {
-            return decimal(std::stof(_token));
+        if (!is_decimal) {
+            int64_t v = 0;
+            auto res = std::from_chars(digits, digits + n, v);
+            if (res.ec == std::errc() && res.ptr == digits + n)
+                return real(v);
+            /*reals that overflow are read as decimals instead*/
+            if (res.ec != std::errc::result_out_of_range)
+                return symbol(_token);
         }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        float f = 0;
+        auto res = std::from_chars(digits, digits + n, f);
+        if (res.ec == std::errc() && res.ptr == digits + n)
+            return decimal(f);
+#else
+        /*from_chars for floats is unsupported before libstdc++ 11*/
+        char* end = nullptr;
+        digits[n] = '\0';
+        float f = std::strtof(digits, &end);
+        if (end == digits + n)
+            return decimal(f);
+#endif
+        return symbol(_token);
     }
     return symbol(_token);
 }
@@ -1202,6 +1492,257 @@ Environment::eval(ExprPtr _e)
     return res;
 }
 
+std::unique_ptr<Continuation>
+Environment::eval_with_budget(ExprPtr _e, size_t _max_steps)
+{
+    std::unique_ptr<Continuation> c(new Continuation(this, _e));
+    c->resume(_max_steps);
+    return c;
+}
+
+EvalWorker::EvalWorker(void)
+{
+    m_thread = std::thread(&EvalWorker::loop, this);
+}
+
+EvalWorker::~EvalWorker(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void
+EvalWorker::start(Continuation* _c)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = _c;
+    }
+    m_cv.notify_all();
+}
+
+void
+EvalWorker::loop(void)
+{
+    Continuation* job;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_job != nullptr || m_quit; });
+            if (m_job == nullptr)
+                return;
+            job = m_job;
+            m_job = nullptr;
+        }
+        job->run();
+    }
+}
+
+Continuation::Continuation(Environment* _env, ExprPtr _e) : m_env(_env), m_expr(_e)
+{
+    if (m_env->m_workers.empty()) {
+        m_worker = std::make_unique<EvalWorker>();
+    } else {
+        m_worker = std::move(m_env->m_workers.back());
+        m_env->m_workers.pop_back();
+    }
+    m_env->m_unfinished++;
+    m_env->m_continuations.insert(this);
+    m_worker->start(this);
+}
+
+Continuation::~Continuation(void)
+{
+    abort();
+    if (m_env == nullptr)
+        return;
+    m_env->m_continuations.erase(this);
+    m_env->m_workers.push_back(std::move(m_worker));
+}
+
+void
+Continuation::abort(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_abort = true;
+    m_cv.notify_all();
+    m_cv.wait(lock, [this] { return m_done; });
+}
+
+void
+Continuation::detach(void)
+{
+    /*the worker is kept, and stops when this is destroyed*/
+    abort();
+    m_env = nullptr;
+}
+
+void
+Continuation::run(void)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_running || m_abort; });
+    }
+    try {
+        if (!m_abort)
+            m_result = m_env->eval(m_expr);
+    } catch (Aborted&) {
+    } catch (...) {
+        m_error = std::current_exception();
+    }
+    /*notified under the lock, the host may destroy this as soon as it
+      sees m_done*/
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_env->m_unfinished--;
+    m_done = true;
+    m_running = false;
+    m_cv.notify_all();
+}
+
+void
+Continuation::step(void)
+{
+    if (m_budget == 0) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this] { return m_running || m_abort; });
+        if (m_abort)
+            throw Aborted{};
+    }
+    m_budget--;
+    m_steps++;
+}
+
+bool
+Continuation::resume(size_t _max_steps)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_done)
+        return true;
+    m_budget = _max_steps;
+    m_running = true;
+    m_env->m_continuation = this;
+    m_cv.notify_all();
+    m_cv.wait(lock, [this] { return !m_running; });
+    m_env->m_continuation = nullptr;
+    if (m_error != nullptr) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+    return m_done;
+}
+
+bool
+Continuation::done(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_done;
+}
+
+ExprPtr
+Continuation::result(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_result;
+}
+
+size_t
+Continuation::steps(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_steps;
+}
+
+MapWorker::MapWorker(void)
+{
+    m_thread = std::thread(&MapWorker::loop, this);
+}
+
+MapWorker::~MapWorker(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void
+MapWorker::start(std::function<void(Environment&)> _job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = std::move(_job);
+        m_busy = true;
+    }
+    m_cv.notify_all();
+}
+
+void
+MapWorker::wait(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_busy; });
+}
+
+void
+MapWorker::loop(void)
+{
+    std::function<void(Environment&)> job;
+    /*the environment is only ever touched by this thread*/
+    m_env = std::make_unique<Environment>();
+    m_env->load_core();
+    for (auto& kv: m_env->global_scope()->variables_get_all())
+        m_core.insert({kv.first, first(kv.second)});
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_job != nullptr || m_quit; });
+            if (m_job == nullptr)
+                break;
+            job = std::move(m_job);
+            m_job = nullptr;
+        }
+        job(*m_env);
+        job = nullptr;
+        reset();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+        }
+        m_cv.notify_all();
+    }
+    m_core.clear();
+    m_env.reset();
+}
+
+void
+MapWorker::reset(void)
+{
+    /*drop the globals a job defined and restore the core ones it changed*/
+    std::vector<std::string> defined;
+    VariableScope* globals = m_env->global_scope();
+    for (auto& kv: globals->variables_get_all()) {
+        auto core = m_core.find(kv.first);
+        if (core == m_core.end())
+            defined.push_back(kv.first);
+        else if (first(kv.second) != core->second)
+            set_car(kv.second, core->second);
+    }
+    for (auto& name: defined)
+        globals->remove_local(name);
+    m_env->outbuffer_getreset();
+    m_env->garbage_collect();
+}
+
 ExprPtr
 _macro_expander(VariableScope* _s, const std::string& _macroname, ExprPtr _macrofn, ExprPtr _macroargs) {
     auto macro_expand = [] (auto macro_expand, VariableScope* scope, ExprPtr body) {
@@ -1247,6 +1788,34 @@ _macro_expander(VariableScope* _s, const std::string& _macroname, ExprPtr _macro
 }
 
 
+ExprPtr
+Environment::callsite_lookup(VariableScope* _scope, ExprPtr _call)
+{
+    ExprPtr sym = car(_call);
+    CallSite* site = m_gc.callsite(_call, false);
+    ExprPtr entry = nullptr;
+    /*a local binding of the called name hides the cached global*/
+    bool shadowed = _scope->m_shadows_global && _scope->binds_locally(get_csym(sym));
+
+    if (site != nullptr && site->symbol == sym && site->epoch == m_def_epoch && !shadowed) {
+        m_callsite_hits++;
+        return site->entry;
+    }
+    m_callsite_misses++;
+    entry = _scope->variable_get(get_csym(sym));
+
+    /*Only cache entries that resolve to the global scope*/
+    if (is_nil(entry) || shadowed)
+        return entry;
+    if (entry != m_global_scope.variable_get_this_scope(get_csym(sym)))
+        return entry;
+    site = m_gc.callsite(_call, true);
+    site->symbol = sym;
+    site->entry = entry;
+    site->epoch = m_def_epoch;
+    return entry;
+}
+
 ExprPtr
 Environment::scoped_eval(VariableScope* _scope, ExprPtr _e)
 {
@@ -1268,10 +1837,13 @@ Environment::scoped_eval(VariableScope* _scope, ExprPtr _e)
     auto eval_fn = [progn, this, _scope] (const std::string& name, ExprPtr fn, ExprPtr args) {
         VariableScope internal = _scope->create_internal();
         args = list_eval(&internal, args);
-        internal.bind(name, fn->callable.binds, args);
-        return progn(&internal, fn->callable.body);
+        internal.bind(name, get_binds(fn), args);
+        return progn(&internal, get_body(fn));
     };
 
+    if (m_continuation != nullptr)
+        m_continuation->step();
+
     /*mark input as being currently used so it wont be removed by the gc*/
     _scope->mark_variables();
     set_mark(_e);
@@ -1289,39 +1861,43 @@ Environment::scoped_eval(VariableScope* _scope, ExprPtr _e)
         ExprPtr var = nullptr;
         if (is_nil(_e))
             return nil();
-        if (_e->symbol == std::string("t") || _e->symbol == std::string("T"))
+        if (get_sym(_e) == "t" || get_sym(_e) == "T")
             return t();
-        var = _scope->variable_get(_e->symbol);
+        var = _scope->variable_get(get_sym(_e));
         return first(var);
     }
 
     /*Handle function calls*/
     if (type(_e) == TYPE_CONS) {
-        std::string name;
+        ExprPtr callee = nullptr;
         ExprPtr fn = nullptr;
         ExprPtr args = nullptr;
         fn = car(_e);
         args = cdr(_e);
         if (type(fn) == TYPE_CONS)
             fn = scoped_eval(_scope, fn);
+        /*the name is only needed to bind lambdas and expand macros*/
+        auto name = [&callee] (void) {
+            return (type(callee) == TYPE_SYMBOL) ? get_sym(callee) : std::string("lambda");
+        };
+        callee = fn;
         if (type(fn) == TYPE_SYMBOL) {
-            name = fn->symbol;
-            fn = first(_scope->variable_get(fn->symbol));
-        }
-        else {
-            name = "lambda";
+            if (fn == car(_e))
+                fn = first(callsite_lookup(_scope, _e));
+            else
+                fn = first(_scope->variable_get(get_csym(fn)));
         }
         if (is_nil(fn))
             throw _scope->ProgramError("eval", "could not evaluate unknown function", first(_e));
 
         if (type(fn) == TYPE_BUILDIN) {
-            return fn->buildin(_scope, args);
+            return get_buildin(fn)(_scope, args);
         }
         if (type(fn) == TYPE_LAMBDA) {
-            return eval_fn(name, fn, args);
+            return eval_fn(name(), fn, args);
         }
         if (type(fn) == TYPE_MACRO) {
-            return scoped_eval(_scope, _macro_expander(_scope, name, fn, args));
+            return scoped_eval(_scope, _macro_expander(_scope, name(), fn, args));
         }
         throw _scope->ProgramError("eval", "could not find function called", fn);
     }
@@ -1384,9 +1960,11 @@ Environment::load_core(void)
         add_buildin("write", core::write);
         add_buildin("newline", core::newline);
         add_buildin("stringify", core::stringify);
+        add_buildin("write-binary", core::write_binary);
+        add_buildin("read-binary", core::read_binary);
         add_buildin("_CONCAT2", core::concat2);
-        add_global("real-max", real(std::numeric_limits<int>::max()));
-        add_global("real-min", real(std::numeric_limits<int>::min()));
+        add_global("real-max", real(std::numeric_limits<int64_t>::max()));
+        add_global("real-min", real(std::numeric_limits<int64_t>::min()));
         add_global("decimal-max", decimal(std::numeric_limits<float>::max()));
         add_global("decimal-min", decimal(std::numeric_limits<float>::min()));
         add_buildin("cos", core::cos);
@@ -1410,6 +1988,7 @@ Environment::load_core(void)
         add_buildin("gc-info", core::gc_info);
         add_buildin("gc-run", core::gc_run);
         add_buildin("get-vars", core::get_vars);
+        add_buildin("pmap", core::pmap);
 
         eval(read(" (fn! progn (&body)"
                   "   \"evaluate body and return last result\""
@@ -1468,17 +2047,16 @@ Environment::cons(ExprPtr _car, ExprPtr _cdr) {
 	ExprPtr out = m_gc.new_expr(TYPE_CONS);
 	if (out == nullptr)
 		return nullptr;
-	out->cons.car = _car;
-	out->cons.cdr = _cdr;
+	out->data = ExprData::cons{_car, _cdr};
 	return out;
 }
 
 ExprPtr
-Environment::real(int _v) {
+Environment::real(int64_t _v) {
      ExprPtr out = m_gc.new_expr(TYPE_REAL);
      if (out == nullptr)
        return nullptr;
-     out->real = _v;
+     out->data = _v;
      return out;
    }
 
@@ -1487,7 +2065,7 @@ Environment::decimal(float _v) {
      ExprPtr out = m_gc.new_expr(TYPE_DECIMAL);
      if (out == nullptr)
        return nullptr;
-     out->decimal = _v;
+     out->data = _v;
      return out;
    }
 
@@ -1496,7 +2074,7 @@ Environment::symbol(const std::string& _v) {
      ExprPtr out = m_gc.new_expr(TYPE_SYMBOL);
      if (out == nullptr)
        return nullptr;
-     out->symbol = str_to_cstr(_v);
+     out->data = str_to_cstr(_v);
      return out;
 }
 
@@ -1505,7 +2083,7 @@ Environment::string(const std::string& _v) {
   ExprPtr out = m_gc.new_expr(TYPE_STRING);
   if (out == nullptr)
     return nullptr;
-  out->string = str_to_cstr(_v);
+  out->data = str_to_cstr(_v);
   return out;
 }
 
@@ -1514,7 +2092,7 @@ Environment::buildin(BuildinFn _v) {
   ExprPtr out = m_gc.new_expr(TYPE_BUILDIN);
   if (out == nullptr)
     return nullptr;
-  out->buildin = _v;
+  out->data = _v;
   return out;
 }
 
@@ -1640,6 +2218,242 @@ stringify(ExprPtr _e, bool _wrap_quotes)
     return ss.str();
 }
 
+/*Binary format:
+    "YALB" <version> <symbol-count> <symbols...> <expr>
+  All counts, lengths and symbol indices are unsigned LEB128 varints, reals are
+  zigzag-encoded varints and decimals are raw little-endian IEEE floats.
+  Lists are stored flat as <count> <elements...> <tail> to avoid recursing
+  on the cdr, a proper list has a NIL tail.*/
+const char binary_magic[] = {'Y', 'A', 'L', 'B'};
+const uint8_t binary_version = 1;
+
+enum BINARY_TAG {
+    BINARY_NIL     = 0,
+    BINARY_LIST    = 1,
+    BINARY_REAL    = 2,
+    BINARY_DECIMAL = 3,
+    BINARY_SYMBOL  = 4,
+    BINARY_STRING  = 5,
+    BINARY_LAMBDA  = 6,
+    BINARY_MACRO   = 7,
+};
+
+void
+_put_varint(std::string& _out, uint64_t _v)
+{
+    while (_v >= 0x80) {
+        _out.push_back(char((_v & 0x7f) | 0x80));
+        _v >>= 7;
+    }
+    _out.push_back(char(_v));
+}
+
+bool
+_get_varint(const uint8_t* _data, size_t _len, size_t& _cursor, uint64_t& _v)
+{
+    _v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (_cursor >= _len)
+            return false;
+        uint8_t byte = _data[_cursor++];
+        _v |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+std::string
+Environment::write_binary(ExprPtr _e)
+{
+    std::unordered_map<std::string, uint64_t> symbols;
+    std::vector<const char*> symbol_order;
+    std::string body;
+    std::string out;
+
+    auto put_expr = [&] (auto put_expr, ExprPtr e) -> void {
+        if (is_nil(e) && type(e) != TYPE_SYMBOL) {
+            body.push_back(char(BINARY_NIL));
+            return;
+        }
+        switch (type(e)) {
+        case TYPE_CONS: {
+            uint64_t n = 0;
+            ExprPtr curr = e;
+            for (; is_cons(curr); curr = cdr(curr))
+                n++;
+            body.push_back(char(BINARY_LIST));
+            _put_varint(body, n);
+            for (curr = e; is_cons(curr); curr = cdr(curr))
+                put_expr(put_expr, car(curr));
+            put_expr(put_expr, curr);
+            return;
+        }
+        case TYPE_REAL: {
+            int64_t v = get_real(e);
+            body.push_back(char(BINARY_REAL));
+            _put_varint(body, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+            return;
+        }
+        case TYPE_DECIMAL: {
+            float v = get_decimal(e);
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            body.push_back(char(BINARY_DECIMAL));
+            for (int i = 0; i < 4; i++)
+                body.push_back(char((bits >> (8 * i)) & 0xff));
+            return;
+        }
+        case TYPE_STRING: {
+            const char* str = get_cstr(e);
+            size_t n = std::strlen(str);
+            body.push_back(char(BINARY_STRING));
+            _put_varint(body, n);
+            body.append(str, n);
+            return;
+        }
+        case TYPE_SYMBOL: {
+            /*accessed directly as get_sym() rejects the NIL symbols*/
+            const char* sym = std::get<2>(e->data);
+            auto res = symbols.insert({sym, symbols.size()});
+            if (res.second)
+                symbol_order.push_back(sym);
+            body.push_back(char(BINARY_SYMBOL));
+            _put_varint(body, res.first->second);
+            return;
+        }
+        case TYPE_LAMBDA:
+        case TYPE_MACRO:
+            body.push_back(char(is_lambda(e) ? BINARY_LAMBDA : BINARY_MACRO));
+            put_expr(put_expr, get_binds(e));
+            put_expr(put_expr, get_body(e));
+            return;
+        default:
+            throw m_global_scope.ProgramError("write-binary", "cannot serialize", e);
+        };
+    };
+
+    put_expr(put_expr, _e);
+    out.append(binary_magic, sizeof(binary_magic));
+    out.push_back(char(binary_version));
+    _put_varint(out, symbol_order.size());
+    for (const char* sym: symbol_order) {
+        size_t n = std::strlen(sym);
+        _put_varint(out, n);
+        out.append(sym, n);
+    }
+    out.append(body);
+    return out;
+}
+
+ExprPtr
+Environment::read_binary(const std::string& _bytes)
+{
+    return read_binary((const uint8_t*)_bytes.data(), _bytes.size());
+}
+
+ExprPtr
+Environment::read_binary(const uint8_t* _data, size_t _len)
+{
+    /*Decodes from a plain byte range so a mmap'ed file can be read directly.
+      Malformed or truncated input reads as NIL.*/
+    std::vector<ExprPtr> symbols;
+    size_t cursor = 0;
+    uint64_t n = 0;
+    bool valid = true;
+
+    auto get_expr = [&] (auto get_expr) -> ExprPtr {
+        uint64_t v = 0;
+        if (!valid || cursor >= _len) {
+            valid = false;
+            return nullptr;
+        }
+        switch (_data[cursor++]) {
+        case BINARY_NIL:
+            return nullptr;
+        case BINARY_LIST: {
+            std::vector<ExprPtr> elements;
+            if (!_get_varint(_data, _len, cursor, v) || v > _len - cursor) {
+                valid = false;
+                return nullptr;
+            }
+            elements.reserve(v);
+            for (uint64_t i = 0; i < v; i++)
+                elements.push_back(get_expr(get_expr));
+            ExprPtr out = get_expr(get_expr);
+            for (auto it = elements.rbegin(); it != elements.rend(); ++it)
+                out = cons(*it, out);
+            return out;
+        }
+        case BINARY_REAL:
+            if (!_get_varint(_data, _len, cursor, v)) {
+                valid = false;
+                return nullptr;
+            }
+            return real(int64_t(v >> 1) ^ -int64_t(v & 1));
+        case BINARY_DECIMAL: {
+            uint32_t bits = 0;
+            float f;
+            if (_len - cursor < 4) {
+                valid = false;
+                return nullptr;
+            }
+            for (int i = 0; i < 4; i++)
+                bits |= uint32_t(_data[cursor++]) << (8 * i);
+            std::memcpy(&f, &bits, sizeof(f));
+            return decimal(f);
+        }
+        case BINARY_STRING:
+            if (!_get_varint(_data, _len, cursor, v) || v > _len - cursor) {
+                valid = false;
+                return nullptr;
+            }
+            cursor += v;
+            return string(std::string((const char*)_data + cursor - v, v));
+        case BINARY_SYMBOL:
+            if (!_get_varint(_data, _len, cursor, v) || v >= symbols.size()) {
+                valid = false;
+                return nullptr;
+            }
+            return symbols[v];
+        case BINARY_LAMBDA: {
+            ExprPtr binds = get_expr(get_expr);
+            return lambda(binds, get_expr(get_expr));
+        }
+        case BINARY_MACRO: {
+            ExprPtr binds = get_expr(get_expr);
+            return macro(binds, get_expr(get_expr));
+        }
+        default:
+            valid = false;
+            return nullptr;
+        };
+    };
+
+    if (_data == nullptr || _len < sizeof(binary_magic) + 1 ||
+        std::memcmp(_data, binary_magic, sizeof(binary_magic)) != 0 ||
+        _data[sizeof(binary_magic)] != binary_version)
+        return nullptr;
+    cursor = sizeof(binary_magic) + 1;
+
+    /*Symbols are immutable, so every occurrence shares the same expr*/
+    if (!_get_varint(_data, _len, cursor, n) || n > _len - cursor)
+        return nullptr;
+    symbols.reserve(n);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t symlen = 0;
+        if (!_get_varint(_data, _len, cursor, symlen) || symlen > _len - cursor)
+            return nullptr;
+        symbols.push_back(symbol(std::string((const char*)_data + cursor, symlen)));
+        cursor += symlen;
+    }
+
+    ExprPtr out = get_expr(get_expr);
+    if (!valid)
+        return nullptr;
+    return out;
+}
+
 ExprPtr
 core::quote(VariableScope* _s, ExprPtr _e)
 {
@@ -1929,6 +2743,42 @@ core::read(VariableScope* _s, ExprPtr _e)
     return _s->env()->read(get_str(first(args)));
 }
 
+ExprPtr
+core::write_binary(VariableScope* _s, ExprPtr _e)
+{
+    ExprPtr args = _s->env()->list_eval(_s, _e);
+    std::ofstream ofs;
+    if (len(args) != 2)
+        throw _s->ProgramError("write-binary", "expects file and value, got", args);
+    if (type(first(args)) != TYPE_STRING)
+        throw _s->ProgramError("write-binary", "expects string as file, got", first(args));
+    std::string bytes = _s->env()->write_binary(second(args));
+    ofs.open(get_str(first(args)), std::ios::binary);
+    if (!ofs)
+        throw _s->ProgramError("write-binary", "could not open file", first(args));
+    ofs.write(bytes.data(), bytes.size());
+    ofs.close();
+    return second(args);
+}
+
+ExprPtr
+core::read_binary(VariableScope* _s, ExprPtr _e)
+{
+    ExprPtr args = _s->env()->list_eval(_s, _e);
+    std::ifstream ifs;
+    std::stringstream ss;
+    if (len(args) != 1)
+        throw _s->ProgramError("read-binary", "expects only 1 argument, got", args);
+    if (type(first(args)) != TYPE_STRING)
+        throw _s->ProgramError("read-binary", "expects string as argument, got", first(args));
+    ifs.open(get_str(first(args)), std::ios::binary);
+    if (!ifs)
+        throw _s->ProgramError("read-binary", "could not open file", first(args));
+    ss << ifs.rdbuf();
+    ifs.close();
+    return _s->env()->read_binary(ss.str());
+}
+
 ExprPtr
 core::eval(VariableScope* _s, ExprPtr _e)
 {
@@ -1986,8 +2836,8 @@ ExprPtr
 core::range(VariableScope* _s, ExprPtr _e)
 {
     bool reverse = false;
-    int low;
-    int high;
+    int64_t low;
+    int64_t high;
     ExprPtr args = _s->env()->list_eval(_s, _e);
     ExprPtr out = nullptr;
 
@@ -1999,7 +2849,7 @@ core::range(VariableScope* _s, ExprPtr _e)
         high = get_real(first(args));
         reverse = true;
     }
-    for (int i = low; i <= high; i++) {
+    for (int64_t i = low; i <= high; i++) {
         out = _s->env()->put_in_list(_s->env()->real(i), out);
     }
     if (reverse)
@@ -2544,6 +3394,149 @@ core::get_vars(VariableScope* _s, ExprPtr _e)
     return locals;
 }
 
+/*Every worker maps at least this many elements, shorter lists use fewer
+  workers down to a single one.*/
+const size_t pmap_min_chunk = 32;
+
+ExprPtr
+core::pmap(VariableScope* _s, ExprPtr _e)
+{
+    /*(pmap fn list [workers])
+      Purity contract: fn is called once per element in an unspecified order
+      and on another thread, inside a copy of the variables fn refers to as
+      seen from the calling scope. fn must only depend on its argument and
+      those variables, and every side effect it has (global!, set!, setcar!,
+      write...) is lost when the call is done, however long the list is.
+      The variables and the results must be serializable with write-binary,
+      pmap throws an error naming the first variable that is not, e.g. a list
+      holding a buildin.*/
+    Environment* env = _s->env();
+    ExprPtr args = env->list_eval(_s, _e);
+    ExprPtr fn = first(args);
+    ExprPtr lst = second(args);
+    size_t workers = std::max(std::thread::hardware_concurrency(), 1u);
+
+    if (len(args) != 2 && len(args) != 3)
+        throw _s->ProgramError("pmap", "expects function, list and optional worker count, got", args);
+    if (!is_lambda(fn) && !is_buildin(fn))
+        throw _s->ProgramError("pmap", "expects function to map with, got", fn);
+    if (!is_nil(lst) && !is_cons(lst))
+        throw _s->ProgramError("pmap", "expects list to map over, got", lst);
+    if (len(args) == 3) {
+        if (!is_real(third(args)) || get_real(third(args)) < 1)
+            throw _s->ProgramError("pmap", "expects worker count to be a positive real, got", third(args));
+        workers = get_real(third(args));
+    }
+    if (is_nil(lst))
+        return env->nil();
+    workers = std::clamp(len(lst) / pmap_min_chunk, size_t(1), workers);
+
+    /*Copy the variables fn refers to, and the ones the functions they hold
+      refer to, as seen from the calling scope. Buildins are shared as
+      function pointers, any other variable that cannot be serialized is an
+      error rather than missing from the workers.*/
+    std::vector<std::pair<std::string, std::string>> vars;
+    std::vector<std::pair<std::string, BuildinFn>> buildins;
+    std::unordered_set<std::string> seen;
+    auto reach = [&] (auto reach, ExprPtr e) -> void {
+        for (; is_cons(e); e = cdr(e))
+            reach(reach, car(e));
+        if (!is_symbol(e) || is_nil(e) || !seen.insert(get_sym(e)).second)
+            return;
+        ExprPtr entry = _s->variable_get(get_csym(e));
+        if (is_nil(entry))
+            return;
+        ExprPtr v = first(entry);
+        if (is_buildin(v)) {
+            buildins.push_back({get_sym(e), get_buildin(v)});
+            return;
+        }
+        try {
+            vars.push_back({get_sym(e), env->write_binary(v)});
+        } catch (Throwable&) {
+            throw _s->ProgramError("pmap", "cannot copy variable to the workers, it is not serializable",
+                                   env->list({e, v}));
+        }
+        if (is_lambda(v) || is_macro(v)) {
+            reach(reach, get_binds(v));
+            reach(reach, get_body(v));
+        }
+    };
+    if (is_lambda(fn)) {
+        reach(reach, get_binds(fn));
+        reach(reach, get_body(fn));
+    }
+    const std::string fn_bytes = is_lambda(fn) ? env->write_binary(fn) : "";
+    const BuildinFn fn_buildin = is_buildin(fn) ? get_buildin(fn) : nullptr;
+
+    /*Split the list into contiguous chunks, one per worker*/
+    std::vector<std::string> chunks(workers);
+    ExprPtr curr = lst;
+    size_t n = len(lst);
+    for (size_t i = 0; i < workers; i++) {
+        ExprPtr chunk = nullptr;
+        for (size_t j = 0; j < n / workers + (i < n % workers); j++) {
+            chunk = env->put_in_list(car(curr), chunk);
+            curr = cdr(curr);
+        }
+        chunks[i] = env->write_binary(ipreverse(chunk));
+    }
+
+    std::vector<std::string> results(workers);
+    std::vector<std::string> thrown(workers);
+    std::vector<std::exception_ptr> failures(workers, nullptr);
+    auto work = [&] (size_t i, Environment& wenv) {
+        try {
+            VariableScope* globals = wenv.global_scope();
+            /*set names the worker already has, so call sites cached on
+              their entries see the copies*/
+            auto put = [&] (const std::string& name, ExprPtr v) {
+                ExprPtr entry = globals->variable_get_this_scope(name);
+                if (is_nil(entry))
+                    globals->add_local(name, v);
+                else
+                    set_car(entry, v);
+            };
+            for (auto& b: buildins)
+                put(b.first, wenv.buildin(b.second));
+            for (auto& v: vars)
+                put(v.first, wenv.read_binary(v.second));
+            ExprPtr wfn = (fn_buildin != nullptr) ? wenv.buildin(fn_buildin) : wenv.read_binary(fn_bytes);
+            try {
+                ExprPtr out = nullptr;
+                for (ExprPtr c = wenv.read_binary(chunks[i]); !is_nil(c); c = cdr(c)) {
+                    ExprPtr call = wenv.list({wfn, wenv.list({wenv.symbol("quote"), car(c)})});
+                    out = wenv.put_in_list(wenv.scoped_eval(globals, call), out);
+                }
+                results[i] = wenv.write_binary(ipreverse(out));
+            } catch (Throwable& t) {
+                thrown[i] = stringify(t.data());
+            }
+        } catch (...) {
+            failures[i] = std::current_exception();
+        }
+    };
+
+    while (env->m_map_workers.size() < workers)
+        env->m_map_workers.push_back(std::make_unique<MapWorker>());
+    for (size_t i = 0; i < workers; i++)
+        env->m_map_workers[i]->start([&work, i] (Environment& wenv) { work(i, wenv); });
+    for (size_t i = 0; i < workers; i++)
+        env->m_map_workers[i]->wait();
+
+    /*Join the results back together in order*/
+    ExprPtr out = nullptr;
+    for (size_t i = 0; i < workers; i++) {
+        if (failures[i] != nullptr)
+            std::rethrow_exception(failures[i]);
+        if (!thrown[i].empty())
+            throw _s->UserThrow(env->read(thrown[i]));
+        for (ExprPtr r = env->read_binary(results[i]); !is_nil(r); r = cdr(r))
+            out = env->put_in_list(car(r), out);
+    }
+    return ipreverse(out);
+}
+
 #endif /*YALPP_IMPLEMENTATION*/
 #endif /*YALCPP_H*/
 
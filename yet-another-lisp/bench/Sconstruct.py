@@ -0,0 +1,29 @@
+import platform
+import os.path
+
+Target = "bench"
+Main = "bench.c"
+IsC99 = True
+
+env = Environment()
+env['SYSTEM'] = platform.system().lower()
+env['ENV']['TERM'] = os.environ['TERM']
+
+def isLinux():
+    if env['SYSTEM'] == 'linux':
+        return True;
+    return False;
+
+print("INFO: platform [", env['SYSTEM'], "]")
+print("INFO: building target [", Target, "]", " from main [", Main, "]")
+
+if IsC99:
+    if isLinux():
+        env.CC = 'gcc'
+        env.Append( CCFLAGS=['-std=c99'])
+
+if isLinux():
+    flags = ['-m64', '-O2', '-Wall', '-Wextra', '-Werror']
+    env.Append( CCFLAGS=[flags])
+
+env.Program(target=Target, source=Main)
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*Count every call to the system heap, from the interpreter and the vendored
+  libraries alike, so the numbers compare to a count of operator new. Exprs
+  taken from the arena are counted separately*/
+long bench_mallocs = 0;
+
+void*
+bench_malloc(size_t _n)
+{
+    bench_mallocs++;
+    return malloc(_n);
+}
+
+void*
+bench_realloc(void* _p, size_t _n)
+{
+    bench_mallocs++;
+    return realloc(_p, _n);
+}
+
+#define malloc(n) bench_malloc(n)
+#define realloc(p, n) bench_realloc(p, n)
+
+#include "../yal.h"
+#include "suite.h"
+
+double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int
+run_program(const BenchProgram* _p)
+{
+    Environment e;
+    Exception msg = {0};
+    struct rusage usage;
+    expr* prg;
+    expr* result = NULL;
+    tstr out;
+    double start;
+    double elapsed;
+    long mallocs;
+    long exprs;
+    long runs = 0;
+    int ok;
+    int i;
+
+    Env_new(&e);
+    Env_add_core(&e);
+    prg = yal_read(&e, &e.globals, &msg, (char*)_p->yal);
+    if (!Exception_is_error(&msg))
+        eval_expr(&e, &e.globals, &msg, prg);
+    if (!Exception_is_error(&msg))
+        prg = yal_read(&e, &e.globals, &msg, (char*)_p->run);
+    if (Exception_is_error(&msg)) {
+        printf("%-16s setup failed: %s\n", _p->name, msg.msg.c_str);
+        Exception_destroy(&msg);
+        Env_destroy(&e);
+        return 1;
+    }
+
+    mallocs = bench_mallocs;
+    exprs = e.arena.n_taken;
+    start = now_ms();
+    do {
+        for (i = 0; i < _p->repeat && !Exception_is_error(&msg); i++)
+            result = eval_expr(&e, &e.globals, &msg, prg);
+        runs += i;
+        elapsed = now_ms() - start;
+    } while (elapsed < BENCH_MIN_MS && !Exception_is_error(&msg));
+    mallocs = bench_mallocs - mallocs;
+    exprs = e.arena.n_taken - exprs;
+    getrusage(RUSAGE_SELF, &usage);
+
+    out = stringify(result, "(", ")");
+    ok = !Exception_is_error(&msg) && strcmp(out.c_str, _p->expected) == 0;
+    printf("%-16s %6ld %12.3f %10ld %12ld %12ld  %s\n",
+           _p->name, runs, elapsed / runs, usage.ru_maxrss,
+           exprs / runs, mallocs / runs,
+           (ok) ? "ok" : (Exception_is_error(&msg)) ? msg.msg.c_str : out.c_str);
+    tstr_destroy(&out);
+    Exception_destroy(&msg);
+    Env_destroy(&e);
+    return !ok;
+}
+
+int
+main(int argc, char **argv) {
+    int failed = 0;
+    int status;
+    int i;
+    int j;
+    pid_t pid;
+
+    printf("%-16s %6s %12s %10s %12s %12s  %s\n",
+           "program", "runs", "ms/run", "peak-rss", "exprs/run", "mallocs/run", "result");
+    for (i = 0; i < BENCH_PROGRAMS_LEN; i++) {
+        /*Only run the programs named on the command line, if any*/
+        for (j = 1; j < argc; j++)
+            if (strcmp(argv[j], bench_programs[i].name) == 0)
+                break;
+        if (argc > 1 && j == argc)
+            continue;
+        fflush(stdout);
+        pid = fork();
+        if (pid == 0)
+            exit(run_program(&bench_programs[i]));
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    printf("peak-rss in kilobytes, %d program(s) failed\n", failed);
+    return failed != 0;
+}
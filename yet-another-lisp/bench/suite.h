@@ -0,0 +1,76 @@
+/*
+ * Benchmark programs shared by the yet-another-lisp (yal.h) and yalpp
+ * (yal.hpp) drivers.
+ *
+ * The two interpreters speak slightly different dialects, so every program
+ * carries its definitions once per dialect. The timed expression and the
+ * expected result are shared, so both drivers do the exact same work.
+ *
+ * A driver evaluates the definitions once, reads the timed expression once,
+ * and then evaluates it in batches of `repeat` runs until at least
+ * BENCH_MIN_MS have passed, so even the short programs are timed well above
+ * the clock resolution. Each program runs in its own process so peak RSS is
+ * per program.
+ *
+ * yet-another-lisp: bench/bench.c
+ * yalpp:            ../yalpp/bench/bench.cpp
+ */
+
+#ifndef YAL_BENCH_SUITE_H
+#define YAL_BENCH_SUITE_H
+
+/*Minimum time in milliseconds each program is timed over*/
+#ifndef BENCH_MIN_MS
+#define BENCH_MIN_MS 100.0
+#endif /*BENCH_MIN_MS*/
+
+typedef struct {
+    const char* name;
+    /*Definitions in the yet-another-lisp dialect*/
+    const char* yal;
+    /*Definitions in the yalpp dialect*/
+    const char* yalpp;
+    const char* run;
+    const char* expected;
+    /*Runs between checks of the clock*/
+    int repeat;
+}BenchProgram;
+
+static const BenchProgram bench_programs[] = {
+    {"fib",
+     "(fn fib (n) (if (= n 0) 0 (if (= n 1) 1 (+ (fib (- n 1)) (fib (- n 2))))))",
+     "(fn! fib (n) (if (= n 0) 0 (if (= n 1) 1 (+ (fib (- n 1)) (fib (- n 2))))))",
+     "(fib 15)", "610", 3},
+
+    {"factorial",
+     "(fn fact (n) (if (= n 0) 1 (* n (fact (- n 1)))))",
+     "(fn! fact (n) (if (= n 0) 1 (* n (fact (- n 1)))))",
+     "(fact 12)", "479001600", 20},
+
+    {"list-build",
+     "(fn build (n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+     "(fn! build (n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+     "(len (build 200 (list 0)))", "201", 3},
+
+    {"string-concat",
+     "(fn cat-n (n s) (if (= n 0) s (cat-n (- n 1) (concat s \"ab\"))))",
+     "(fn! cat-n (n s) (if (= n 0) s (cat-n (- n 1) (concat s \"ab\"))))",
+     "(cat-n 20 \"\")", "\"abababababababababababababababababababab\"", 20},
+
+    {"deep-recursion",
+     "(fn deep (n) (if (= n 0) 0 (deep (- n 1))))",
+     "(fn! deep (n) (if (= n 0) 0 (deep (- n 1))))",
+     "(deep 1000)", "0", 1},
+
+    /*yet-another-lisp macros expand to a list of forms, yalpp to one form*/
+    {"macro-heavy",
+     "(progn (macro sq (x) (list (list '* x x)))"
+     "       (fn msum (n) (if (= n 0) 0 (+ (sq n) (msum (- n 1))))))",
+     "(progn (macro! sq (x) ['* x x])"
+     "       (fn! msum (n) (if (= n 0) 0 (+ (sq n) (msum (- n 1))))))",
+     "(msum 30)", "9455", 20},
+};
+
+#define BENCH_PROGRAMS_LEN ((int)(sizeof(bench_programs) / sizeof(bench_programs[0])))
+
+#endif /*YAL_BENCH_SUITE_H*/
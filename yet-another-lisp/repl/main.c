@@ -23,7 +23,7 @@ main(int argc, char **argv) {
         if (input == NULL)
             break;
         printf("you wrote: %s\n", input);
-        read_result = read(&e, &e.globals, &exception, input);
+        read_result = yal_read(&e, &e.globals, &exception, input);
         if (Exception_is_error(&exception)) {
         printf("yal> ERROR: %s\n", exception.msg.c_str);
         }
@@ -1,4 +1,15 @@
+#include <stdlib.h>
 #include "testlib.h"
+#include "../../allocators/allocator.h"
+
+/*Counts the calls yal makes to the system heap while sysheap_counting is set*/
+static int sysheap_counting = 0;
+static int sysheap_calls = 0;
+static void* count_malloc(size_t _n) { sysheap_calls += sysheap_counting; return malloc(_n); }
+static void* count_realloc(void* _p, size_t _n) { sysheap_calls += sysheap_counting; return realloc(_p, _n); }
+#define malloc(n) count_malloc(n)
+#define realloc(p, n) count_realloc(p, n)
+
 #include "../yal.h"
 
 #define PRINT_IF_ERROR(MSGPTR) \
@@ -12,7 +23,7 @@ lex_type_test(Environment* _env, VariableScope* _scope, char* _p, const int _typ
     Exception msg = {0};
     expr* result;
 
-    result = read(_env, _scope, &msg, _p);
+    result = yal_read(_env, _scope, &msg, _p);
     if (Exception_is_error(&msg)) {
         printf("YAL ERROR: %s\n", msg.msg.c_str);
     }
@@ -34,7 +45,7 @@ exception_test(Environment* _env, VariableScope* _scope, char* _p, const int _ex
     expr* result;
     char out;
 
-    result = read(_env, _scope, &msg, _p);
+    result = yal_read(_env, _scope, &msg, _p);
     if (Exception_is_error(&msg)) {
         printf("YAL ERROR: %s\n", msg.msg.c_str);
     }
@@ -59,7 +70,7 @@ read_test(Environment* _env, VariableScope* _scope, char* _p, char* _expected)
     char eq = 0;
     expr* result;
     ASSERT_INV_SCOPE(_scope);
-    result = read(_env, _scope, &msg, _p);
+    result = yal_read(_env, _scope, &msg, _p);
     if (Exception_is_error(&msg))
         return 0;
     tstr lexed = stringify(result, "(", ")");
@@ -85,7 +96,7 @@ repl_test(Environment* _env, VariableScope* _scope, char* _p, char* _gt)
     Exception msg = {0};
 
     ASSERT_INV_SCOPE(_scope);
-    read_result = read(_env, _scope, &msg, _p);
+    read_result = yal_read(_env, _scope, &msg, _p);
 
     if (Exception_is_error(&msg)) {
         printf("yal> ERROR: %s\n", msg.msg.c_str);
@@ -554,6 +565,8 @@ test_buildin_math(void)
     TL_TEST(repl_test(&e, &e.globals, "(* 4 3)", "12"));
     TL_TEST(repl_test(&e, &e.globals, "(/ 8 2)", "4"));
     TL_TEST(repl_test(&e, &e.globals, "(/ 0 2)", "0"));
+    TL_TEST(exception_test(&e, &e.globals, "(/ 1 0)", EXCEPTION_INVALIDINPUT));
+    TL_TEST(exception_test(&e, &e.globals, "(/ 1 2 0.0)", EXCEPTION_INVALIDINPUT));
 
     TL_TEST(repl_test(&e, &e.globals, "(+ 2 (- 5 6) 1)", "2"));
     TL_TEST(repl_test(&e, &e.globals, "(+ 4 (* 2 6) (- 10 5))", "21"));
@@ -616,8 +629,8 @@ test_global(void)
     char found = 0;
     for (i = 0; i < Variables_len(&e.globals.variables); i++) {
         v = Variables_peek(&e.globals.variables, i);
-        if (tstr_equal(&v->symbol, &pi)) {
-            printf("found '%s'\n", v->symbol.c_str);
+        if (tstr_equal(&v->symbol->symbol, &pi)) {
+            printf("found '%s'\n", v->symbol->symbol.c_str);
             found = 1;
         }
     }
@@ -1136,6 +1149,526 @@ test_type_check(void)
     Env_destroy(&e);
 }
 
+void
+test_arena(void)
+{
+    Environment e;
+    expr* a;
+    expr* b;
+    int used;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    /*Freed expressions are reused before the arena grows*/
+    used = e.arena.n_used;
+    a = real(&e, 1);
+    TL_TEST(e.arena.n_used == used + 1);
+    variable_delete(&e, a);
+    TL_TEST(e.arena.n_used == used);
+    b = string(&e, "reused");
+    TL_TEST(a == b);
+    variable_delete(&e, b);
+    variable_delete(&e, b);
+    TL_TEST(e.arena.n_used == used);
+
+    TL_TEST(repl_test(&e, &e.globals, "(+ 1 2 3)", "6"));
+    Env_destroy(&e);
+
+    /*Fixed arena backed by memory from a dynamic allocator*/
+    static uint8_t memory[ALC_KB_2_B(16)];
+    dynallocator da = {0};
+    uint8_t* mem;
+    TL_TEST(dynalc_init(&da, region(memory, sizeof(memory))) == ALLOCATOR_OK);
+    mem = dynalc_malloc(&da, ALC_KB_2_B(8));
+    TL_TEST(mem != NULL);
+
+    Env_new(&e);
+    TL_TEST(exprArena_add_region(&e.arena, mem, ALC_KB_2_B(8)));
+    e.arena.fixed = 1;
+    TL_TEST(e.arena.n_free > 0);
+    Env_add_core(&e);
+    TL_TEST(e.arena.slabs->owned == 0);
+    TL_TEST(e.arena.slabs->next == NULL);
+    TL_TEST(repl_test(&e, &e.globals, "(* 2 (+ 1 2))", "6"));
+    TL_TEST(e.arena.slabs->next == NULL);
+    Env_destroy(&e);
+    dynalc_free(&da, mem);
+}
+
+void
+test_scope_lookup(void)
+{
+    Environment e;
+    VariableScope local = {0};
+    Variable* v;
+    expr* sym;
+    char name[32];
+    int i;
+    int found = 0;
+    tl_timer_s timer = {0, 0};
+    Env_new(&e);
+    Env_add_core(&e);
+
+    for (i = 0; i < 500; i++) {
+        sprintf(name, "global-%d", i);
+        Env_add_global(&e, name, real(&e, i));
+    }
+    TL_TEST(e.globals.slots != NULL);
+    TL_TEST(e.globals.n_slots * 3 >= Variables_len(&e.globals.variables) * 4);
+
+    tl_timer_start(&timer);
+    for (i = 0; i < 500; i++) {
+        sprintf(name, "global-%d", i);
+        sym = symbol(&e, name);
+        v = _find_variable(&e.globals, sym);
+        if (v != NULL && v->value->real == i)
+            found++;
+        variable_delete(&e, sym);
+    }
+    tl_timer_stop(&timer);
+    TL_TEST(found == 500);
+    printf("500 global lookups took %fs\n", timer.elapsed_sec);
+
+    sym = symbol(&e, "global-none");
+    TL_TEST(_find_variable(&e.globals, sym) == NULL);
+    variable_delete(&e, sym);
+
+    /*Locals shadow globals, and are searched before the outer scope*/
+    VariableScope_new(&e, &local, &e.globals);
+    Env_add_variable(&e, &local, "global-7", real(&e, -7));
+    TL_TEST(repl_test(&e, &local, "global-7", "-7"));
+    TL_TEST(repl_test(&e, &local, "global-8", "8"));
+    TL_TEST(repl_test(&e, &e.globals, "global-7", "7"));
+    TL_TEST(repl_test(&e, &e.globals, "(+ global-1 global-499)", "500"));
+    VariableScope_destroy(&e, &local);
+
+    Env_destroy(&e);
+}
+
+void
+test_buildin_resolve(void)
+{
+    Environment e;
+    Exception msg = {0};
+    expr* program;
+    expr* result;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    program = yal_read(&e, &e.globals, &msg, "(+ 1 (* 2 3))");
+    TL_TEST(car(program)->type == TYPE_SYMBOL);
+    result = eval_expr(&e, &e.globals, &msg, program);
+    TL_TEST(!Exception_is_error(&msg));
+    TL_TEST(expr_compare(result, "7"));
+
+    /*Call sites are resolved after their first evaluation, and left as
+      they were read*/
+    TL_TEST(program->buildin != 0 && third(program)->buildin != 0);
+    TL_TEST(_call_buildin(&e, program) == _find_buildin(&e, symbol(&e, "+")));
+    TL_TEST(car(program) == symbol(&e, "+"));
+    TL_TEST(expr_compare(program, "(+ 1 (* 2 3))"));
+    result = eval_expr(&e, &e.globals, &msg, program);
+    TL_TEST(!Exception_is_error(&msg));
+    TL_TEST(expr_compare(result, "7"));
+
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(fn square (v) (* v v))",
+                      "square"));
+    TL_TEST(repl_test(&e, &e.globals, "(square 4)", "16"));
+    TL_TEST(repl_test(&e, &e.globals, "(square 5)", "25"));
+    TL_TEST(repl_test(&e, &e.globals, "(fn? +)", "T"));
+
+    /*Programs can inspect forms that were evaluated*/
+    TL_TEST(repl_test(&e, &e.globals, "(var forms (list (list '+ 1 2)))", "forms"));
+    TL_TEST(repl_test(&e, &e.globals, "(macro run () forms)", "run"));
+    TL_TEST(repl_test(&e, &e.globals, "(run)", "3"));
+    TL_TEST(repl_test(&e, &e.globals, "(run)", "3"));
+    program = _find_variable(&e.globals, symbol(&e, "forms"))->value;
+    TL_TEST(car(car(program))->type == TYPE_SYMBOL);
+    TL_TEST(repl_test(&e, &e.globals, "(eq (car (car forms)) '+)", "T"));
+    Exception_destroy(&msg);
+    Env_destroy(&e);
+}
+
+void
+test_gc(void)
+{
+    Environment e;
+    expr* kept;
+    int i;
+    int peak = 0;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    TL_TEST(repl_test(&e, &e.globals, "(var weapons '(pistol lazergun shotgun))", "weapons"));
+    TL_TEST(repl_test(&e, &e.globals, "(fn square (v) (* v v))", "square"));
+    kept = cons(&e, real(&e, 42), cons(&e, NULL, NULL));
+    Env_gc_pin(&e, kept);
+
+    /*Garbage from earlier evaluations is reclaimed between evaluations*/
+    TL_TEST(Env_gc_run(&e, &e.globals) > 0);
+    for (i = 0; i < 200; i++) {
+        TL_TEST(repl_test(&e, &e.globals, "(len (range 0 100))", "100"));
+        if (e.arena.n_used > peak)
+            peak = e.arena.n_used;
+    }
+    printf("collections: %d, peak exprs in use: %d\n", e.gc.collections, peak);
+    TL_TEST(e.gc.collections > 1);
+    TL_TEST(peak < YAL_GC_THRESHOLD * 2);
+
+    TL_TEST(repl_test(&e, &e.globals, "weapons", "(pistol lazergun shotgun)"));
+    TL_TEST(repl_test(&e, &e.globals, "(square 12)", "144"));
+    TL_TEST(repl_test(&e, &e.globals, "PI", "3.141592"));
+    TL_TEST(expr_compare(kept, "(42)"));
+    Env_gc_unpin(&e, kept);
+
+    TL_TEST(repl_test(&e, &e.globals, "(gc-run)", "T"));
+    i = e.gc.collections;
+    TL_TEST(repl_test(&e, &e.globals, "(square 3)", "9"));
+    TL_TEST(e.gc.collections == i + 1);
+    Env_destroy(&e);
+}
+
+void
+test_symbol_interning(void)
+{
+    Environment e;
+    expr* a;
+    char name[32];
+    int used;
+    int i;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    /*Existing names allocate nothing and compare by pointer*/
+    a = symbol(&e, "weapon");
+    used = e.arena.n_used;
+    TL_TEST(symbol(&e, "weapon") == a);
+    TL_TEST(symbol(&e, "weapons") != a);
+    TL_TEST(e.arena.n_used == used + 1);
+    TL_TEST(symbol(&e, NULL) == symbol(&e, "NIL"));
+    TL_TEST(is_nil(symbol(&e, "nil")));
+    TL_TEST(is_nil(symbol(&e, "NIL")));
+    TL_TEST(!is_nil(symbol(&e, "nill")));
+
+    for (i = 0; i < 1000; i++) {
+        sprintf(name, "sym-%d", i);
+        symbol(&e, name);
+    }
+    TL_TEST(e.symbols.n_slots * 3 >= e.symbols.len * 4);
+    TL_TEST(symbol(&e, "sym-999") == symbol(&e, "sym-999"));
+    TL_TEST(symbol(&e, "weapon") == a);
+
+    TL_TEST(repl_test(&e, &e.globals, "(var w 'weapon)", "w"));
+    TL_TEST(repl_test(&e, &e.globals, "(= w 'weapon)", "T"));
+    TL_TEST(repl_test(&e, &e.globals, "(= w 'weapons)", "NIL"));
+    TL_TEST(repl_test(&e, &e.globals, "(quote t)", "T"));
+    TL_TEST(Env_gc_run(&e, &e.globals) >= 0);
+    TL_TEST(symbol(&e, "sym-10") == symbol(&e, "sym-10"));
+    TL_TEST(repl_test(&e, &e.globals, "w", "weapon"));
+    Env_destroy(&e);
+}
+
+void
+test_read_tokens(void)
+{
+    Environment e;
+    Token t;
+    int cursor = 0;
+    int symbols;
+    int used;
+    char* src = "('a [1 \"s s\"]\t'(b))";
+    char kinds[] = {TOKEN_OPEN, TOKEN_QUOTE, TOKEN_OPEN_LIST, TOKEN_ATOM,
+                    TOKEN_STRING, TOKEN_CLOSE, TOKEN_QUOTE_OPEN, TOKEN_ATOM,
+                    TOKEN_CLOSE, TOKEN_CLOSE, TOKEN_END};
+    int lengths[] = {1, 2, 1, 1, 5, 1, 2, 1, 1, 1, 0};
+    int i;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    /*Tokens are ranges into the source*/
+    for (i = 0; i < (int)sizeof(kinds); i++) {
+        t = _next_token(src, &cursor);
+        TL_TEST(t.kind == kinds[i] && t.length == lengths[i]);
+    }
+    cursor = 0;
+    t = _next_token("  \"unterminated", &cursor);
+    TL_TEST(t.kind == TOKEN_STRING && t.offset == 2 && t.length == 13);
+
+    TL_TEST(read_test(&e, &e.globals, src, "((quote a) (list 1 \"s s\") (quote (b)))"));
+    TL_TEST(repl_test(&e, &e.globals, "(+ 1 2) \n", "3"));
+
+    /*Reading known symbols again only allocates the list structure*/
+    TL_TEST(read_test(&e, &e.globals, "(fn add (a b) (+ a b))", "(fn add (a b) (+ a b))"));
+    symbols = e.symbols.len;
+    used = e.arena.n_used;
+    TL_TEST(read_test(&e, &e.globals, "(fn add (a b) (+ a b))", "(fn add (a b) (+ a b))"));
+    TL_TEST(e.symbols.len == symbols);
+    TL_TEST(e.arena.n_used - used == 14);
+    Env_destroy(&e);
+}
+
+void
+test_frame_calls(void)
+{
+    Environment e;
+    Exception msg = {0};
+    expr* call;
+    int used;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    TL_TEST(repl_test(&e, &e.globals, "(fn pick (a b) a)", "pick"));
+    TL_TEST(repl_test(&e, &e.globals, "(pick 1 2)", "1"));
+    TL_TEST(repl_test(&e, &e.globals, "((lambda (x y) (+ x y)) 3 4)", "7"));
+
+    /*Binding parameters does not allocate*/
+    call = yal_read(&e, &e.globals, &msg, "(pick 1 2)");
+    used = e.arena.n_used;
+    TL_TEST(eval_expr(&e, &e.globals, &msg, call)->real == 1);
+    TL_TEST(e.arena.n_used == used);
+    TL_TEST(e.frames.top == 0);
+    Exception_destroy(&msg);
+
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(fn fact (n) (if (= n 0) 1 (* n (fact (- n 1)))))",
+                      "fact"));
+    TL_TEST(repl_test(&e, &e.globals, "(fact 5)", "120"));
+    TL_TEST(e.frames.top == 0);
+
+    /*Frames are popped when a call fails*/
+    TL_TEST(exception_test(&e, &e.globals, "(pick 1)", EXCEPTION_INVALIDINPUT));
+    TL_TEST(e.frames.top == 0);
+    TL_TEST(exception_test(&e, &e.globals, "(pick 1 (car))", EXCEPTION_INVALIDINPUT));
+    TL_TEST(e.frames.top == 0);
+    Env_destroy(&e);
+
+    /*Calls deeper than the frame stack bind in their own scope*/
+    Env_new(&e);
+    Env_add_core(&e);
+    e.frames.len = 4;
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(fn fact (n) (if (= n 0) 1 (* n (fact (- n 1)))))",
+                      "fact"));
+    TL_TEST(repl_test(&e, &e.globals, "(fact 3)", "6"));
+    TL_TEST(repl_test(&e, &e.globals, "(fact 10)", "3628800"));
+    TL_TEST(e.frames.top == 0);
+    TL_TEST(repl_test(&e, &e.globals, "(fn pick (a b) a)", "pick"));
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(fn deep (n) (if (= n 0) (pick 1 (car)) (deep (- n 1))))",
+                      "deep"));
+    TL_TEST(exception_test(&e, &e.globals, "(deep 10)", EXCEPTION_INVALIDINPUT));
+    TL_TEST(e.frames.top == 0);
+    Env_destroy(&e);
+
+    /*Recursion deeper than the default frame stack*/
+    Env_new(&e);
+    Env_add_core(&e);
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(fn depth (n) (if (= n 0) 0 (+ 1 (depth (- n 1)))))",
+                      "depth"));
+    TL_TEST(repl_test(&e, &e.globals, "(depth 5000)", "5000"));
+    TL_TEST(e.frames.top == 0);
+    Env_destroy(&e);
+}
+
+void
+test_buildin_concat(void)
+{
+    Environment e;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(concat \"ab\" \"cd\")",
+                      "\"abcd\""));
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(concat \"\" \"a b\" \"\")",
+                      "\"a b\""));
+    TL_TEST(exception_test(&e, &e.globals, "(concat \"ab\" 1)", EXCEPTION_INVALIDINPUT));
+    Env_destroy(&e);
+}
+
+void
+test_optimize(void)
+{
+    Environment e;
+    Exception msg = {0};
+    expr* prg;
+    int used;
+    Env_new(&e);
+    Env_add_core(&e);
+
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(+ 1 (* 2 3) 0.5)"));
+    TL_TEST(expr_compare(prg, "7.500000"));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(fn f (n) (+ n (* 2 3)))"));
+    TL_TEST(expr_compare(prg, "(fn f (n) (+ n 6))"));
+    eval_expr(&e, &e.globals, &msg, prg);
+    TL_TEST(repl_test(&e, &e.globals, "(f 1)", "7"));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(progn (concat \"a\" \"b\"))"));
+    TL_TEST(expr_compare(prg, "\"ab\""));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(len (range 0 3))"));
+    TL_TEST(expr_compare(prg, "(len (quote (0 1 2)))"));
+    TL_TEST(expr_compare(eval_expr(&e, &e.globals, &msg, prg), "3"));
+
+    /*Quoted forms, failing calls and macro inputs are left as written*/
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(list '(+ 1 2) (range 3 1))"));
+    TL_TEST(expr_compare(prg, "(list (quote (+ 1 2)) (range 3 1))"));
+    TL_TEST(repl_test(&e, &e.globals, "(macro sq (x) (list (list '* x x)))", "sq"));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(sq (+ 1 2))"));
+    TL_TEST(expr_compare(prg, "(sq (+ 1 2))"));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(if nil (/ 1 0) (/ 0 2))"));
+    TL_TEST(expr_compare(prg, "(if NIL (/ 1 0) 0)"));
+    TL_TEST(expr_compare(eval_expr(&e, &e.globals, &msg, prg), "0"));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(if t 1 (/ 4 2 0.0))"));
+    TL_TEST(expr_compare(prg, "(if T 1 (/ 4 2 0.000000))"));
+
+    /*Parameter lists are not calls, even when named after pure buildins*/
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(fn twice (eq) (* eq 2))"));
+    TL_TEST(expr_compare(prg, "(fn twice (eq) (* eq 2))"));
+    eval_expr(&e, &e.globals, &msg, prg);
+    TL_TEST(repl_test(&e, &e.globals, "(twice 4)", "8"));
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "((lambda (not) (+ not 1)) 2)"));
+    TL_TEST(expr_compare(prg, "((lambda (not) (+ not 1)) 2)"));
+    TL_TEST(expr_compare(eval_expr(&e, &e.globals, &msg, prg), "3"));
+
+    /*A folded program allocates nothing when evaluated*/
+    prg = optimize(&e, yal_read(&e, &e.globals, &msg, "(progn (* (+ 1 2) (- 10 4)))"));
+    used = e.arena.n_used;
+    TL_TEST(expr_compare(eval_expr(&e, &e.globals, &msg, prg), "18"));
+    TL_TEST(e.arena.n_used == used);
+    TL_TEST(!Exception_is_error(&msg));
+    Exception_destroy(&msg);
+    Env_destroy(&e);
+}
+
+void
+test_allocator_hook(void)
+{
+    static uint8_t mem[ALC_MB_2_B(2)];
+    dynallocator da = {0};
+    Environment e;
+    Exception msg = {0};
+    expr* str;
+    dynalc_init(&da, region(mem, sizeof(mem)));
+
+    Env_new_with_allocator(&e, YalAllocator_dynalc(&da));
+    Env_add_core(&e);
+    TL_TEST(da.bookkeeper.curr > 0);
+    TL_TEST(repl_test(&e, &e.globals,
+                      "(fn fact (n) (if (= n 0) 1 (* n (fact (- n 1)))))",
+                      "fact"));
+    TL_TEST(repl_test(&e, &e.globals, "(fact 10)", "3628800"));
+    TL_TEST(exception_test(&e, &e.globals, "(fact)", EXCEPTION_INVALIDINPUT));
+
+    /*Expressions and the strings they own are in the region*/
+    str = eval_expr(&e, &e.globals, &msg, yal_read(&e, &e.globals, &msg, "(concat \"a\" \"b\")"));
+    TL_TEST((uint8_t*)str >= mem && (uint8_t*)str < mem + sizeof(mem));
+    TL_TEST((uint8_t*)str->string.c_str >= mem && (uint8_t*)str->string.c_str < mem + sizeof(mem));
+    TL_TEST(repl_test(&e, &e.globals, "(gc-run)", "T"));
+    TL_TEST(repl_test(&e, &e.globals, "(fact 3)", "6"));
+    TL_TEST(e.gc.collections > 0);
+    TL_TEST(!Exception_is_error(&msg));
+
+    /*Everything is given back when the environment is destroyed*/
+    Env_destroy(&e);
+    TL_TEST(da.bookkeeper.curr == 0);
+}
+
+void
+test_allocator_per_env(void)
+{
+    static uint8_t mem[ALC_MB_2_B(2)];
+    dynallocator da = {0};
+    Environment a;
+    Environment b;
+    Exception msg = {0};
+    expr* e;
+    tstr str;
+    dynalc_init(&da, region(mem, sizeof(mem)));
+    Env_new_with_allocator(&a, YalAllocator_dynalc(&da));
+    Env_add_core(&a);
+    Env_new(&b);
+    Env_add_core(&b);
+
+    /*Messages and strings for the host outlive the use of their environment*/
+    eval_expr(&a, &a.globals, &msg, yal_read(&a, &a.globals, &msg, "(car)"));
+    TL_TEST(Exception_is_error(&msg));
+    str = stringify(yal_read(&a, &a.globals, &msg, "(1 2)"), "(", ")");
+    TL_TEST(repl_test(&b, &b.globals, "(concat \"a\" \"b\")", "\"ab\""));
+    Exception_destroy(&msg);
+    tstr_destroy(&str);
+
+    /*Each environment allocates from its own allocator*/
+    e = eval_expr(&b, &b.globals, &msg, yal_read(&b, &b.globals, &msg, "(concat \"a\" \"b\")"));
+    TL_TEST(!((uint8_t*)e >= mem && (uint8_t*)e < mem + sizeof(mem)));
+    e = eval_expr(&a, &a.globals, &msg, yal_read(&a, &a.globals, &msg, "(concat \"a\" \"b\")"));
+    TL_TEST((uint8_t*)e->string.c_str >= mem && (uint8_t*)e->string.c_str < mem + sizeof(mem));
+    Env_destroy(&b);
+    TL_TEST(repl_test(&a, &a.globals, "(+ 1 2)", "3"));
+    Env_destroy(&a);
+    TL_TEST(da.bookkeeper.curr == 0);
+}
+
+char
+heapless_test(Environment* _env, char* _p, char* _gt)
+/*Only the reading and evaluating are counted, not the printing*/
+{
+    Exception msg = {0};
+    expr* result;
+    tstr str;
+    char are_equal;
+    sysheap_counting = 1;
+    result = eval_expr(_env, &_env->globals, &msg, yal_read(_env, &_env->globals, &msg, _p));
+    Exception_destroy(&msg);
+    sysheap_counting = 0;
+    str = stringify(result, "(", ")");
+    are_equal = strcmp(str.c_str, _gt) == 0;
+    if (!are_equal)
+        printf("%s = %s, expected %s\n", _p, str.c_str, _gt);
+    tstr_destroy(&str);
+    return are_equal;
+}
+
+void
+test_allocator_no_system_heap(void)
+{
+    static uint8_t mem[ALC_MB_2_B(2)];
+    dynallocator da = {0};
+    Environment e;
+    Exception msg = {0};
+    char program[32];
+    char name[8];
+    int i;
+    dynalc_init(&da, region(mem, sizeof(mem)));
+    Env_new_with_allocator(&e, YalAllocator_dynalc(&da));
+    Env_add_core(&e);
+
+    /*Evaluating on an environment with an allocator never calls malloc*/
+    sysheap_calls = 0;
+    TL_TEST(heapless_test(&e, "(eq 'a 'a)", "T"));
+    TL_TEST(heapless_test(&e, "(equal 1 1)", "T"));
+    TL_TEST(heapless_test(&e, "(eq '(1 (2 . \"b\")) '(1 (2 . \"b\")))", "T"));
+    TL_TEST(heapless_test(&e, "(eq 1.5 1.5 2.5)", "NIL"));
+    for (i = 0; i < 64; ++i) {
+        sprintf(program, "(global g%d %d)", i, i);
+        sprintf(name, "g%d", i);
+        TL_TEST(heapless_test(&e, program, name));
+    }
+    TL_TEST(heapless_test(&e, "(+ g0 g63)", "63"));
+    TL_TEST(heapless_test(&e, "(fn f (x) (+ x g63))", "f"));
+    TL_TEST(heapless_test(&e, "(f 1)", "64"));
+    sysheap_counting = 1;
+    eval_expr(&e, &e.globals, &msg, yal_read(&e, &e.globals, &msg, "(car (1 2))"));
+    sysheap_counting = 0;
+    TL_TEST(Exception_is_error(&msg));
+    TL_TEST((uint8_t*)msg.msg.c_str >= mem && (uint8_t*)msg.msg.c_str < mem + sizeof(mem));
+    Exception_destroy(&msg);
+    TL_TEST(sysheap_calls == 0);
+    Env_destroy(&e);
+    TL_TEST(da.bookkeeper.curr == 0);
+}
+
 int main(int argc, char **argv) {
 	(void)argc;
 	(void)argv;
@@ -1165,6 +1698,18 @@ int main(int argc, char **argv) {
 	TL(test_buildin_equality());
     TL(test_functions_and_recursion());
     TL(test_type_check());
+    TL(test_arena());
+    TL(test_scope_lookup());
+    TL(test_buildin_resolve());
+    TL(test_gc());
+    TL(test_symbol_interning());
+    TL(test_read_tokens());
+    TL(test_frame_calls());
+    TL(test_buildin_concat());
+    TL(test_optimize());
+    TL(test_allocator_hook());
+    TL(test_allocator_per_env());
+    TL(test_allocator_no_system_heap());
 
     tl_summary();
 
@@ -38,6 +38,34 @@ For more information, please refer to
         - variable defines
         Fixed Tokenization of quotes and arrays
         Added most of the standard functions that needs to be implemented.
+- [0.3] Replaced per expression malloc with a slab arena and free list,
+        optionally backed by user provided memory regions.
+        Variable scopes are indexed by an open addressed hash table on the
+        symbol hash, which is precomputed when symbols are created.
+        Call forms remember the buildin they resolved to on their first
+        evaluation.
+        Added a mark and sweep garbage collector, running between top level
+        evaluations.
+        Symbols are interned in a per environment symbol table, and compared
+        by pointer.
+        Rewrote the reader as a single pass parser over (offset, length, kind)
+        tokens that point into the source.
+        Function, lambda and macro calls bind their parameters into slots on
+        a preallocated frame stack, without copying arguments. Calls nested
+        deeper than the frame stack bind them in their own scope.
+        Added the concat buildin, and a benchmark suite shared with yalpp.
+        Added optimize(), an optional pass over yal_read() results that folds
+        calls to pure buildins with constant inputs, expands range with
+        constant bounds and collapses single form progn.
+        Every allocation an environment makes, its expressions, tables,
+        tsarray arrays, strings and exception messages, goes through the
+        YalAllocator of that environment, evaluating never calls malloc.
+        Only stringify() results are on the system heap, for the host.
+        eq and equal compare without printing, debug prints need YAL_DEBUG.
+        An adapter for dynallocator is given if allocator.h is included
+        before yal.h.
+        Renamed read() to yal_read(), read() clashed with the POSIX read()
+        from unistd.h.
 - [0.1] Created AST structure and imported base lib functionality.
 - [0.0] Initialized library.
 */
@@ -53,7 +81,6 @@ http://www.ulisp.com/show?1BLW
 */
 
 /*Major todos*/
-/*TODO: proper memory management & garbage collection (with info stats)*/
 /*TODO: READ EVAL PRINT functionality so we can go full-circle and load files*/
 /*TODO: Conditionals: and or not*/
 /*TODO: scopes with let* */
@@ -84,10 +111,69 @@ http://www.ulisp.com/show?1BLW
 #include <stdint.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #include "vendor/alloc.h"
 //#include "vendor/error.h"
 
+/*Routes allocations to a user provided context, eg. a fixed memory region.
+  A zeroed allocator uses the system heap. The allocator must hand out memory
+  aligned for any type, as expression slabs are allocated through it.
+  Each environment keeps its own, and everything allocated for it is given to
+  the helpers below along with the allocator it came from.*/
+typedef struct {
+    void* ctx;
+    void* (*alloc)(void* _ctx, size_t _n);
+    void* (*resize)(void* _ctx, void* _p, size_t _n);
+    void (*release)(void* _ctx, void* _p);
+}YalAllocator;
+
+/*A NULL allocator is the system heap too*/
+void*
+_yal_malloc(YalAllocator* _a, size_t _n)
+{
+    if (_a == NULL || _a->alloc == NULL)
+        return malloc(_n);
+    return _a->alloc(_a->ctx, _n);
+}
+
+void*
+_yal_realloc(YalAllocator* _a, void* _p, size_t _n)
+{
+    if (_a == NULL || _a->resize == NULL)
+        return realloc(_p, _n);
+    return _a->resize(_a->ctx, _p, _n);
+}
+
+void
+_yal_free(YalAllocator* _a, void* _p)
+{
+    if (_p == NULL)
+        return;
+    if (_a == NULL || _a->release == NULL) {
+        free(_p);
+        return;
+    }
+    _a->release(_a->ctx, _p);
+}
+
+void*
+_yal_calloc(YalAllocator* _a, size_t _c, size_t _n)
+{
+    void* p = _yal_malloc(_a, _c * _n);
+    if (p != NULL)
+        memset(p, 0, _c * _n);
+    return p;
+}
+
+/*Arrays keep the allocator of the environment they belong to*/
+#define TSARRAY_NO_STDLIB
+#define TSARRAY_ALLOCATOR YalAllocator
+#define TSARRAY_MALLOC(a, n) _yal_malloc(a, n)
+#define TSARRAY_REALLOC(a, p, n) _yal_realloc(a, p, n)
+#define TSARRAY_FREE(a, p) _yal_free(a, p)
+
 #define TSTR_IMPLEMENTATION
 #include "vendor/tstr.h"
 
@@ -100,8 +186,12 @@ http://www.ulisp.com/show?1BLW
         tstr_destroy(&name);                                    \
     } while (0)
 
+#ifdef YAL_DEBUG
 #define DBPRINT(before, expr) \
     WITH_STRINGEXPR(dbexpr, (expr), printf(before); printexpr(expr);  printf("\n");)
+#else
+#define DBPRINT(before, expr) do { } while (0)
+#endif /*YAL_DEBUG*/
 
 enum TYPE {
     TYPE_CONS = 0,
@@ -134,8 +224,22 @@ enum EXCEPTION {
     EXCEPTION_COUNT
 };
 
+/*Forward declarations*/
+typedef struct expr expr;
+typedef struct Environment Environment;
+typedef struct VariableScope VariableScope;
+typedef struct Exception Exception;
+typedef expr*(*buildin_fn)(Environment*, VariableScope*, Exception*, expr*);
+
 struct expr {
     uint8_t type;
+    /*Set while the garbage collector marks reachable expressions*/
+    uint8_t mark;
+    /*Call forms cache the index of the buildin they resolved to, plus one.
+      0 means not resolved yet*/
+    uint16_t buildin;
+    /*Precomputed symbol hash, used for variable lookup*/
+    uint32_t hash;
     union {
         /*Value atom*/
         union {
@@ -155,15 +259,48 @@ struct expr {
         };
     };
 };
-typedef struct expr expr;
+
+/*Expressions are handed out from fixed size slabs, freed expressions are
+  linked into a free list through their car, so taking and returning is O(1).*/
+#ifndef YAL_ARENA_SLAB_LEN
+#define YAL_ARENA_SLAB_LEN 256
+#endif /*YAL_ARENA_SLAB_LEN*/
+
+/*type of an expression that currently sits in the free list*/
+#define _EXPR_FREE 0xFF
+
+typedef struct exprSlab exprSlab;
+struct exprSlab {
+    exprSlab* next;
+    int len;
+    char owned;
+    expr exprs[];
+};
 
 typedef struct {
+    /*Allocator of the environment, slabs are taken from it*/
+    YalAllocator* allocator;
+    exprSlab* slabs;
+    expr* freelist;
+    int n_free;
+    int n_used;
+    /*Expressions handed out since creation*/
+    long n_taken;
+    /*If set, the arena never mallocs, and only uses regions given to it*/
+    char fixed;
+}exprArena;
+
+struct Exception {
     char type;
+    /*Allocated by the environment that threw, so destroy exceptions before
+      their environment*/
     tstr msg;
-}Exception;
+    YalAllocator* allocator;
+};
 
 typedef struct {
-    tstr symbol;
+    /*Interned symbol*/
+    expr* symbol;
     expr* value;
 }Variable;
 
@@ -171,31 +308,78 @@ typedef struct {
 #define arr_t_name Variables
 #include "vendor/tsarray.h"
 
-/*Forward declarations*/
-typedef struct Environment Environment;
-typedef struct VariableScope VariableScope;
-typedef expr*(*buildin_fn)(Environment*, VariableScope*, Exception*, expr*);
+/*Scopes with fewer variables than this are searched linearly*/
+#ifndef YAL_SCOPE_HASH_MIN
+#define YAL_SCOPE_HASH_MIN 8
+#endif /*YAL_SCOPE_HASH_MIN*/
 
 struct VariableScope {
     VariableScope* outer;
+    /*Parameters of a call, bound in slots on the frame stack*/
+    Variable* frame;
+    int frame_len;
     Variables variables;
+    /*Open addressed index into variables, holds index+1 and 0 when empty*/
+    int* slots;
+    int n_slots;
 };
 
+#define t_type expr*
+#define arr_t_name exprStack
+#include "vendor/tsarray.h"
+
+/*Collection happens when a top level evaluation starts with at least this
+  many expressions in use*/
+#ifndef YAL_GC_THRESHOLD
+#define YAL_GC_THRESHOLD 4096
+#endif /*YAL_GC_THRESHOLD*/
+
+/*Amount of parameter slots available to nested calls*/
+#ifndef YAL_FRAME_STACK_LEN
+#define YAL_FRAME_STACK_LEN 4096
+#endif /*YAL_FRAME_STACK_LEN*/
+
+typedef struct {
+    Variable* slots;
+    int top;
+    int len;
+}FrameStack;
+
+typedef struct {
+    /*Host held expressions that must survive collection*/
+    exprStack pinned;
+    int threshold;
+    int collections;
+    int eval_depth;
+    char pending;
+}GarbageCollector;
+
+/*Open addressed table of interned symbols, keyed on the symbol hash*/
+typedef struct {
+    expr** slots;
+    int n_slots;
+    int len;
+}SymbolTable;
+
 typedef struct {
     const char* name;
     buildin_fn fn;
+    /*Interned name, call forms check their cached buildin against it*/
+    expr* symbol;
+    /*Result only depends on the inputs, so constant calls can be folded*/
+    char pure;
 }Buildin;
 
 #define t_type Buildin
 #define arr_t_name Buildins
 #include "vendor/tsarray.h"
 
-#define t_type expr*
-#define arr_t_name exprStack
-#include "vendor/tsarray.h"
-
 struct Environment {
-    exprStack in_use;
+    YalAllocator allocator;
+    exprArena arena;
+    GarbageCollector gc;
+    SymbolTable symbols;
+    FrameStack frames;
     Buildins buildins;
     VariableScope constants;
     VariableScope globals;
@@ -208,25 +392,25 @@ struct Environment {
 #define UNIMPLEMENTED(fun) assert(0 && "UNIMPLEMENTED: " && fun)
 
 #define THROW_ARGEVALFAIL(msgdst, fnsym, args)             \
-    _throw_error(msgdst, fnsym, EXCEPTION_INVALIDARGEVAL, "Could not evaluate arguments.", args)
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_INVALIDARGEVAL, "Could not evaluate arguments.", args)
 
 #define THROW_INVALIDINPUT(msgdst, fnsym, expected, args)                     \
-    _throw_error(msgdst, fnsym, EXCEPTION_INVALIDINPUT, expected, args)
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_INVALIDINPUT, expected, args)
 
 #define THROW_INVALIDSYMBOL(msgdst, fnsym, args)               \
-    _throw_error(msgdst, fnsym, EXCEPTION_SYMNOTFOUND, "Symbol does not exist", args)
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_SYMNOTFOUND, "Symbol does not exist", args)
 
 #define THROW_INVALIDFUNCTION(msgdst, fnsym, args)               \
-    _throw_error(msgdst, fnsym, EXCEPTION_FNNOTFOUND, "Function does not exist", args)
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_FNNOTFOUND, "Function does not exist", args)
 
 #define THROW_INVALIDTYPE(msgdst, fnsym, type, args)                    \
-    _throw_error(msgdst, fnsym, EXCEPTION_NOTAVALUE, "Invalid type, expected " #type, args)
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_NOTAVALUE, "Invalid type, expected " #type, args)
 
 #define THROW_NONVALUEARG(msgdst, fnsym, args)               \
-    _throw_error(msgdst, fnsym, EXCEPTION_NOTAVALUE, "Not a value", args)
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_NOTAVALUE, "Not a value", args)
 
 #define THROW_NOTIMPLEMENTED(msgdst, fnsym)               \
-    _throw_error(msgdst, fnsym, EXCEPTION_NOTIMPLEMENTED, "called function is not implemented", NIL())
+    _throw_error(_env, msgdst, fnsym, EXCEPTION_NOTIMPLEMENTED, "called function is not implemented", NIL())
 
 #define RETURN_ON_EXCEPTION(msgdst, ret) \
     do { if (Exception_is_error(msgdst)) return ret; } while (0)
@@ -256,16 +440,30 @@ void Exception_destroy(Exception* _msg);
 
 /*Environment Management*/
 Environment* Env_new(Environment* _env);
+Environment* Env_new_with_allocator(Environment* _env, YalAllocator _allocator);
 void Env_destroy(Environment* _env);
 void Env_add_buildin(Environment* _env, const char* _name, buildin_fn _fn);
+void Env_add_pure_buildin(Environment* _env, const char* _name, buildin_fn _fn);
 void Env_add_constant(Environment* _env, const char* _name, expr* _value);
 void Env_add_global(Environment* _env, const char* _name, expr* _value);
 void Env_add_variable(Environment* _env, VariableScope* _scope, const char* _name, expr* value);
 void Env_add_core(Environment* _env);
 
+/*Arena Management*/
+char exprArena_add_region(exprArena* _a, void* _mem, uint32_t _len);
+expr* exprArena_take(exprArena* _a);
+void exprArena_return(exprArena* _a, expr* _e);
+void exprArena_destroy(exprArena* _a);
+
+/*Garbage Collection*/
+int Env_gc_run(Environment* _env, VariableScope* _scope);
+void Env_gc_pin(Environment* _env, expr* _e);
+void Env_gc_unpin(Environment* _env, expr* _e);
+
 /*Scope Management*/
 VariableScope* VariableScope_new(Environment* _env, VariableScope* _this, VariableScope* _outer);
 void VariableScope_destroy(Environment* _env, VariableScope* _scope);
+void VariableScope_add(VariableScope* _scope, Variable _v);
 
 /*Global Vars*/
 expr* NIL(void);
@@ -302,8 +500,9 @@ expr* string(Environment* _env, char* _v);
 expr* put(Environment* _env, expr* _val, expr* _list);
 
 /*Core*/
-expr* read(Environment* _env, VariableScope* _scope, Exception* _throwdst, char* _program_str);
+expr* yal_read(Environment* _env, VariableScope* _scope, Exception* _throwdst, char* _program_str);
 expr* eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* optimize(Environment* _env, expr* _in);
 expr* list(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 
 /*Buildins*/
@@ -314,6 +513,7 @@ expr* buildin_car(Environment* _env, VariableScope* _scope, Exception* _throwdst
 expr* buildin_cons(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_list(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_len(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_concat(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_first(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_second(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_third(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
@@ -336,29 +536,86 @@ expr* buildin_put(Environment* _env, VariableScope* _scope, Exception* _throwdst
 expr* buildin_reverse(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_progn(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr* buildin_apply(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_cond(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_letstar(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_try(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_catch(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_defmacro(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_deffn(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
+expr* buildin_deflambda(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 
 
 /******************************************************************************/
 #define YAL_IMPLEMENTATION
 #ifdef YAL_IMPLEMENTATION
 
+/*Interned symbols with these names point at these exact strings, so they are
+  recognized with a pointer compare*/
+static char _YAL_SYM_NIL[] = "NIL";
+static char _YAL_SYM_nil[] = "nil";
+static char _YAL_SYM_T[] = "T";
+static char _YAL_SYM_t[] = "t";
+
+tstr
+_yal_strfmt(YalAllocator* _a, const char* _fmt, ...)
+/*tstr_fmt() through an allocator*/
+{
+    tstr out = {0};
+    va_list va1;
+    va_list va2;
+    va_start(va1, _fmt);
+    va_start(va2, _fmt);
+    out.maxlen = 1 + vsnprintf(NULL, 0, _fmt, va1);
+    va_end(va1);
+    out.c_str = (char*)_yal_malloc(_a, out.maxlen);
+    if (out.c_str == NULL)
+        ASSERT_NOMOREMEMORY();
+    vsnprintf(out.c_str, out.maxlen, _fmt, va2);
+    va_end(va2);
+    return out;
+}
+
 void
-_throw_error(Exception* _dst,
+_yal_strappend(YalAllocator* _a, tstr* _dst, const char* _s)
+/*Append to a string allocated by the same allocator, growing it by doubling*/
+{
+    int n = (_dst->c_str != NULL) ? (int)strlen(_dst->c_str) : 0;
+    int m = (int)strlen(_s);
+    int maxlen = (_dst->maxlen > 16) ? _dst->maxlen : 16;
+    if (_dst->c_str == NULL || n + m + 1 > _dst->maxlen) {
+        while (maxlen < n + m + 1)
+            maxlen *= 2;
+        _dst->c_str = (char*)_yal_realloc(_a, _dst->c_str, maxlen);
+        if (_dst->c_str == NULL)
+            ASSERT_NOMOREMEMORY();
+        _dst->maxlen = maxlen;
+    }
+    memcpy(_dst->c_str + n, _s, m + 1);
+}
+
+tstr _stringify(YalAllocator* _a, expr* _args, const char* _open, const char* _close);
+
+void
+_throw_error(Environment* _env,
+             Exception* _dst,
              const char* _fnsym,
              char _type,
              const char* _msg,
              expr* _expr)
+/*The message is allocated by the environment, like everything else it
+  allocates while evaluating*/
 {
-    tstr msg;
+    YalAllocator* a = &_env->allocator;
+    tstr str;
     if (_dst == NULL)
         return;
 
-    WITH_STRINGEXPR(str, _expr,
-                    msg = tstr_fmt("(%s) %s, %s\n", _fnsym, _msg, str.c_str);
-                    tstr_destroy(&_dst->msg);
-                    _dst->type = _type;
-                    _dst->msg = msg;
-        );
+    str = _stringify(a, _expr, "(", ")");
+    _yal_free(_dst->allocator, _dst->msg.c_str);
+    _dst->msg = _yal_strfmt(a, "(%s) %s, %s\n", _fnsym, _msg, str.c_str);
+    _dst->allocator = a;
+    _dst->type = _type;
+    _yal_free(a, str.c_str);
 }
 
 const char*
@@ -404,14 +661,33 @@ Exception_destroy(Exception* _dst)
 {
      if (_dst == NULL)
         return;
-     tstr_destroy(&_dst->msg);
+     _yal_free(_dst->allocator, _dst->msg.c_str);
+     _dst->msg = (tstr){0};
+     _dst->allocator = NULL;
      _dst->type = EXCEPTION_OK;
 }
 
 Environment*
 Env_new(Environment* _env)
+{
+    return Env_new_with_allocator(_env, (YalAllocator){0});
+}
+
+Environment*
+Env_new_with_allocator(Environment* _env, YalAllocator _allocator)
+/*Every allocation made for the environment goes through the given allocator,
+  and the allocator must outlive the environment. Arrays and the arena point
+  at the allocator in the environment, so it must not be moved.*/
 {
     *_env = (Environment){0};
+    _env->allocator = _allocator;
+    _env->arena.allocator = &_env->allocator;
+    _env->gc.pinned.allocator = &_env->allocator;
+    _env->buildins.allocator = &_env->allocator;
+    _env->constants.variables.allocator = &_env->allocator;
+    _env->globals.variables.allocator = &_env->allocator;
+    _env->gc.threshold = YAL_GC_THRESHOLD;
+    _env->frames.len = YAL_FRAME_STACK_LEN;
     /*TODO: 30 is a arbitrary number, change when you know size of buildins*/
     //exprStack_initn(&_env->in_use, 30);
     //Buildins_initn(&_env->buildins, 30);
@@ -421,18 +697,124 @@ Env_new(Environment* _env)
 }
 
 void
-variable_delete(Environment* _env, expr* _atom)
+_exprArena_link(exprArena* _a, exprSlab* _slab)
 {
-    ASSERT_INV_ENV(_env);
-    if (_atom == NULL || _atom == NIL())
+    int i;
+    _slab->next = _a->slabs;
+    _a->slabs = _slab;
+    /*Push in reverse so expressions are handed out in address order*/
+    for (i = _slab->len - 1; i >= 0; i--) {
+        _slab->exprs[i].type = _EXPR_FREE;
+        _slab->exprs[i].car = _a->freelist;
+        _a->freelist = &_slab->exprs[i];
+    }
+    _a->n_free += _slab->len;
+}
+
+char
+exprArena_add_region(exprArena* _a, void* _mem, uint32_t _len)
+/*Hand a block of memory to the arena, eg. from dynalc_malloc() or a
+  blkallocator block. The memory must outlive the arena.*/
+{
+    uintptr_t start;
+    uintptr_t end;
+    exprSlab* slab;
+    if (_a == NULL || _mem == NULL)
+        return 0;
+    start = ((uintptr_t)_mem + sizeof(void*) - 1) & ~(uintptr_t)(sizeof(void*) - 1);
+    end = (uintptr_t)_mem + _len;
+    if (end < start + sizeof(exprSlab) + sizeof(expr))
+        return 0;
+    slab = (exprSlab*)start;
+    slab->len = (end - start - sizeof(exprSlab)) / sizeof(expr);
+    slab->owned = 0;
+    _exprArena_link(_a, slab);
+    return 1;
+}
+
+expr*
+exprArena_take(exprArena* _a)
+{
+    expr* e;
+    exprSlab* slab;
+    if (_a->freelist == NULL) {
+        if (_a->fixed)
+            return NULL;
+        slab = (exprSlab*)_yal_malloc(_a->allocator,
+                                      sizeof(exprSlab) + sizeof(expr) * YAL_ARENA_SLAB_LEN);
+        if (slab == NULL)
+            return NULL;
+        slab->len = YAL_ARENA_SLAB_LEN;
+        slab->owned = 1;
+        _exprArena_link(_a, slab);
+    }
+    e = _a->freelist;
+    _a->freelist = e->car;
+    _a->n_free--;
+    _a->n_used++;
+    _a->n_taken++;
+    *e = (expr) {0};
+    return e;
+}
+
+void
+exprArena_return(exprArena* _a, expr* _e)
+{
+    if (_e == NULL || _e->type == _EXPR_FREE)
         return;
-    //DBPRINT("variable_deleting: ", _atom);
+    _e->type = _EXPR_FREE;
+    _e->car = _a->freelist;
+    _a->freelist = _e;
+    _a->n_free++;
+    _a->n_used--;
+}
+
+void
+exprArena_destroy(exprArena* _a)
+{
+    exprSlab* slab;
+    exprSlab* next;
+    if (_a == NULL)
+        return;
+    for (slab = _a->slabs; slab != NULL; slab = next) {
+        next = slab->next;
+        if (slab->owned)
+            _yal_free(_a->allocator, slab);
+    }
+    _a->slabs = NULL;
+    _a->freelist = NULL;
+    _a->n_free = 0;
+    _a->n_used = 0;
+}
+
+tstr
+_yal_tstr_n(Environment* _env, const char* _s, int _n)
+/*Copy of the first _n characters for an expression to own, it is allocated
+  from the environment and released by _variable_release()*/
+{
+    tstr out = {0};
+    out.c_str = (char*)_yal_malloc(&_env->allocator, _n + 1);
+    if (out.c_str == NULL)
+        ASSERT_NOMOREMEMORY();
+    _rawstr_ncopy((char*)_s, out.c_str, _n);
+    out.c_str[_n] = '\0';
+    out.maxlen = _n + 1;
+    return out;
+}
+
+void
+_variable_release(Environment* _env, expr* _atom)
+{
     switch (_atom->type) {
     case TYPE_SYMBOL:
-        tstr_destroy(&_atom->symbol);
+        if (!_atom->symbol.is_view)
+            _yal_free(&_env->allocator, _atom->symbol.c_str);
+        _atom->symbol = (tstr){0};
         break;
     case TYPE_STRING:
-        tstr_destroy(&_atom->string);
+        if (!_atom->string.is_view)
+            _yal_free(&_env->allocator, _atom->string.c_str);
+        _atom->string = (tstr){0};
         break;
     case TYPE_FUNCTION:
     case TYPE_MACRO:
@@ -445,40 +827,48 @@ variable_delete(Environment* _env, expr* _atom)
     default:
         break;
     };
+}
 
-    int i;
-    int n = exprStack_len(&_env->in_use);
-    for (i = 0; i < n; i++)
-        if (*exprStack_peek(&_env->in_use, i) == _atom)
-            exprStack_remove(&_env->in_use, i);
-    free(_atom);
+void
+variable_delete(Environment* _env, expr* _atom)
+{
+    ASSERT_INV_ENV(_env);
+    if (_atom == NULL || _atom == NIL())
+        return;
+    /*Interned symbols belong to the symbol table*/
+    if (_atom->type == TYPE_SYMBOL)
+        return;
+    //DBPRINT("variable_deleting: ", _atom);
+    _variable_release(_env, _atom);
+    exprArena_return(&_env->arena, _atom);
 }
 
 void
 Env_destroy(Environment* _env)
 {
-    expr* tmp;
+    exprSlab* slab;
     int i;
-    int n;
     if (_env == NULL)
         return;
     Buildins_destroy(&_env->buildins);
     VariableScope_destroy(_env, &_env->globals);
     VariableScope_destroy(_env, &_env->constants);
+    exprStack_destroy(&_env->gc.pinned);
+    _yal_free(&_env->allocator, _env->symbols.slots);
+    _yal_free(&_env->allocator, _env->frames.slots);
 
-    n = exprStack_len(&_env->in_use);
-    for (i = 0; i < n; i++) {
-        tmp = exprStack_pop(&_env->in_use);
-        if (tmp != NULL)
-            variable_delete(_env, tmp);
-    }
-    exprStack_destroy(&_env->in_use);
+    for (slab = _env->arena.slabs; slab != NULL; slab = slab->next)
+        for (i = 0; i < slab->len; i++)
+            if (slab->exprs[i].type != _EXPR_FREE)
+                _variable_release(_env, &slab->exprs[i]);
+    exprArena_destroy(&_env->arena);
 }
 
 VariableScope*
 VariableScope_new(Environment* _env, VariableScope* _this, VariableScope* _outer)
 {
     VariableScope_destroy(_env, _this);
+    _this->variables.allocator = &_env->allocator;
     Variables_initn(&_this->variables, 1);
     _this->outer = _outer;
     return _this;
@@ -488,17 +878,88 @@ void
 VariableScope_destroy(Environment* _env, VariableScope* _scope)
 {
     UNUSED(_env);
+    /*NOTE: Values can outlive their scope, they are left to the garbage collector*/
+    Variables_destroy(&_scope->variables);
+    _yal_free(_scope->variables.allocator, _scope->slots);
+    _scope->slots = NULL;
+    _scope->n_slots = 0;
+    _scope->frame = NULL;
+    _scope->frame_len = 0;
+    _scope->outer = NULL;
+}
+
+void
+_VariableScope_index(VariableScope* _scope, int _i)
+{
+    uint32_t mask = _scope->n_slots - 1;
+    uint32_t h = Variables_peek(&_scope->variables, _i)->symbol->hash & mask;
+    /*Duplicates land later in the probe sequence, so the oldest one is found
+      first, same as a linear search*/
+    while (_scope->slots[h] != 0)
+        h = (h + 1) & mask;
+    _scope->slots[h] = _i + 1;
+}
+
+void
+_VariableScope_rehash(VariableScope* _scope, int _n_slots)
+{
     int i;
-    Variable tmp;
     int n = Variables_len(&_scope->variables);
-    for (i = 0; i < n; i++) {
-        tmp = Variables_pop(&_scope->variables);
-        /*NOTE: We cannot destroy the variables created in the scope, as they can be returned*/
-        //variable_delete(_env, tmp.value);
-        tstr_destroy(&tmp.symbol);
+    /*The index is allocated like the variables it indexes*/
+    _yal_free(_scope->variables.allocator, _scope->slots);
+    _scope->slots = (int*)_yal_calloc(_scope->variables.allocator, _n_slots, sizeof(int));
+    if (_scope->slots == NULL)
+        ASSERT_NOMOREMEMORY();
+    _scope->n_slots = _n_slots;
+    for (i = 0; i < n; i++)
+        _VariableScope_index(_scope, i);
+}
+
+void
+VariableScope_add(VariableScope* _scope, Variable _v)
+{
+    int n;
+    ASSERT_INV_SCOPE(_scope);
+    Variables_push(&_scope->variables, _v);
+    n = Variables_len(&_scope->variables);
+    if (_scope->slots == NULL) {
+        if (n >= YAL_SCOPE_HASH_MIN)
+            _VariableScope_rehash(_scope, YAL_SCOPE_HASH_MIN * 4);
+    }
+    else if (n * 4 > _scope->n_slots * 3)
+        _VariableScope_rehash(_scope, _scope->n_slots * 2);
+    else
+        _VariableScope_index(_scope, n - 1);
+}
+
+Variable*
+_VariableScope_lookup(VariableScope* _scope, expr* _sym)
+{
+    Variable* variable = NULL;
+    uint32_t mask;
+    uint32_t h;
+    int i;
+    int n;
+    /*Parameters are bound before anything defined in the body*/
+    for (i = 0; i < _scope->frame_len; i++)
+        if (_scope->frame[i].symbol == _sym)
+            return &_scope->frame[i];
+    if (_scope->slots == NULL) {
+        n = Variables_len(&_scope->variables);
+        for (i = 0; i < n; i++) {
+            variable = Variables_peek(&_scope->variables, i);
+            if (variable->symbol == _sym)
+                return variable;
+        }
+        return NULL;
     }
-    Variables_destroy(&_scope->variables);
-    _scope->outer = NULL;
+    mask = _scope->n_slots - 1;
+    for (h = _sym->hash & mask; _scope->slots[h] != 0; h = (h + 1) & mask) {
+        variable = Variables_peek(&_scope->variables, _scope->slots[h] - 1);
+        if (variable->symbol == _sym)
+            return variable;
+    }
+    return NULL;
 }
 
 /*the global nil object, so we dont have to allocate a bunch of them at runtime*/
@@ -512,6 +973,104 @@ NIL(void)
     return &_NIL_VALUE;
 }
 
+void
+_gc_mark(expr* _e)
+{
+    /*Recurse on car and loop on cdr, so long lists do not eat the stack*/
+    while (_e != NULL && _e != &_NIL_VALUE && !_e->mark) {
+        _e->mark = 1;
+        switch (_e->type) {
+        case TYPE_CONS:
+            _gc_mark(_e->car);
+            _e = _e->cdr;
+            break;
+        case TYPE_FUNCTION:
+        case TYPE_MACRO:
+        case TYPE_LAMBDA:
+            _gc_mark(_e->callable.binds);
+            _e = _e->callable.body;
+            break;
+        default:
+            return;
+        };
+    }
+}
+
+void
+_gc_mark_scope(VariableScope* _scope)
+{
+    int i;
+    for (; _scope != NULL; _scope = _scope->outer) {
+        for (i = 0; i < _scope->frame_len; i++)
+            _gc_mark(_scope->frame[i].value);
+        for (i = 0; i < Variables_len(&_scope->variables); i++)
+            _gc_mark(Variables_peek(&_scope->variables, i)->value);
+    }
+}
+
+int
+Env_gc_run(Environment* _env, VariableScope* _scope)
+/*Collect every expression not reachable from constants, globals, buildins,
+  interned symbols, pinned expressions or the given scope chain. Must not be called while an
+  evaluation is in progress, as temporaries on the C stack are not roots.
+  Returns the amount of expressions freed.*/
+{
+    exprSlab* slab;
+    expr* e;
+    int freed = 0;
+    int i;
+    ASSERT_INV_ENV(_env);
+    _gc_mark_scope(&_env->constants);
+    _gc_mark_scope(&_env->globals);
+    _gc_mark_scope(_scope);
+    for (i = 0; i < Buildins_len(&_env->buildins); i++)
+        _gc_mark(Buildins_peek(&_env->buildins, i)->symbol);
+    for (i = 0; i < exprStack_len(&_env->gc.pinned); i++)
+        _gc_mark(*exprStack_peek(&_env->gc.pinned, i));
+    for (i = 0; i < _env->symbols.n_slots; i++)
+        _gc_mark(_env->symbols.slots[i]);
+
+    for (slab = _env->arena.slabs; slab != NULL; slab = slab->next) {
+        for (i = 0; i < slab->len; i++) {
+            e = &slab->exprs[i];
+            if (e->type == _EXPR_FREE)
+                continue;
+            if (e->mark) {
+                e->mark = 0;
+                continue;
+            }
+            variable_delete(_env, e);
+            freed++;
+        }
+    }
+    _env->gc.collections++;
+    _env->gc.pending = 0;
+    _env->gc.threshold = _env->arena.n_used * 2;
+    if (_env->gc.threshold < YAL_GC_THRESHOLD)
+        _env->gc.threshold = YAL_GC_THRESHOLD;
+    return freed;
+}
+
+void
+Env_gc_pin(Environment* _env, expr* _e)
+{
+    ASSERT_INV_ENV(_env);
+    exprStack_push(&_env->gc.pinned, _e);
+}
+
+void
+Env_gc_unpin(Environment* _env, expr* _e)
+{
+    int i;
+    ASSERT_INV_ENV(_env);
+    for (i = exprStack_len(&_env->gc.pinned) - 1; i >= 0; i--) {
+        if (*exprStack_peek(&_env->gc.pinned, i) == _e) {
+            exprStack_remove(&_env->gc.pinned, i);
+            return;
+        }
+    }
+}
+
 char
 is_nil(expr* _args)
 {
@@ -522,9 +1081,8 @@ is_nil(expr* _args)
     //return 1;
     //if (_args->type == TYPE_CONS && is_nil(car(_args)) && is_nil(cdr(_args)))
     //return 1;
-    if (_args->type == TYPE_SYMBOL && tstr_ok(&_args->symbol) && tstr_equalc(&_args->symbol, "nil"))
-        return 1;
-    if (_args->type == TYPE_SYMBOL && tstr_ok(&_args->symbol) && tstr_equalc(&_args->symbol, "NIL"))
+    if (_args->type == TYPE_SYMBOL &&
+        (_args->symbol.c_str == _YAL_SYM_nil || _args->symbol.c_str == _YAL_SYM_NIL))
         return 1;
 
     return 0;
@@ -629,12 +1187,9 @@ expr*
 _variable_new(Environment* _env)
 {
     ASSERT_INV_ENV(_env);
-    expr* e = (expr*)malloc(sizeof(*e));
+    expr* e = exprArena_take(&_env->arena);
     if (e == NULL)
         ASSERT_NOMOREMEMORY();
-    *e = (expr) {0};
-    printf("exprstack ptr %p\n", &_env->in_use);
-    exprStack_push(&_env->in_use, e);
     return e;
 }
 
@@ -702,6 +1257,7 @@ cons(Environment* _env, expr* _car, expr* _cdr)
     if (e == NULL)
         return NIL();
     e->type = TYPE_CONS;
+    e->buildin = 0;
     e->car = _car;
     e->cdr = _cdr;
     return e;
@@ -731,33 +1287,108 @@ decimal(Environment* _env, float _v)
     return e;
 }
 
+void
+_symbols_insert(SymbolTable* _t, expr* _sym)
+{
+    uint32_t mask = _t->n_slots - 1;
+    uint32_t h = _sym->hash & mask;
+    while (_t->slots[h] != NULL)
+        h = (h + 1) & mask;
+    _t->slots[h] = _sym;
+}
+
+void
+_symbols_rehash(Environment* _env, SymbolTable* _t, int _n_slots)
+{
+    int i;
+    expr** old = _t->slots;
+    int n_old = _t->n_slots;
+    _t->slots = (expr**)_yal_calloc(&_env->allocator, _n_slots, sizeof(expr*));
+    if (_t->slots == NULL)
+        ASSERT_NOMOREMEMORY();
+    _t->n_slots = _n_slots;
+    for (i = 0; i < n_old; i++)
+        if (old[i] != NULL)
+            _symbols_insert(_t, old[i]);
+    _yal_free(&_env->allocator, old);
+}
+
+char*
+_symbol_wellknown(const char* _name, int _n)
+{
+    char* wellknown[] = {_YAL_SYM_NIL, _YAL_SYM_nil, _YAL_SYM_T, _YAL_SYM_t};
+    int i;
+    for (i = 0; i < (int)(sizeof(wellknown) / sizeof(wellknown[0])); i++)
+        if (_rawstr_is_equal(wellknown[i], (char*)_name, _n) && wellknown[i][_n] == '\0')
+            return wellknown[i];
+    return NULL;
+}
+
+expr*
+_symbol_intern(Environment* _env, const char* _name, int _n)
+/*Find or create the symbol named by the first _n characters of _name*/
+{
+    SymbolTable* t = &_env->symbols;
+    uint32_t hash = (uint32_t)tstr_hashn(_name, _n);
+    uint32_t mask;
+    uint32_t h;
+    char* wellknown;
+    expr* e;
+    if (t->slots != NULL) {
+        mask = t->n_slots - 1;
+        for (h = hash & mask; t->slots[h] != NULL; h = (h + 1) & mask) {
+            e = t->slots[h];
+            if (e->hash == hash &&
+                _rawstr_is_equal(e->symbol.c_str, (char*)_name, _n) &&
+                e->symbol.c_str[_n] == '\0')
+                return e;
+        }
+    }
+    if (t->slots == NULL)
+        _symbols_rehash(_env, t, 64);
+    else if ((t->len + 1) * 4 > t->n_slots * 3)
+        _symbols_rehash(_env, t, t->n_slots * 2);
+
+    e = _variable_new(_env);
+    e->type = TYPE_SYMBOL;
+    wellknown = _symbol_wellknown(_name, _n);
+    if (wellknown != NULL)
+        e->symbol = tstr_view(wellknown);
+    else
+        e->symbol = _yal_tstr_n(_env, _name, _n);
+    e->hash = hash;
+    _symbols_insert(t, e);
+    t->len++;
+    return e;
+}
+
 expr*
 symbol(Environment* _env, char* _v)
 {
     ASSERT_INV_ENV(_env);
-    expr* e = _variable_new(_env);
-    if (e == NULL)
-        return NIL();
-    e->type = TYPE_SYMBOL;
     if (_v == NULL)
-        e->symbol = tstr_("NIL");
-    else
-        e->symbol = tstr_(_v);
-    return e;
+        _v = _YAL_SYM_NIL;
+    return _symbol_intern(_env, _v, _rawstr_findchar(_v, '\0'));
 }
 
 expr*
-string(Environment* _env, char* _v)
+_string_n(Environment* _env, const char* _v, int _n)
 {
     ASSERT_INV_ENV(_env);
     expr* e = _variable_new(_env);
     if (e == NULL)
         return NIL();
     e->type = TYPE_STRING;
-    e->string = tstr_(_v);
+    e->string = _yal_tstr_n(_env, _v, _n);
     return e;
 }
 
+expr*
+string(Environment* _env, char* _v)
+{
+    return _string_n(_env, _v, _rawstr_findchar(_v, '\0'));
+}
+
 
 expr*
 put(Environment* _env, expr* _val, expr* _list)
@@ -776,35 +1407,35 @@ printexpr(expr* _arg)
 
 
 tstr
-_stringify_value(expr* _arg)
+_stringify_value(YalAllocator* _a, expr* _arg)
 {
     if (is_nil(_arg))
-        return tstr_("NIL");
+        return _yal_strfmt(_a, "NIL");
 
     switch (_arg->type) {
     case TYPE_CONS:
-        return stringify(_arg, "(", ")");
+        return _stringify(_a, _arg, "(", ")");
     case TYPE_VECTOR:
-        return stringify(_arg, "{", "}");
+        return _stringify(_a, _arg, "{", "}");
     case TYPE_DICTIONARY:
-        return stringify(_arg, "#[", "]");
+        return _stringify(_a, _arg, "#[", "]");
     case TYPE_LAMBDA:
-        return tstr_("#<lambda>");
+        return _yal_strfmt(_a, "#<lambda>");
     case TYPE_MACRO:
-        return tstr_("#<macro>");
+        return _yal_strfmt(_a, "#<macro>");
     case TYPE_FUNCTION:
-        return tstr_("#<function>");
+        return _yal_strfmt(_a, "#<function>");
     case TYPE_REAL:
-        return tstr_from_int(_arg->real);
+        return _yal_strfmt(_a, "%d", _arg->real);
     case TYPE_DECIMAL:
-        return tstr_from_float(_arg->decimal);
+        return _yal_strfmt(_a, "%f", _arg->decimal);
     case TYPE_SYMBOL:
-        if (tstr_equalc(&_arg->symbol, "t") || tstr_equalc(&_arg->symbol, "T"))
-            return tstr_("T");
-        return tstr_(_arg->symbol.c_str);
+        if (_arg->symbol.c_str == _YAL_SYM_t || _arg->symbol.c_str == _YAL_SYM_T)
+            return _yal_strfmt(_a, "T");
+        return _yal_strfmt(_a, "%s", _arg->symbol.c_str);
     case TYPE_STRING:
         /*NOTE: The quotes are part of the string datatype now*/
-        return tstr_(_arg->string.c_str);
+        return _yal_strfmt(_a, "%s", _arg->string.c_str);
     default:
         printf("_stringify_value() Got invalid atom type! got %d\n", _arg->type);
         ASSERT_UNREACHABLE();
@@ -813,282 +1444,221 @@ _stringify_value(expr* _arg)
 }
 
 tstr
-stringify(expr* _args, const char* _open, const char* _close)
+_stringify(YalAllocator* _a, expr* _args, const char* _open, const char* _close)
+/*The string is allocated by _a, and released with _yal_free()*/
 {
     tstr dst = {0};
     expr* curr = _args;
     tstr currstr = {0};
-    tstr open = tstr_view(_open);
-    tstr close = tstr_view(_close);
-    tstr space = tstr_view(" ");
 
     if (_args == NULL)
-        return tstr_("NIL");
+        return _yal_strfmt(_a, "NIL");
     if (is_nil(_args))
-        return tstr_("NIL");
+        return _yal_strfmt(_a, "NIL");
 
     if (_args->type != TYPE_CONS)
-        return _stringify_value(curr);
+        return _stringify_value(_a, curr);
 
     if (is_dotted(_args)) {
-        tstr carstr = _stringify_value(car(_args));
-        tstr cdrstr = _stringify_value(cdr(_args));
-        dst = tstr_fmt("(%s . %s)", carstr.c_str, cdrstr.c_str);
-        tstr_destroy(&carstr);
-        tstr_destroy(&cdrstr);
+        tstr carstr = _stringify_value(_a, car(_args));
+        tstr cdrstr = _stringify_value(_a, cdr(_args));
+        dst = _yal_strfmt(_a, "(%s . %s)", carstr.c_str, cdrstr.c_str);
+        _yal_free(_a, carstr.c_str);
+        _yal_free(_a, cdrstr.c_str);
         return dst;
     }
     /*Manage head value*/
-    tstr_add2end(&dst, &open);
-    currstr = _stringify_value(car(curr));
-    tstr_add2end(&dst, &currstr);
-    tstr_destroy(&currstr);
+    dst = _yal_strfmt(_a, "%s", _open);
+    currstr = _stringify_value(_a, car(curr));
+    _yal_strappend(_a, &dst, currstr.c_str);
+    _yal_free(_a, currstr.c_str);
     curr = cdr(curr);
 
     /*Manage tail values*/
     while (!is_nil(curr)) {
         if (is_nil(car(curr)) && is_nil(cdr(curr)))
             break;
-        tstr_add2end(&dst, &space);
-        currstr = _stringify_value(car(curr));
-        tstr_add2end(&dst, &currstr);
-        tstr_destroy(&currstr);
+        _yal_strappend(_a, &dst, " ");
+        currstr = _stringify_value(_a, car(curr));
+        _yal_strappend(_a, &dst, currstr.c_str);
+        _yal_free(_a, currstr.c_str);
         curr = cdr(curr);
     }
-    tstr_add2end(&dst, &close);
+    _yal_strappend(_a, &dst, _close);
     return dst;
 }
 
-char
-_token_value_type(tstr* _num)
-{
-    tstr decimal_indicator = tstr_view(".");
-    if (tstr_find(_num, &decimal_indicator) == TSTR_INVALID)
-        return TYPE_REAL;
-    return TYPE_DECIMAL;
-}
-
 tstr
-_try_get_special_token(char* _t)    
+stringify(expr* _args, const char* _open, const char* _close)
+/*The string is on the system heap, for the host to tstr_destroy()*/
 {
-    const char* stokens[] = {
-        "(", ")","'(",
-        "{", "}","'{",
-        "[", "]","'[",
-        };
-    const int stoken_len = sizeof(stokens) / sizeof(stokens[0]);
-    tstr stok;
-    int i;
-    for (i = 0; i < stoken_len; i++) {
-        stok = tstr_view(stokens[i]);
-        if (_rawstr_is_equal(stok.c_str, _t, tstr_length(&stok)))
-            return stok;
-    }
-    return (tstr) {0};
+    return _stringify(NULL, _args, _open, _close);
 }
 
+enum TOKEN {
+    TOKEN_END = 0,
+    TOKEN_ATOM,
+    TOKEN_STRING,
+    TOKEN_QUOTE,
+    TOKEN_OPEN,
+    TOKEN_OPEN_LIST,
+    TOKEN_OPEN_MAP,
+    TOKEN_QUOTE_OPEN,
+    TOKEN_CLOSE,
+
+    TOKEN_COUNT
+};
+
+/*A token is a range in the source, so reading allocates nothing but exprs*/
+typedef struct {
+    int offset;
+    int length;
+    char kind;
+}Token;
+
 #define _IS_WHITESPACE(C) \
     (((C) == ' ' || (C) == '\t' || (C) == '\n') ? 1 : 0)
 
-tstr
-_get_next_token(char* _source, int* _cursor)
+char
+_special_token(const char* _c, int* _len)
+{
+    *_len = 1;
+    switch (_c[0]) {
+    case '(':
+        return TOKEN_OPEN;
+    case '[':
+        return TOKEN_OPEN_LIST;
+    case '{':
+        return TOKEN_OPEN_MAP;
+    case ')':
+    case ']':
+    case '}':
+        return TOKEN_CLOSE;
+    case '\'':
+        *_len = 2;
+        if (_c[1] == '(' || _c[1] == '[' || _c[1] == '{')
+            return TOKEN_QUOTE_OPEN;
+        break;
+    default:
+        break;
+    };
+    *_len = 0;
+    return TOKEN_END;
+}
+
+Token
+_next_token(const char* _source, int* _cursor)
 {
-    tstr token = {0};
-    tstr maybestoken = {0};
+    Token token = {0};
+    const char* c;
     int len = 0;
-    maybestoken = _try_get_special_token(&_source[*_cursor]);
-    if (tstr_ok(&maybestoken)) {
-        len = tstr_length(&maybestoken);
-    }
-    else if (_source[*_cursor + len] == '\"') {
+    int speciallen;
+    while (_IS_WHITESPACE(_source[*_cursor]))
+        (*_cursor)++;
+    c = &_source[*_cursor];
+    token.offset = *_cursor;
+    token.kind = _special_token(c, &len);
+
+    if (token.kind == TOKEN_END && c[0] == '\"') {
         len++;
-        while (_source[*_cursor + len] != '\"' && _source[*_cursor + len] != '\0') {
+        while (c[len] != '\"' && c[len] != '\0')
             len++;
-        }
-        len++;
-        token = tstr_n(&_source[*_cursor], len);
-        *_cursor += len;
-        return token;
+        if (c[len] == '\"')
+            len++;
+        token.kind = TOKEN_STRING;
     }
-    else {
-        while (!_IS_WHITESPACE(_source[*_cursor + len]) &&
-               _source[*_cursor + len] != '\0') {
+    else if (token.kind == TOKEN_END && c[0] != '\0') {
+        /*Atoms end at whitespace or where a special token starts*/
+        while (!_IS_WHITESPACE(c[len]) && c[len] != '\0') {
             len++;
-            maybestoken = _try_get_special_token(&_source[*_cursor + len]);
-            if (tstr_ok(&maybestoken))
+            if (_special_token(&c[len], &speciallen) != TOKEN_END)
                 break;
         }
+        token.kind = (c[0] == '\'') ? TOKEN_QUOTE : TOKEN_ATOM;
     }
-    /*Create Token*/
-    token = tstr_n(&_source[*_cursor], len);
+    token.length = len;
     *_cursor += len;
     return token;
 }
 
-void
-_trim_whitespace(char* _source, int* _cursor)
-{
-    while (_IS_WHITESPACE(_source[*_cursor]))
-        (*_cursor)++;
-}
-
-#define t_type tstr
-#define arr_t_name Tokens
-#include "vendor/tsarray.h"
-
-Tokens
-_tokenize(char* _source, int* _cursor)
-{
-    assert(_source != NULL && "Invalid program given to tokenizer");
-    assert(_cursor != NULL && "Invalid cursor given to tokenizer");
-    Tokens tokens = {0};
-    tstr curr = {0};
-
-    Tokens_initn(&tokens, 10);
-    *_cursor = 0;
-    while (_source[*_cursor] != '\0') {
-        _trim_whitespace(_source, _cursor);
-        //printf("cursor(%d) -> ", *_cursor);
-        curr = _get_next_token(_source, _cursor);
-        //printf("token: %s\n", curr.c_str);
-        Tokens_push(&tokens, curr);
-    }
-    /*TODO:  Do error checking like matching+even parens*/
-    /*TODO:  Remove garbage tokens*/
-    /*TODO:  if you want a tokenizer impl that is isolated, take this
-             and add a tokenization recipe struct with:
-             - garbate token list
-             - literal token list
-             - extra stuff like use newline tokens
-             - etc..
-    */
-    return tokens;
-}
-
-void
-tokens_print(Tokens* _tokens, const char* _start, const char* _end, const char* _sep)
-{
-    int i;
-    int n = Tokens_len(_tokens);
-    printf("TOKENS(%d): ", n);
-    for (i = 0; i < n; i++) {
-        printf("%s%s%s%s", _start, Tokens_peek(_tokens, i)->c_str, _end, _sep);
-    }
-    printf("\n");
-}
-
-void
-_tokens_post_process(Tokens* _tokens)
-{
-  /*TODO: Here we remove the outer scope of the lexed function.
-    if we lex more than one scope we cant do this..
-    On top of this, we cant lex non-list inputs..
-   */
-    UNUSED(_tokens);
-    //tokens_print(_tokens, "[", "]", " ");
-    //Tokens_pop(_tokens);
-    //Tokens_pop_front(_tokens);
-}
-
 char
-_looks_like_number(tstr _token)
+_looks_like_number(const char* _token, int _len)
 {
   /*TODO: We can do cool stuff like allowing _ in numbers and remove them before
           lexing so that 100_000_000 is a valid number.
   */
-    if (tstr_length(&_token) > 1 && (_token.c_str[0] == '-' || _token.c_str[0] == '+'))
-        return (_token.c_str[1] >= '0' && (_token.c_str[1]) <= '9') ? 1 : 0;
-    return (_token.c_str[0] >= '0' && (_token.c_str[0]) <= '9') ? 1 : 0;
-}
-
-char
-_looks_like_string(tstr _token)
-{
-    if (tstr_length(&_token) < 2)
-        return 0;
-    return (_token.c_str[0] == '\"');
-}
-
-char
-tstr_cstartswith(tstr* _src, const char* _st)    
-{
-    tstr st = tstr_view(_st);
-    if (tstr_length(_src) < tstr_length(&st))
-        return 0;
-    return _rawstr_is_equal(_src->c_str, st.c_str, tstr_length(&st));
+    if (_len > 1 && (_token[0] == '-' || _token[0] == '+'))
+        return (_token[1] >= '0' && (_token[1]) <= '9') ? 1 : 0;
+    return (_token[0] >= '0' && (_token[0]) <= '9') ? 1 : 0;
 }
 
 expr*
-_lex_value(Environment* _env, tstr* _token)
+_parse_value(Environment* _env, const char* _token, int _len)
 {
-    if (_looks_like_string(*_token)) {
-        return string(_env, _token->c_str);
-    }
-    else if (_looks_like_number(*_token)) {
-        if (_token_value_type(_token) == TYPE_REAL)
-            return real(_env, tstr_to_int(_token));
-        else
-            return decimal(_env, tstr_to_float(_token));
+    int i;
+    if (_len >= 2 && _token[0] == '\"')
+        return _string_n(_env, _token, _len);
+    if (_len > 0 && _looks_like_number(_token, _len)) {
+        for (i = 0; i < _len; i++)
+            if (_token[i] == '.')
+                return decimal(_env, atof(_token));
+        return real(_env, atoi(_token));
     }
-    return symbol(_env, _token->c_str);
+    return _symbol_intern(_env, _token, _len);
 }
 
 expr*
-_lex(Environment* _env, Tokens* _tokens)
+_parse(Environment* _env, const char* _source, int* _cursor)
 {
     /*TODO: Does not support special syntax for:
     dotted lists (a . 34)
     */
     ASSERT_INV_ENV(_env);
-    assert(_tokens != NULL);
-    tstr token;
+    Token token;
+    const char* text;
     expr* program = cons(_env, NULL, NULL);
     expr* curr = program;
 
-    while (Tokens_len(_tokens) > 0) {
-        token = Tokens_pop_front(_tokens);
-        if (tstr_equalc(&token, ")") || tstr_equalc(&token, "]")) {
-            tstr_destroy(&token);
+    for (token = _next_token(_source, _cursor);
+         token.kind != TOKEN_END && token.kind != TOKEN_CLOSE;
+         token = _next_token(_source, _cursor)) {
+        text = &_source[token.offset];
+        switch (token.kind) {
+        case TOKEN_OPEN:
+            curr->car = _parse(_env, _source, _cursor);
             break;
-        }
-        else if (tstr_equalc(&token, "(")) {
-            curr->car = _lex(_env, _tokens);
-        }
-        else if (tstr_equalc(&token, "[")) {
-            curr->car = cons(_env, symbol(_env, "list"), _lex(_env, _tokens));
-        }
-        else if (tstr_equalc(&token, "{")) {
+        case TOKEN_OPEN_LIST:
+            curr->car = cons(_env, symbol(_env, "list"), _parse(_env, _source, _cursor));
+            break;
+        case TOKEN_OPEN_MAP:
             ASSERT_UNREACHABLE();
             /*TODO: we dont support maps or vectors*/
-            curr->car = cons(_env, symbol(_env, "map"), _lex(_env, _tokens));
-        }
-        else if (tstr_cstartswith(&token, "'")) {
-            tstr resttok = tstr_(token.c_str+1);
-            if (tstr_equalc(&resttok, "(") ||
-                tstr_equalc(&resttok, "[") ||
-                tstr_equalc(&resttok, "{")) {
-                curr->car = cons(_env, symbol(_env, "quote"), cons(_env, _lex(_env, _tokens), NULL));
-            } else {
-                 curr->car = cons(_env, symbol(_env, "quote"), cons(_env, _lex_value(_env, &resttok), NULL));
-            }
-            tstr_destroy(&resttok);
-        }
-        else {
-            curr->car = _lex_value(_env, &token);
-        }
-        /*Insert extracted into lexed program*/
-        tstr_destroy(&token);
+            curr->car = cons(_env, symbol(_env, "map"), _parse(_env, _source, _cursor));
+            break;
+        case TOKEN_QUOTE_OPEN:
+            curr->car = cons(_env, symbol(_env, "quote"),
+                             cons(_env, _parse(_env, _source, _cursor), NULL));
+            break;
+        case TOKEN_QUOTE:
+            curr->car = cons(_env, symbol(_env, "quote"),
+                             cons(_env, _parse_value(_env, text + 1, token.length - 1), NULL));
+            break;
+        default:
+            curr->car = _parse_value(_env, text, token.length);
+            break;
+        };
+        /*Insert extracted into parsed program*/
         curr->cdr = cons(_env, NULL, NULL);
         curr = curr->cdr;
     }
-    //DBPRINT("lexed program: ", program);
+    //DBPRINT("parsed program: ", program);
     return program;
 }
 
 expr*
-read(Environment* _env, VariableScope* _scope, Exception* _throwdst, char* _program_str)
+yal_read(Environment* _env, VariableScope* _scope, Exception* _throwdst, char* _program_str)
 {
-    /*TODO: Need error checking from _lex()*/
+    /*TODO: Need error checking from _parse()*/
     ASSERT_INV_ENV(_env);
     ASSERT_INV_SCOPE(_scope);
     UNUSED(_throwdst);
@@ -1099,10 +1669,7 @@ read(Environment* _env, VariableScope* _scope, Exception* _throwdst, char* _prog
     }
 
     int cursor = 0;
-    Tokens tokens = _tokenize(_program_str, &cursor);
-    _tokens_post_process(&tokens);
-    expr* program = _lex(_env, &tokens);
-    Tokens_destroy(&tokens);
+    expr* program = _parse(_env, _program_str, &cursor);
     /*TODO: This mighr be wrong to do!*/
     if (len(program) == 1)
         return car(program);
@@ -1118,64 +1685,110 @@ _find_buildin(Environment* _env, expr* _sym)
     int i;
     if (is_nil(_sym) || !is_symbol(_sym))
         return NULL;
+    /*Symbols are interned, so the names compare by pointer*/
     for (i = 0; i < Buildins_len(&_env->buildins); i++) {
         buildin = Buildins_peek(&_env->buildins, i);
-        if (tstr_equalc(&_sym->symbol, buildin->name)) {
+        if (buildin->symbol == _sym)
             return buildin;
-        }
     }
     return NULL;
 }
 
+Buildin*
+_call_buildin(Environment* _env, expr* _form)
+/*Buildins always win in call position, so a call form caches the buildin it
+  resolved to. The form is left as written, as programs may inspect it, and
+  the cache is only trusted while its car is the buildin's symbol*/
+{
+    Buildin* buildin;
+    int i = _form->buildin;
+    if (i != 0 && i <= Buildins_len(&_env->buildins)) {
+        buildin = Buildins_peek(&_env->buildins, i - 1);
+        if (buildin->symbol == car(_form))
+            return buildin;
+    }
+    buildin = _find_buildin(_env, car(_form));
+    if (buildin != NULL)
+        _form->buildin = (uint16_t)(buildin - Buildins_peek(&_env->buildins, 0)) + 1;
+    return buildin;
+}
+
 Variable*
 _find_variable(VariableScope* _scope, expr* _sym)
 {
     Variable* variable = NULL;
-    int i;
-    int n = Variables_len(&_scope->variables);
-    for (i = 0; i < n; i++) {
-        variable = Variables_peek(&_scope->variables, i);
-        if (variable == NULL)
-            continue;
-        if (!tstr_ok(&variable->symbol))
-            continue;
-
-        if (tstr_equal(&variable->symbol, &_sym->symbol)) {
+    if (_sym == NULL || _sym->type != TYPE_SYMBOL)
+        return NULL;
+    for (; _scope != NULL; _scope = _scope->outer) {
+        variable = _VariableScope_lookup(_scope, _sym);
+        if (variable != NULL)
             return variable;
-        }
     }
-    if (_scope->outer != NULL)
-        return _find_variable(_scope->outer, _sym);
     return NULL;
 }
 
-void
-_bind(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _binds, expr* _values)
+expr*
+_call(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _fn, expr* _args, char _eval_args)
+/*Call a function, lambda or macro. Parameters are bound directly into slots
+  on the frame stack, so calling allocates nothing for binding. Calls nested
+  deeper than the frame stack bind their parameters in their own scope.*/
 {
-  /*TODO: We just blindly pair binds and values,
-          In the future, add support for &rest and keyword binds aswell*/
-    ASSERT_INV_ENV(_env);
-    ASSERT_INV_SCOPE(_scope);
+    /*TODO: We just blindly pair binds and values,
+            In the future, add support for &rest and keyword binds aswell*/
+    FrameStack* frames = &_env->frames;
+    VariableScope local = {0};
+    Variable* frame = NULL;
+    Variable v;
+    expr* bind = _fn->callable.binds;
+    expr* result;
+    int n = len(bind);
+    int i;
 
-    if (len(_binds) != len(_values))
-        THROW_INVALIDINPUT(_throwdst,
-                           "_bind",
-                           "Expected equal amount of binds and values",
-                           _binds);
-
-    expr* bind = _binds; 
-    expr* val = _values; 
-    //DBPRINT("binding ", car(bind));
-    //DBPRINT("to ", car(val));
-    while (!is_nil(cdr(bind)) && !is_nil(cdr(val))) {
-        Env_add_variable(_env, _scope, car(bind)->symbol.c_str, car(val));
-        bind = cdr(bind);
-        val = cdr(val);
+    if (len(_args) != n) {
+        THROW_INVALIDINPUT(_throwdst, "_call", "Expected equal amount of binds and values", bind);
+        return NIL();
     }
+    if (frames->slots == NULL) {
+        frames->slots = (Variable*)_yal_malloc(&_env->allocator, sizeof(Variable) * frames->len);
+        if (frames->slots == NULL)
+            ASSERT_NOMOREMEMORY();
+    }
+    /*Reserve the frame first, calls made by the arguments go on top of it.
+      Slots are never moved, as outer calls point into them*/
+    if (frames->top + n <= frames->len) {
+        frame = &frames->slots[frames->top];
+        frames->top += n;
+    }
+    local.variables.allocator = &_env->allocator;
+    for (i = 0; i < n; i++) {
+        v.symbol = car(bind);
+        v.value = (_eval_args) ? eval_expr(_env, _scope, _throwdst, car(_args)) : car(_args);
+        if (Exception_is_error(_throwdst)) {
+            if (frame != NULL)
+                frames->top -= n;
+            VariableScope_destroy(_env, &local);
+            return NIL();
+        }
+        if (frame != NULL)
+            frame[i] = v;
+        else
+            VariableScope_add(&local, v);
+        bind = cdr(bind);
+        _args = cdr(_args);
+    }
+    local.outer = _scope;
+    local.frame = frame;
+    local.frame_len = (frame != NULL) ? n : 0;
+    result = buildin_progn(_env, &local, _throwdst, _fn->callable.body);
+    VariableScope_destroy(_env, &local);
+    if (frame != NULL)
+        frames->top -= n;
+    RETURN_ON_EXCEPTION(_throwdst, NIL());
+    return result;
 }
 
 expr*
-eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
+_eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
 {
     /*TODO: Needs a cleaning*/
     ASSERT_INV_ENV(_env);
@@ -1184,7 +1797,6 @@ eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr*
     expr* args = NULL;
     Buildin* buildin = NULL;
     Variable* variable = NULL;
-    VariableScope local = {0};
     expr* result = NULL;
     if (is_nil(_in))
         return _in;
@@ -1199,17 +1811,10 @@ eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr*
         if (fn->type == TYPE_LAMBDA) {
             //DBPRINT("lambda binds: ", fn->callable.binds);
             //DBPRINT("lambda body: ", fn->callable.body);
-            args = list(_env, _scope, _throwdst, args);
-            RETURN_ON_EXCEPTION(_throwdst, NIL());
-            VariableScope_new(_env, &local, _scope);
-            _bind(_env, &local, _throwdst, fn->callable.binds, args);
-            result = buildin_progn(_env, &local, _throwdst, fn->callable.body);
-            RETURN_ON_EXCEPTION(_throwdst, NIL());
-            VariableScope_destroy(_env, &local);
-            return result;
+            return _call(_env, _scope, _throwdst, fn, args, 1);
         }
         else if (fn->type == TYPE_SYMBOL) {
-            buildin = _find_buildin(_env, fn);
+            buildin = _call_buildin(_env, _in);
             if (buildin != NULL) {
                 result = buildin->fn(_env, _scope, _throwdst, args);
                 //DBPRINT("(eval) RESULT: ", result);
@@ -1221,27 +1826,15 @@ eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr*
                 if (variable->value->type == TYPE_FUNCTION) {
                     //DBPRINT("fn binds: ", variable->value->callable.binds);
                     //DBPRINT("fn body: ", variable->value->callable.body);
-                    args = list(_env, _scope, _throwdst, args);
-                    RETURN_ON_EXCEPTION(_throwdst, NIL());
-                    VariableScope_new(_env, &local, _scope);
-                    _bind(_env, &local, _throwdst, variable->value->callable.binds, args);
-                    result = buildin_progn(_env, &local, _throwdst, variable->value->callable.body);
-                    RETURN_ON_EXCEPTION(_throwdst, NIL());
-                    VariableScope_destroy(_env, &local);
-                    return result;
+                    return _call(_env, _scope, _throwdst, variable->value, args, 1);
                 }
                 else if (variable->value->type == TYPE_MACRO) {
                     /*TODO: verify this is correct, only diff is i dont eval args!*/
 
-                    DBPRINT("macro binds: ", variable->value->callable.binds);
-                    DBPRINT("macro body: ", variable->value->callable.body);
-                    //args = list(_env, _scope, _throwdst, args);
-                    //RETURN_ON_EXCEPTION(_throwdst, NIL());
-                    VariableScope_new(_env, &local, _scope);
-                    _bind(_env, &local, _throwdst, variable->value->callable.binds, args);
-                    result = buildin_progn(_env, &local, _throwdst, variable->value->callable.body);
+                    //DBPRINT("macro binds: ", variable->value->callable.binds);
+                    //DBPRINT("macro body: ", variable->value->callable.body);
+                    result = _call(_env, _scope, _throwdst, variable->value, args, 0);
                     RETURN_ON_EXCEPTION(_throwdst, NIL());
-                    VariableScope_destroy(_env, &local);
                     result = buildin_progn(_env, _scope, _throwdst, result);
                     RETURN_ON_EXCEPTION(_throwdst, NIL());
                     return result;
@@ -1279,6 +1872,142 @@ eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr*
     return NIL();
 }
 
+expr*
+eval_expr(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
+{
+    expr* result;
+    ASSERT_INV_ENV(_env);
+    /*Only a top level evaluation is a safe point for collection, nothing but
+      the evaluated expression is held on the C stack by the interpreter*/
+    if (_env->gc.eval_depth == 0 &&
+        (_env->gc.pending || _env->arena.n_used >= _env->gc.threshold)) {
+        Env_gc_pin(_env, _in);
+        Env_gc_run(_env, _scope);
+        Env_gc_unpin(_env, _in);
+    }
+    _env->gc.eval_depth++;
+    result = _eval_expr(_env, _scope, _throwdst, _in);
+    _env->gc.eval_depth--;
+    return result;
+}
+
+char
+_is_constant(expr* _e)
+/*Constants evaluate to themselves*/
+{
+    if (is_nil(_e))
+        return 1;
+    switch (_e->type) {
+    case TYPE_REAL:
+    case TYPE_DECIMAL:
+    case TYPE_STRING:
+        return 1;
+    case TYPE_SYMBOL:
+        return _e->symbol.c_str == _YAL_SYM_t || _e->symbol.c_str == _YAL_SYM_T;
+    default:
+        return 0;
+    }
+}
+
+int
+_unevaluated_inputs(Buildin* _buildin)
+/*Number of leading inputs a special form takes as written. Names and
+  parameter lists are not calls and must not be folded. -1 means none of
+  the inputs are plain forms, as in quote or the clauses of cond*/
+{
+    if (_buildin == NULL)
+        return 0;
+    if (_buildin->fn == buildin_deffn || _buildin->fn == buildin_defmacro)
+        return 2;
+    if (_buildin->fn == buildin_deflambda)
+        return 1;
+    if (_buildin->fn == buildin_quote || _buildin->fn == buildin_cond ||
+        _buildin->fn == buildin_letstar || _buildin->fn == buildin_try ||
+        _buildin->fn == buildin_catch)
+        return -1;
+    return 0;
+}
+
+expr*
+_optimize(Environment* _env, expr* _in)
+{
+    Exception msg = {0};
+    Buildin* buildin;
+    Variable* variable;
+    expr* iter;
+    expr* result;
+    char constant = 1;
+    int skip;
+
+    if (!is_cons(_in))
+        return _in;
+    buildin = _call_buildin(_env, _in);
+    skip = _unevaluated_inputs(buildin);
+    if (skip < 0)
+        return _in;
+    if (buildin == NULL && is_symbol(car(_in))) {
+        /*Macros are given their input forms, so leave them as written*/
+        variable = _find_variable(&_env->globals, car(_in));
+        if (variable != NULL && variable->value->type == TYPE_MACRO)
+            return _in;
+    }
+    if (is_cons(car(_in)))
+        _in->car = _optimize(_env, car(_in));
+    for (iter = cdr(_in); !is_nil(cdr(iter)); iter = cdr(iter)) {
+        if (skip > 0) {
+            skip--;
+            constant = 0;
+            continue;
+        }
+        iter->car = _optimize(_env, car(iter));
+        if (!_is_constant(car(iter)))
+            constant = 0;
+    }
+    if (buildin == NULL)
+        return _in;
+
+    if (buildin->fn == buildin_progn && len(cdr(_in)) == 1)
+        return car(cdr(_in));
+    if (!constant || (!buildin->pure && buildin->fn != buildin_range))
+        return _in;
+    /*Inputs are constant, so the buildin can be called directly. The call
+      may sit in a branch that is never taken, so pure buildins must report
+      bad inputs as exceptions and never trap. Calls that fail are left in
+      place to fail if they are evaluated*/
+    result = buildin->fn(_env, &_env->globals, &msg, cdr(_in));
+    if (Exception_is_error(&msg)) {
+        Exception_destroy(&msg);
+        return _in;
+    }
+    if (buildin->fn == buildin_range)
+        return cons(_env, symbol(_env, "quote"), cons(_env, result, cons(_env, NULL, NULL)));
+    if (!_is_constant(result))
+        return _in;
+    return result;
+}
+
+expr*
+optimize(Environment* _env, expr* _in)
+/*Optional pass over a program given by yal_read(), before it is evaluated.
+  Calls to pure buildins where every input is a constant are replaced by
+  their result, range with constant bounds is replaced by the quoted list and
+  progn with a single form is replaced by that form. Calls that would throw
+  are left as written, also in branches that are never taken. Names and
+  parameter lists of fn, macro and lambda, and the inputs of quote, cond,
+  let*, try and catch are not folded.
+  NOTE: An expanded range is shared by every evaluation of the program,
+        and only macros defined before optimize() are left unexpanded.*/
+{
+    expr* result;
+    ASSERT_INV_ENV(_env);
+    /*Folding evaluates the constant inputs, the program being optimized is
+      not reachable by the collector so it must not run meanwhile*/
+    _env->gc.eval_depth++;
+    result = _optimize(_env, _in);
+    _env->gc.eval_depth--;
+    return result;
+}
+
 expr* buildin_list(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in);
 expr*
 list(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
@@ -1299,7 +2028,7 @@ buildin_read(Environment* _env, VariableScope* _scope, Exception* _throwdst, exp
         THROW_INVALIDINPUT(_throwdst, "read", "expected string input", _in);
         return NIL();
     }
-    return read(_env, _scope, _throwdst, _in->string.c_str);
+    return yal_read(_env, _scope, _throwdst, _in->string.c_str);
 }
 
 expr*
@@ -1342,6 +2071,56 @@ buildin_len(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr
     return real(_env, len(args));
 }
 
+const char*
+_string_contents(expr* _str, int* _n)
+/*The quotes are part of a string, so skip them when joining strings*/
+{
+    const char* c = _str->string.c_str;
+    *_n = tstr_length(&_str->string);
+    if (*_n >= 2 && c[0] == '"' && c[*_n - 1] == '"') {
+        *_n -= 2;
+        return c + 1;
+    }
+    return c;
+}
+
+expr*
+buildin_concat(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
+{
+    expr* args;
+    expr* iter;
+    expr* out;
+    const char* contents;
+    char* buf;
+    int total = 2;
+    int n;
+    ASSERT_INV_SCOPE(_scope);
+    args = list(_env, _scope, _throwdst, _in);
+    RETURN_ON_EXCEPTION(_throwdst, NIL());
+    for (iter = args; !is_nil(cdr(iter)); iter = cdr(iter)) {
+        if (!is_string(car(iter))) {
+            THROW_INVALIDINPUT(_throwdst, "concat", "Expected only strings", _in);
+            return NIL();
+        }
+        _string_contents(car(iter), &n);
+        total += n;
+    }
+    buf = (char*)_yal_malloc(&_env->allocator, total + 1);
+    if (buf == NULL)
+        ASSERT_NOMOREMEMORY();
+    buf[0] = '"';
+    total = 1;
+    for (iter = args; !is_nil(cdr(iter)); iter = cdr(iter)) {
+        contents = _string_contents(car(iter), &n);
+        _rawstr_ncopy((char*)contents, buf + total, n);
+        total += n;
+    }
+    buf[total++] = '"';
+    out = _string_n(_env, buf, total);
+    _yal_free(&_env->allocator, buf);
+    return out;
+}
+
 expr*
 buildin_quote(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
 {
@@ -1674,6 +2453,17 @@ _DIVIDE2(Environment* _env, Exception* _throwdst, expr* _a, expr* _b)
         THROW_INVALIDINPUT(_throwdst, "_DIVIDE2", "expected inputs to be values", cons(_env, _a, _b));
         return real(_env, 0);
     }
+    /*Integer division traps on these instead of failing*/
+    if ((_b->type == TYPE_REAL && _b->real == 0) ||
+        (_b->type == TYPE_DECIMAL && _b->decimal == 0.f)) {
+        THROW_INVALIDINPUT(_throwdst, "divide", "division by zero!", cons(_env, _a, _b));
+        return real(_env, 0);
+    }
+    if (_a->type == TYPE_REAL && _b->type == TYPE_REAL &&
+        _a->real == INT_MIN && _b->real == -1) {
+        THROW_INVALIDINPUT(_throwdst, "divide", "division overflows!", cons(_env, _a, _b));
+        return real(_env, 0);
+    }
     if (_a->type == TYPE_DECIMAL && _b->type == TYPE_DECIMAL)
         return decimal(_env, _a->decimal / _b->decimal);
     else if (_a->type == TYPE_REAL && _b->type == TYPE_DECIMAL)
@@ -1703,8 +2493,10 @@ buildin_divide(Environment* _env, VariableScope* _scope, Exception* _throwdst, e
             THROW_NONVALUEARG(_throwdst, "/", args);
             return NIL();
         }
-        if ((tmp->type == TYPE_REAL && tmp->real == 0) ||
-            (tmp->type == TYPE_DECIMAL && tmp->decimal == 0.f)) {
+        /*Only divisors may be zero*/
+        if (tmp != args &&
+            ((car(tmp)->type == TYPE_REAL && car(tmp)->real == 0) ||
+             (car(tmp)->type == TYPE_DECIMAL && car(tmp)->decimal == 0.f))) {
             THROW_INVALIDINPUT(_throwdst, "divide", "division by zero!", args);
             return real(_env, 0);
         }
@@ -1744,7 +2536,7 @@ _MATHEQUAL2(Environment* _env, Exception* _throwdst, expr* _a, expr* _b)
         return _a->real == _b->real;
 
     else if (_a->type == TYPE_SYMBOL && _b->type == TYPE_SYMBOL)
-        return tstr_equal(&_a->symbol, &_b->symbol);
+        return _a == _b;
     else if (_a->type == TYPE_STRING && _b->type == TYPE_STRING)
         return tstr_equal(&_a->string, &_b->string);
 
@@ -1786,11 +2578,70 @@ buildin_mathequal(Environment* _env, VariableScope* _scope, Exception* _throwdst
     return symbol(_env, "t");
 }
 
+char
+_prints_same(expr* _a, expr* _b)
+/*True when both expressions stringify the same, without building the
+  strings*/
+{
+    char buf_a[64];
+    char buf_b[64];
+    char end_a;
+    char end_b;
+    if (is_nil(_a) || is_nil(_b))
+        return is_nil(_a) && is_nil(_b);
+    if (_a->type != _b->type)
+        return 0;
+    switch (_a->type) {
+    case TYPE_CONS:
+    case TYPE_VECTOR:
+    case TYPE_DICTIONARY:
+        if (is_dotted(_a) || is_dotted(_b))
+            return is_dotted(_a) && is_dotted(_b) &&
+                   _prints_same(car(_a), car(_b)) && _prints_same(cdr(_a), cdr(_b));
+        /*Walk both lists the way stringify() does*/
+        if (!_prints_same(car(_a), car(_b)))
+            return 0;
+        _a = cdr(_a);
+        _b = cdr(_b);
+        for (;;) {
+            end_a = is_nil(_a) || (is_nil(car(_a)) && is_nil(cdr(_a)));
+            end_b = is_nil(_b) || (is_nil(car(_b)) && is_nil(cdr(_b)));
+            if (end_a || end_b)
+                return end_a && end_b;
+            if (!_prints_same(car(_a), car(_b)))
+                return 0;
+            _a = cdr(_a);
+            _b = cdr(_b);
+        }
+    case TYPE_LAMBDA:
+    case TYPE_MACRO:
+    case TYPE_FUNCTION:
+        return 1;
+    case TYPE_REAL:
+        return _a->real == _b->real;
+    case TYPE_DECIMAL:
+        snprintf(buf_a, sizeof(buf_a), "%f", _a->decimal);
+        snprintf(buf_b, sizeof(buf_b), "%f", _b->decimal);
+        return strcmp(buf_a, buf_b) == 0;
+    case TYPE_SYMBOL:
+        /*Interned, only t and T print the same under different names*/
+        if (_a->symbol.c_str == _YAL_SYM_T)
+            return _b->symbol.c_str == _YAL_SYM_T || _b->symbol.c_str == _YAL_SYM_t;
+        if (_a->symbol.c_str == _YAL_SYM_t)
+            return _b->symbol.c_str == _YAL_SYM_T || _b->symbol.c_str == _YAL_SYM_t;
+        return _a == _b || strcmp(_a->symbol.c_str, _b->symbol.c_str) == 0;
+    case TYPE_STRING:
+        return strcmp(_a->string.c_str, _b->string.c_str) == 0;
+    default:
+        ASSERT_UNREACHABLE();
+    };
+    return 0;
+}
+
 expr*
 buildin_simequal(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
 {
-    tstr gt;
-    tstr curr;
+    expr* gt;
     expr* tmp;
     ASSERT_INV_ENV(_env);
     ASSERT_INV_SCOPE(_scope);
@@ -1800,29 +2651,22 @@ buildin_simequal(Environment* _env, VariableScope* _scope, Exception* _throwdst,
         return symbol(_env, "t");
     }
     tmp = _in;
-    gt = _stringify_value(first(tmp));
+    gt = first(tmp);
     tmp = cdr(tmp);
 
     /*check for equality*/
     while (!is_nil(cdr(tmp))) {
-        curr = _stringify_value(car(tmp));
-        if (!tstr_equal(&gt, &curr)) {
-            tstr_destroy(&gt);
-            tstr_destroy(&curr);
+        if (!_prints_same(gt, car(tmp)))
             return NIL();
-        }
-        tstr_destroy(&curr);
         tmp = cdr(tmp);
     }
-    tstr_destroy(&gt);
     return symbol(_env, "t");
 }
 
 expr*
 buildin_eq(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr* _in)
 {
-    tstr gt;
-    tstr curr;
+    expr* gt;
     expr* tmp;
     expr* args;
     ASSERT_INV_ENV(_env);
@@ -1833,21 +2677,15 @@ buildin_eq(Environment* _env, VariableScope* _scope, Exception* _throwdst, expr*
         return symbol(_env, "t");
     }
     tmp = args;
-    gt = _stringify_value(first(tmp));
+    gt = first(tmp);
     tmp = cdr(tmp);
 
     /*check for equality*/
     while (!is_nil(cdr(tmp))) {
-        curr = _stringify_value(car(tmp));
-        if (!tstr_equal(&gt, &curr)) {
-            tstr_destroy(&gt);
-            tstr_destroy(&curr);
+        if (!_prints_same(gt, car(tmp)))
             return NIL();
-        }
-        tstr_destroy(&curr);
         tmp = cdr(tmp);
     }
-    tstr_destroy(&gt);
     return symbol(_env, "t");
 }
 
@@ -1877,12 +2715,12 @@ buildin_progn(Environment* _env, VariableScope* _scope, Exception* _throwdst, ex
 }
 
 void
-_add_to_variablescope(Variables* _dst, expr* _n, expr* _v)
+_add_to_variablescope(VariableScope* _dst, expr* _n, expr* _v)
 {
     Variable v = {0};
-    tstr_copy(&_n->symbol, &v.symbol);
+    v.symbol = _n;
     v.value = _v;
-    Variables_push(_dst, v);
+    VariableScope_add(_dst, v);
 }
 
 expr*
@@ -1897,7 +2735,7 @@ buildin_defconst(Environment* _env, VariableScope* _scope, Exception* _throwdst,
         THROW_INVALIDINPUT(_throwdst, "const", "expected 1-2 args, and first arg to be symbol", _in);
         return NIL();
     }
-    _add_to_variablescope(&_env->constants.variables, first(_in), val);
+    _add_to_variablescope(&_env->constants, first(_in), val);
     DBPRINT("created constant: ", first(_in));
     DBPRINT("with value: ", val);
     return first(_in);
@@ -1920,7 +2758,7 @@ buildin_defglobal(Environment* _env, VariableScope* _scope, Exception* _throwdst
         THROW_INVALIDINPUT(_throwdst, "global", "expected 1-2 args, and first arg to be symbol", _in);
         return NIL();
     }
-    _add_to_variablescope(&_env->globals.variables, first(_in), val);
+    _add_to_variablescope(&_env->globals, first(_in), val);
     DBPRINT("created global: ", first(_in));
     DBPRINT("with value: ", val);
     return first(_in);
@@ -1938,7 +2776,7 @@ buildin_defvar(Environment* _env, VariableScope* _scope, Exception* _throwdst, e
         THROW_INVALIDINPUT(_throwdst, "var", "expected 1-2 args, and first arg to be symbol", _in);
         return NIL();
     }
-    _add_to_variablescope(&_scope->variables, first(_in), val);
+    _add_to_variablescope(_scope, first(_in), val);
     DBPRINT("created variable: ", first(_in));
     DBPRINT("with value: ", val);
     return first(_in);
@@ -2039,12 +2877,12 @@ buildin_defmacro(Environment* _env, VariableScope* _scope, Exception* _throwdst,
     UNUSED(_throwdst);
 
     Variable var = {0};
-    tstr_copy(&first(_in)->symbol, &var.symbol);
+    var.symbol = first(_in);
     var.value = _variable_new(_env);
     var.value->type = TYPE_MACRO;
     var.value->callable.binds = second(_in);
     var.value->callable.body = cdr(cdr(_in));
-    Variables_push(&_env->globals.variables, var);
+    VariableScope_add(&_env->globals, var);
     return first(_in);
 }
 
@@ -2057,12 +2895,12 @@ buildin_deffn(Environment* _env, VariableScope* _scope, Exception* _throwdst, ex
     UNUSED(_throwdst);
 
     Variable var = {0};
-    tstr_copy(&first(_in)->symbol, &var.symbol);
+    var.symbol = first(_in);
     var.value = _variable_new(_env);
     var.value->type = TYPE_FUNCTION;
     var.value->callable.binds = second(_in);
     var.value->callable.body = cdr(cdr(_in));
-    Variables_push(&_env->globals.variables, var);
+    VariableScope_add(&_env->globals, var);
     return first(_in);
 }
 
@@ -2349,8 +3187,11 @@ buildin_gc_run(Environment* _env, VariableScope* _scope, Exception* _throwdst, e
 {
     ASSERT_INV_ENV(_env);
     ASSERT_INV_SCOPE(_scope);
-    THROW_NOTIMPLEMENTED(_throwdst, "gc-run");
-    return _in;
+    UNUSED(_throwdst);
+    UNUSED(_in);
+    /*We are inside an evaluation, so collect at the next top level one*/
+    _env->gc.pending = 1;
+    return symbol(_env, "t");
 }
 
 expr*
@@ -2358,8 +3199,13 @@ buildin_gc_info(Environment* _env, VariableScope* _scope, Exception* _throwdst,
 {
     ASSERT_INV_ENV(_env);
     ASSERT_INV_SCOPE(_scope);
-    THROW_NOTIMPLEMENTED(_throwdst, "gc-info");
-    return _in;
+    UNUSED(_throwdst);
+    UNUSED(_in);
+    /*(used free collections)*/
+    return cons(_env, real(_env, _env->arena.n_used),
+                cons(_env, real(_env, _env->arena.n_free),
+                     cons(_env, real(_env, _env->gc.collections),
+                          cons(_env, NULL, NULL))));
 }
 
 expr*
@@ -2367,8 +3213,9 @@ buildin_gc_memused(Environment* _env, VariableScope* _scope, Exception* _throwds
 {
     ASSERT_INV_ENV(_env);
     ASSERT_INV_SCOPE(_scope);
-    THROW_NOTIMPLEMENTED(_throwdst, "gc-used");
-    return _in;
+    UNUSED(_throwdst);
+    UNUSED(_in);
+    return real(_env, _env->arena.n_used * sizeof(expr));
 }
 
 expr*
@@ -2410,25 +3257,34 @@ buildin_print_env(Environment* _env, VariableScope* _scope, Exception* _throwdst
 void
 Env_add_buildin(Environment* _env, const char* _name, buildin_fn _fn)
 {
-    Buildins_push(&_env->buildins, (Buildin){_name, _fn});
+    /*Call forms cache buildin indices in 16 bits*/
+    assert(Buildins_len(&_env->buildins) < UINT16_MAX);
+    Buildins_push(&_env->buildins, (Buildin){_name, _fn, symbol(_env, (char*)_name), 0});
+}
+
+void
+Env_add_pure_buildin(Environment* _env, const char* _name, buildin_fn _fn)
+{
+    Env_add_buildin(_env, _name, _fn);
+    Buildins_peek(&_env->buildins, Buildins_len(&_env->buildins) - 1)->pure = 1;
 }
 
 void
 Env_add_constant(Environment* _env, const char* _name, expr* value)
 {
     Variable v = {0};
-    v.symbol = tstr_((char*)_name);
+    v.symbol = symbol(_env, (char*)_name);
     v.value = variable_duplicate(_env, value);
-    Variables_push(&_env->constants.variables, v);
+    VariableScope_add(&_env->constants, v);
 }
 
 void
 Env_add_variable(Environment* _env, VariableScope* _scope, const char* _name, expr* value)
 {
     Variable v = {0};
-    v.symbol = tstr_((char*)_name);
+    v.symbol = symbol(_env, (char*)_name);
     v.value = variable_duplicate(_env, value);
-    Variables_push(&_scope->variables, v);
+    VariableScope_add(_scope, v);
 }
 
 void
@@ -2447,7 +3303,8 @@ Env_add_core(Environment* _env)
     Env_add_buildin(_env, "quote", buildin_quote);
     Env_add_buildin(_env, "list", buildin_list);
     Env_add_buildin(_env, "cons", buildin_cons);
-    Env_add_buildin(_env, "len", buildin_len);
+    Env_add_pure_buildin(_env, "len", buildin_len);
+    Env_add_pure_buildin(_env, "concat", buildin_concat);
     Env_add_buildin(_env, "put", buildin_put);
     Env_add_buildin(_env, "reverse", buildin_reverse);
 
@@ -2481,10 +3338,10 @@ Env_add_core(Environment* _env)
     /*String management*/
 
     /*Math operators*/
-    Env_add_buildin(_env, "+", buildin_plus);
-    Env_add_buildin(_env, "-", buildin_minus);
-    Env_add_buildin(_env, "*", buildin_multiply);
-    Env_add_buildin(_env, "/", buildin_divide);
+    Env_add_pure_buildin(_env, "+", buildin_plus);
+    Env_add_pure_buildin(_env, "-", buildin_minus);
+    Env_add_pure_buildin(_env, "*", buildin_multiply);
+    Env_add_pure_buildin(_env, "/", buildin_divide);
 
     /*Variable management*/
     Env_add_buildin(_env, "const", buildin_defconst);
@@ -2495,24 +3352,24 @@ Env_add_core(Environment* _env)
     Env_add_buildin(_env, "print-env", buildin_print_env);
 
     /*Condition management*/
-    Env_add_buildin(_env, "<", buildin_lessthan);
-    Env_add_buildin(_env, ">", buildin_greaterthan);
-    Env_add_buildin(_env, "=", buildin_mathequal);
-    Env_add_buildin(_env, "eq", buildin_eq);
-    Env_add_buildin(_env, "equal", buildin_simequal);
+    Env_add_pure_buildin(_env, "<", buildin_lessthan);
+    Env_add_pure_buildin(_env, ">", buildin_greaterthan);
+    Env_add_pure_buildin(_env, "=", buildin_mathequal);
+    Env_add_pure_buildin(_env, "eq", buildin_eq);
+    Env_add_pure_buildin(_env, "equal", buildin_simequal);
     Env_add_buildin(_env, "cond", buildin_cond);
     Env_add_buildin(_env, "if", buildin_if);
     Env_add_buildin(_env, "unless", buildin_unless);
-    Env_add_buildin(_env, "not", buildin_not);
+    Env_add_pure_buildin(_env, "not", buildin_not);
 
     /*Type management*/
-    Env_add_buildin(_env, "nil?", buildin_nilp);
-    Env_add_buildin(_env, "value?", buildin_valuep);
-    Env_add_buildin(_env, "real?", buildin_realp);
-    Env_add_buildin(_env, "decimal?", buildin_decimalp);
-    Env_add_buildin(_env, "symbol?", buildin_symbolp);
-    Env_add_buildin(_env, "string?", buildin_stringp);
-    Env_add_buildin(_env, "list?", buildin_listp);
+    Env_add_pure_buildin(_env, "nil?", buildin_nilp);
+    Env_add_pure_buildin(_env, "value?", buildin_valuep);
+    Env_add_pure_buildin(_env, "real?", buildin_realp);
+    Env_add_pure_buildin(_env, "decimal?", buildin_decimalp);
+    Env_add_pure_buildin(_env, "symbol?", buildin_symbolp);
+    Env_add_pure_buildin(_env, "string?", buildin_stringp);
+    Env_add_pure_buildin(_env, "list?", buildin_listp);
     Env_add_buildin(_env, "var?", buildin_varp);
     Env_add_buildin(_env, "const?", buildin_constp);
     Env_add_buildin(_env, "fn?", buildin_fnp);
@@ -2536,5 +3393,38 @@ Env_add_core(Environment* _env)
     Env_add_constant(_env, "E-constant", decimal(_env, 0.57721));
 }
 
+#ifdef ALLOCATOR_H
+/*Adapter for the dynamic allocator of allocators/allocator.h, which must be
+  included before yal.h. The environment then lives in the allocator region:
+
+      dynallocator da = {0};
+      dynalc_init(&da, region(mem, len));
+      Env_new_with_allocator(&env, YalAllocator_dynalc(&da));
+*/
+void*
+_yal_dynalc_alloc(void* _ctx, size_t _n)
+{
+    return dynalc_malloc((dynallocator*)_ctx, (int)_n);
+}
+
+void*
+_yal_dynalc_resize(void* _ctx, void* _p, size_t _n)
+{
+    return dynalc_realloc((dynallocator*)_ctx, _p, (uint32_t)_n);
+}
+
+void
+_yal_dynalc_release(void* _ctx, void* _p)
+{
+    dynalc_free((dynallocator*)_ctx, _p);
+}
+
+YalAllocator
+YalAllocator_dynalc(dynallocator* _da)
+{
+    return (YalAllocator){_da, _yal_dynalc_alloc, _yal_dynalc_resize, _yal_dynalc_release};
+}
+#endif /*ALLOCATOR_H*/
+
 #endif /*YAL_IMPLEMENTATION*/
 #endif /*YAL_H*/